@@ -6,11 +6,18 @@
 #include <inttypes.h>
 #include <ctype.h>
 #include "automaton/2d_automaton.h"
+#include "automaton/batch.h"
+#include "automaton/engine.h"
+#include "automaton/kernels.h"
 #include "automaton/rule.h"
+#include "automaton/stats.h"
 #include "nn/nn.h"
 #include "utils/compress.h"
+#include "utils/cycle.h"
+#include "utils/frame_lz.h"
 #include "utils/utils.h"
 #include "utils/hashmap.h"
+#include "utils/size_queue.h"
 
 #if PROFILE
 #define PROF(x) {\
@@ -28,6 +35,7 @@
 #define PERT 1E-15
 #define WINDOW 501
 #define W_STEP 13
+#define ENTROPY_SCORES 12 /* Predictive score and entropy of the 6 maps */
 
 
 typedef struct masking_element
@@ -129,6 +137,9 @@ int parse_pattern(size_t size, uint8_t* a, FILE* pattern_file)
   size_t x = size/2, y = size/2; /* Pattern's upper left corner is the center
                                     of the automaton */
 
+  /* If BG is not given, the background is 0 */
+  memset(a, 0, size * size * sizeof(uint8_t));
+
   while ((ch = fgetc(pattern_file)) != EOF && pattern_start != -1)  {
     switch (ch) {
     case '#':
@@ -177,14 +188,6 @@ int parse_pattern(size_t size, uint8_t* a, FILE* pattern_file)
     }
   }
 
-  /* If BG was not given, initialize all to 0 */
-  for (size_t i = 0; i < size; ++i) {
-    for (size_t j = 0; j < size; ++j) {
-      a[i * size + j] = (uint8_t)0;
-    }
-  }
-
-
   fclose(pattern_file);
   return pattern_start;
 }
@@ -192,114 +195,45 @@ int parse_pattern(size_t size, uint8_t* a, FILE* pattern_file)
 /**
  * Function that updates the automaton state from the buffer last_autom to the
  * buffer autom. It uses a rule stored as a lookup table.
+ *
+ * Both buffers are padded frames with a halo of width horizon (see
+ * automaton/kernels.h), so every cell reads its neighbors without wrapping.
+ * Only the rows [row_begin, row_end) are updated.
  */
 void update_step_general(size_t size,
                          uint8_t* autom,
                          uint8_t* rule,
                          uint8_t* last_autom,
                          int horizon,
-                         uint32_t* pows)
+                         uint32_t* pows,
+                         size_t row_begin,
+                         size_t row_end)
 {
+  size_t pitch = size + 2 * horizon;
   uint32_t position;
   uint8_t current_value;
   int increment;
 
-  /* Take care of cells not on boundary first */
-  for (size_t i = horizon; i < size - horizon; i++) {
-    for (size_t j = horizon; j < size - horizon; j++) {
+  for (size_t i = row_begin + horizon; i < row_end + horizon; i++) {
+    for (size_t j = horizon; j < size + horizon; j++) {
       position = 0;
       increment = 0;
       for (int k = - horizon; k <= horizon; k++) {
         for (int l = - horizon; l <= horizon; l++) {
-          current_value = last_autom[(i + k) * size
+          current_value = last_autom[(i + k) * pitch
                                      + (j + l)];
           position += current_value * pows[increment];
           ++increment;
         }
       }
-      autom[i * size + j] = rule[position];
-    }
-  }
-
-  /* Deal with boundary conditions separately */
-  /* TODO: These boundary conditions updates only work with horizon=1 */
-  /* First and last line */
-  for (size_t j = 0; j < size; ++j) {
-    position = 0;
-    increment = 0;
-    for (int k = - horizon; k <= horizon; k++) {
-      for (int l = - horizon; l <= horizon; l++) {
-        current_value = last_autom[((k + size) % size) * size
-                                   + ((j + l + size) % size)];
-        position += current_value * pows[increment];
-        ++increment;
-      }
-    }
-    autom[j] = rule[position];
-
-    position = 0;
-    increment = 0;
-    for (int k = - horizon; k <= horizon; k++) {
-      for (int l = - horizon; l <= horizon; l++) {
-        current_value = last_autom[((size - 1 + k + size) % size) * size
-                                   + ((j + l + size) % size)];
-        position += current_value * pows[increment];
-        ++increment;
-      }
+      autom[i * pitch + j] = rule[position];
     }
-    autom[(size - 1) * size + j] = rule[position];
   }
 
-  /* First and last column */
-  for (size_t i = 0; i < size; ++i) {
-    position = 0;
-    increment = 0;
-    for (int k = - horizon; k <= horizon; k++) {
-      for (int l = - horizon; l <= horizon; l++) {
-        current_value = last_autom[((i + k + size) % size) * size
-                                   + ((l + size) % size)];
-        position += current_value * pows[increment];
-        ++increment;
-      }
-    }
-    autom[i * size] = rule[position];
-
-    position = 0;
-    increment = 0;
-    for (int k = - horizon; k <= horizon; k++) {
-      for (int l = - horizon; l <= horizon; l++) {
-        current_value = last_autom[((i + k + size) % size) * size
-                                   + ((size - 1 + l + size) % size)];
-        position += current_value * pows[increment];
-        ++increment;
-      }
-    }
-    autom[i * size + size - 1] = rule[position];
-  }
+  refresh_halo_rows(size, autom, horizon, row_begin, row_end);
 }
 
 
-/**
- * Count the cells in each state and return the minority state cell count
- */
-int count_cells(size_t size, uint8_t* A, int states)
-{
-  int* counts = (int*)calloc(states, sizeof(int));
-  for (size_t i = 0; i < size; ++i) {
-    for (size_t j = 0; j < size; ++j) {
-      counts[A[i* size + j]] += 1;
-    }
-  }
-  int value = counts[0];
-  for (int i = 0; i < states; ++i) {
-    if (counts[i] < value) {
-      value = counts[i];
-    }
-  }
-  free(counts);
-  return value + 1;
-}
-
 int normalize_probs(any_t states, any_t data)
 {
   data_struct_t* in = (data_struct_t*) data;
@@ -319,20 +253,18 @@ int normalize_probs(any_t states, any_t data)
 
 void build_key_string(int key_len, char key[key_len],
                       size_t size, uint8_t* automaton,
-                      int offset, size_t i, size_t j)
-{
-  int key_index;
-  for (int a = -offset; a < offset + 1; a++) {
-    for (int b = -offset; b < offset + 1; b++) {
-      key_index = (a + offset) * (2 * offset + 1) + (b + offset);
-      if (a == 0 && b == 0) {
-        key[key_index] = 'x';
-      }
-      else {
-        key[key_index] =
-          '0' + automaton[((i + a + size) % size) * size
-                          + ((j + b + size) % size)];
-      }
+                      neighborhood_t* window, size_t i, size_t j)
+{
+  for (int p = 0; p < window->cells; p++) {
+    int a = window->dy[p];
+    int b = window->dx[p];
+    if (a == 0 && b == 0) {
+      key[p] = 'x';
+    }
+    else {
+      key[p] =
+        '0' + automaton[((i + a + size) % size) * size
+                        + ((j + b + size) % size)];
     }
   }
   key[key_len - 1] = '\0';
@@ -340,20 +272,20 @@ void build_key_string(int key_len, char key[key_len],
 
 entrop_state_ph_t* populate_map(map_t* map, size_t size,
                                 uint8_t* automaton,
-                                int offset, int states)
+                                neighborhood_t* window, int states)
 {
   data_struct_t* value;
   entrop_state_ph_t* out_data =
     (entrop_state_ph_t *) calloc(1, sizeof(entrop_state_ph_t));
 
-  int key_len = (2*offset + 1) * (2*offset + 1) + 1;
+  int key_len = window->cells + 1;
   char key[key_len];
   int error;
   out_data->entropy = 0.0;
 
   for (size_t i = 0; i < size; i++) {
     for (size_t j = 0; j < size; j++) {
-      build_key_string(key_len, key, size, automaton, offset, i, j);
+      build_key_string(key_len, key, size, automaton, window, i, j);
       error = hashmap_get(map, key, (void**)(&value));
 
       if (error==MAP_MISSING) {
@@ -372,7 +304,7 @@ entrop_state_ph_t* populate_map(map_t* map, size_t size,
 
   for (size_t i = 0; i < size; i++) {
     for (size_t j = 0; j < size; j++) {
-      build_key_string(key_len, key, size, automaton, offset, i, j);
+      build_key_string(key_len, key, size, automaton, window, i, j);
       error = hashmap_get(map, key, (void**)(&value));
       if (error==MAP_MISSING) {
         out_data->entropy += -log( 1 / (double) states );
@@ -411,17 +343,17 @@ entrop_state_ph_t* entropy_score(map_t map, int states)
 }
 
 double predictive_score(map_t map, int states, size_t size,
-                        uint8_t* automaton, int offset)
+                        uint8_t* automaton, neighborhood_t* window)
 {
   data_struct_t* value;
-  int key_len = (2*offset + 1) * (2*offset + 1) + 1;
+  int key_len = window->cells + 1;
   char key[key_len];
   int error;
   double result = 0;
 
   for (size_t i = 0; i < size; i++) {
     for (size_t j = 0; j < size; j++) {
-      build_key_string(key_len, key, size, automaton, offset, i, j);
+      build_key_string(key_len, key, size, automaton, window, i, j);
       error = hashmap_get(map, key, (void**)(&value));
       if (error==MAP_MISSING) {
         result += - log(1/(double)states);
@@ -452,14 +384,20 @@ void free_map(map_t map)
   hashmap_free(map);
 }
 
+/**
+ * Write the predictive score and entropy of a map to a file, and store them in
+ * scores[0] and scores[1].
+ */
 void add_entropy_results_to_file(map_t map_source, size_t size,
                          uint8_t* automaton, int states,
-                         int offset, FILE* file, entrop_state_ph_t* result)
+                         neighborhood_t* window, FILE* file,
+                         entrop_state_ph_t* result, double scores[2])
 {
   if (result) {
+    scores[0] = predictive_score(map_source, states, size, automaton, window);
+    scores[1] = result->entropy;
     fprintf(file, "%f    %f    %"PRIu32"    ",
-            predictive_score(map_source, states, size, automaton, offset),
-            result->entropy, result->visited);
+            scores[0], result->entropy, result->visited);
     free(result);
   }
 }
@@ -520,142 +458,684 @@ void random_noise(size_t size, uint8_t* automaton, int states, double rate)
   }
 }
 
-void compress_double(int step, FILE* out_file,
-                     char* dbl_pholder, size_t size, char* out_string,
-                     int compressed_size, int last_compressed_size,
-                     int cell_count, int last_cell_count)
+/**
+ * Write the compressed sizes of a grain step with the joint complexity. The
+ * ratios compare the sizes of the grain frame and the previous one alone
+ * with their joint size `dbl_comp_size`, all measured by the same
+ * compressor, and `cumulative` is the size of all the frames up to the step.
+ */
+static void write_joint(FILE* out_file, int step, int compressed_size,
+                        long alone, long last_alone, long dbl_comp_size,
+                        long cumulative, int cell_count, int last_cell_count)
 {
   double ratio = 0., ratio2 = 0.;
-  int size_sum;
-
-  memcpy(&dbl_pholder[size * size + 1],
-         out_string, size * size + 1);
-
-  int dbl_comp_size =
-    compress_memory_size(dbl_pholder, step * ((size + 1) * size + 1));
-  memcpy(dbl_pholder, out_string, (size + 1) * size + 1);
+  long size_sum;
 
   if (step > 0) {
-    size_sum = last_compressed_size + compressed_size;
+    size_sum = last_alone + alone;
     ratio2 = (size_sum - dbl_comp_size)/(float)size_sum;
-    ratio = ( (last_compressed_size / (float)last_cell_count) +
-              (compressed_size / (float)cell_count) ) /
+    ratio = ( (last_alone / (float)last_cell_count) +
+              (alone / (float)cell_count) ) /
       (dbl_comp_size / (float)(last_cell_count + cell_count));
   }
   fprintf(out_file, "%i    %i    %f    %f    "
-          "%i    %i    %i\n",
+          "%i    %i    %li    %li\n",
           step, compressed_size, ratio, ratio2,
           cell_count, last_cell_count,
-          dbl_comp_size);
+          dbl_comp_size, cumulative);
 
 }
 
 /**
- * Main entrypoint that handles all the automaton processing.
+ * Tell if the frame obtained after step i is read by the measurements, either
+ * right after the step or at the beginning of the next one. Engines only need
+ * to write their state back to the flat frame at those steps.
  */
-void process_rule(uint64_t grule_size, uint8_t rule[grule_size],
-                  char rule_buf[],
-                  long steps,
-                  struct Options2D* opts,
-                  results_nn_t* results)
+static int frame_needed(long i, long steps, struct Options2D* opts)
+{
+  if (opts->mask == MASK) {
+    return 1;
+  }
+  if (opts->grain_write > 0 && i % opts->grain_write == 0
+      && opts->save_steps == 1) {
+    return 1;
+  }
+  if (opts->output_data == NO_OUTPUT) {
+    return 0;
+  }
+  return opts->joint_complexity == 1
+    || i % opts->grain == 0
+    || i == steps - WINDOW
+    || (i > (steps - WINDOW) && (i - (steps - WINDOW)) % W_STEP == 0)
+    || i == steps - 51
+    || i == steps - 5
+    || i == steps - 1;
+}
+
+/**
+ * Measurements done on the frames of one automaton: output files, early
+ * stopping state and the frames kept for the entropy and neural network
+ * metrics.
+ */
+typedef struct measure_s
+{
+  char* rule_buf;
+  results_nn_t* results;
+
+  FILE* out_file;
+  char* fname;
+  FILE* active_file;
+  char* active_fname;
+  FILE* entrop_file;
+  char* entrop_fname;
+  FILE* nn_file;
+  char* nn_fname;
+  FILE* fisher_file;
+  char* fisher_fname;
+  FILE* stats_file;
+  char* stats_fname;
+
+  compressor_t* compressor; /**< Context of all the compressed sizes */
+  estimator_t* estimator; /**< Compressed size of the grain frames */
+  size_queue_t* queue; /**< Workers computing them instead, NULL if none */
+  int last_compressed_size;
+  int compressed_size;
+  int last_cell_count;
+  int cell_count;
+  cycle_t cycle; /**< Cycle entered by the trajectory (early stopping) */
+  engine_t* engine; /**< Engine whose state_hash, if any, identifies the
+                       states of the trajectory instead of the frames */
+  int stopped; /**< Set when the early stopping mechanism triggered */
+  step_stats_t stats; /**< Statistics of the frame when not given */
+
+  uint8_t* automat5;
+  uint8_t* automat50;
+  uint8_t* automat300;
+  uint8_t** test_automata;
+
+  compressor_t* joint; /**< Stream of all the printed frames, for joint
+                          complexity */
+  frame_lz_t* joint_lz; /**< Same with the long window matcher */
+  frame_lz_t* pair_lz; /**< Matcher of the pairwise sizes with joint_lz */
+  uint8_t* last_grain; /**< Previous grain frame, for the pairwise sizes */
+  char* pair_string; /**< Printed previous grain frame */
+  char* out_string;
+  long printed; /**< Generation printed in out_string, -1 if none */
+  char* out_string300;
+  char* out_string50;
+  char* out_string5;
+
+  map_t map300;
+  map_t map50;
+  map_t map5;
+  map_t map300b;
+  map_t map50b;
+  map_t map5b;
+  entrop_state_ph_t *res300, *res50, *res5, *res300b, *res50b, *res5b;
+  neighborhood_t window_a; /**< Cells of the keys of the first maps */
+  neighborhood_t window_b; /**< Same for the maps suffixed by b */
+
+  /* Grain steps measured, written to out_file once their size is known */
+  int* grain_steps;
+  int* cell_counts; /**< Minority state cell count, plus one */
+  long* joint_sizes; /**< Compressed size of the frames up to the step */
+  long* alone_sizes; /**< Size of the grain frame alone and with the */
+  long* pair_sizes;  /**< previous one, by the joint compressor */
+  int n_grains;
+
+  /* Values of the metrics, for the statistics of an ensemble */
+  int* sizes; /**< Compressed size at each grain step */
+  int n_sizes; /**< Sizes known and written */
+  double entropy[ENTROPY_SCORES]; /**< Scores of the 6 entropy maps */
+  int has_entropy;
+  network_result_t nn;
+  int has_nn;
+} measure_t;
+
+/**
+ * Prepare the measurements of a rule. `workers` threads compute the
+ * compressed sizes in the background, 0 to compute them in measure_frame.
+ */
+static void measure_init(measure_t* m, char rule_buf[], long steps,
+                         struct Options2D* opts, results_nn_t* results,
+                         int activity, int workers)
+{
+  size_t size = opts->size;
+  size_t length = (size + 1) * size + 1;
+
+  memset(m, 0, sizeof(measure_t));
+  m->rule_buf = rule_buf;
+  m->results = results;
+  m->printed = -1;
+  cycle_init(&m->cycle);
+  m->compressor = compressor_new(Z_BEST_COMPRESSION, Z_DEFAULT_STRATEGY);
+  m->estimator = estimator_new(opts->estimator, size, opts->states,
+                               m->compressor);
+  if (workers > 0 && opts->output_data != NO_OUTPUT) {
+    m->queue = size_queue_new(workers, 2 * workers, opts->estimator, size,
+                              opts->states);
+  }
+
+  m->test_automata =
+    (uint8_t**) calloc(WINDOW / W_STEP, sizeof(uint8_t*));
+
+  if (opts->output_data != NO_OUTPUT) {
+    asprintf(&m->fname, "%s/out/out%s.dat", opts->data_dir_name, rule_buf);
+    m->out_file = fopen(m->fname, "w+");
+
+    asprintf(&m->stats_fname, "%s/var/stats%s.dat", opts->data_dir_name,
+             rule_buf);
+    m->stats_file = fopen(m->stats_fname, "w+");
+
+    if (activity) {
+      asprintf(&m->active_fname, "%s/var/active%s.dat", opts->data_dir_name,
+               rule_buf);
+      m->active_file = fopen(m->active_fname, "w+");
+    }
+
+    m->automat5 = (uint8_t*) calloc(size * size, sizeof(uint8_t));
+    m->automat50 = (uint8_t*) calloc(size * size, sizeof(uint8_t));
+    m->automat300 = (uint8_t*) calloc(size * size, sizeof(uint8_t));
+
+    for (int i = 0; i < (WINDOW / W_STEP); ++i) {
+      m->test_automata[i] = (uint8_t*) calloc(size * size, sizeof(uint8_t));
+    }
+
+    if (opts->joint_complexity == 1
+        && opts->joint_compressor == JOINT_LONG) {
+      m->joint_lz = frame_lz_new(size, size, opts->states);
+      m->pair_lz = frame_lz_new(size, size, opts->states);
+    }
+    else if (opts->joint_complexity == 1) {
+      m->joint = compressor_new(Z_BEST_COMPRESSION, Z_DEFAULT_STRATEGY);
+    }
+    if (opts->joint_complexity == 1) {
+      m->last_grain = (uint8_t*) malloc(size * size * sizeof(uint8_t));
+      m->pair_string = (char*) malloc(length);
+    }
+  }
+
+  m->sizes = (int*) malloc((steps / opts->grain + 1) * sizeof(int));
+  m->grain_steps = (int*) malloc((steps / opts->grain + 1) * sizeof(int));
+  m->cell_counts = (int*) malloc((steps / opts->grain + 1) * sizeof(int));
+  m->joint_sizes = (long*) malloc((steps / opts->grain + 1) * sizeof(long));
+  m->alone_sizes = (long*) malloc((steps / opts->grain + 1) * sizeof(long));
+  m->pair_sizes = (long*) malloc((steps / opts->grain + 1) * sizeof(long));
+  m->out_string = (char*) malloc(length);
+  m->out_string300 = (char*) malloc(length);
+  m->out_string50 = (char*) malloc(length);
+  m->out_string5 = (char*) malloc(length);
+
+  m->map300 = hashmap_new();
+  m->map50 = hashmap_new();
+  m->map5 = hashmap_new();
+  m->map300b = hashmap_new();
+  m->map50b = hashmap_new();
+  m->map5b = hashmap_new();
+  /* Windows of the shape of the rule neighborhood */
+  neighborhood_init(&m->window_a, neighborhood_window_shape(
+                      &opts->neighborhood), 2);
+  neighborhood_init(&m->window_b, neighborhood_window_shape(
+                      &opts->neighborhood), 1);
+}
+
+/**
+ * Push the state of generation `step`, whose frame hashes to `hash`, to the
+ * cycle detection. Writes the cycle when it closes one and sets m->stopped
+ * with early stopping.
+ */
+static void measure_cycle(measure_t* m, long step, uint64_t hash,
+                          struct Options2D* opts)
+{
+  if (m->engine && m->engine->state_hash) {
+    hash = m->engine->state_hash(m->engine);
+  }
+  if (!cycle_push(&m->cycle, step, hash)) {
+    return;
+  }
+
+  char* cycle_fname;
+  asprintf(&cycle_fname, "%s/var/cycle%s.dat", opts->data_dir_name,
+           m->rule_buf);
+  FILE* cycle_file = fopen(cycle_fname, "w+");
+  fprintf(cycle_file, "%li    %li\n", m->cycle.period, m->cycle.transient);
+  fclose(cycle_file);
+  free(cycle_fname);
+
+  if (opts->early == EARLY) {
+    printf("\n");
+    m->stopped = 1;
+  }
+}
+
+/** Feed the frame at the beginning of step i to the joint complexity */
+static void measure_joint(measure_t* m, int i, uint8_t* frame,
+                          struct Options2D* opts)
+{
+  size_t size = opts->size;
+
+  /* The initial frame starts the trajectory of the cycle detection */
+  if (i == 0) {
+    frame_stats(&m->stats, size, opts->states, frame, NULL);
+    measure_cycle(m, 0, m->stats.hash, opts);
+  }
+
+  if (m->joint_lz) {
+    frame_lz_feed(m->joint_lz, frame);
+  }
+  else if (opts->joint_complexity == 1 && opts->output_data != NO_OUTPUT) {
+    /* Already printed when the previous step was saved, unless the mask
+       changed it since */
+    if (m->printed != i || opts->mask == MASK) {
+      print_bits(size, size, frame, m->out_string);
+      m->printed = i;
+    }
+    compressor_feed(m->joint, m->out_string, (size + 1) * size);
+  }
+}
+
+/**
+ * Write the grain steps whose compressed size is known, in step order. With
+ * workers, waits for the sizes when `all` is set or the queue is full, so
+ * that a frame can be pushed.
+ */
+static void write_sizes(measure_t* m, int all)
+{
+  while (m->n_sizes < m->n_grains) {
+    int k = m->n_sizes;
+    if (m->queue && !size_queue_pop(m->queue,
+                                    all || size_queue_full(m->queue),
+                                    &m->sizes[k])) {
+      break;
+    }
+    m->n_sizes++;
+
+    m->last_compressed_size = m->compressed_size;
+    m->last_cell_count = m->cell_count;
+    m->compressed_size = m->sizes[k];
+    m->cell_count = m->cell_counts[k];
+
+    if (m->joint || m->joint_lz) {
+      write_joint(m->out_file, m->grain_steps[k], m->compressed_size,
+                  m->alone_sizes[k], (k > 0) ? m->alone_sizes[k - 1]: 0,
+                  m->pair_sizes[k], m->joint_sizes[k], m->cell_count,
+                  m->last_cell_count);
+    } else {
+      fprintf(m->out_file, "%i    %i\n", m->grain_steps[k],
+              m->compressed_size);
+    }
+
+    printf("%i  ", m->compressed_size);
+    fflush(stdout);
+  }
+}
+
+/** Print the frame of generation i + 1 to out_string if not already there */
+static void print_frame(measure_t* m, int i, uint8_t* frame, size_t size)
+{
+  if (m->printed != i + 1) {
+    print_bits(size, size, frame, m->out_string);
+    m->printed = i + 1;
+  }
+}
+
+/**
+ * Sizes of the grain frame k obtained after step i alone and along with the
+ * previous grain frame, measured by the compressor of the joint complexity.
+ * The long window matcher adds the size of the frame conditioned on the
+ * previous one to the size of the previous one. Deflate reads the frame and
+ * then the previous one in a single stream, the joint size of the pair not
+ * depending on their order.
+ */
+static void measure_pair(measure_t* m, int k, int i, uint8_t* frame,
+                         size_t size)
+{
+  size_t length = (size + 1) * size;
+
+  if (m->pair_lz) {
+    frame_lz_reset(m->pair_lz);
+    uint64_t alone = frame_lz_feed(m->pair_lz, frame);
+    uint64_t pair = alone;
+    if (k > 0) {
+      frame_lz_reset(m->pair_lz);
+      pair = frame_lz_feed(m->pair_lz, m->last_grain);
+      pair += frame_lz_feed(m->pair_lz, frame);
+    }
+    m->alone_sizes[k] = (long) ((alone + 7) / 8);
+    m->pair_sizes[k] = (long) ((pair + 7) / 8);
+    memcpy(m->last_grain, frame, size * size * sizeof(uint8_t));
+    return;
+  }
+
+  print_frame(m, i, frame, size);
+  compressor_reset(m->compressor);
+  compressor_feed(m->compressor, m->out_string, length);
+  m->alone_sizes[k] = compressor_flushed_size(m->compressor);
+  if (k > 0) {
+    print_bits(size, size, m->last_grain, m->pair_string);
+    compressor_feed(m->compressor, m->pair_string, length);
+  }
+  m->pair_sizes[k] = compressor_flushed_size(m->compressor);
+  memcpy(m->last_grain, frame, size * size * sizeof(uint8_t));
+}
+
+/**
+ * Measurements on the frame obtained after step i, sets m->stopped when the
+ * automaton entered a cycle. `stats` are the statistics of the frame fused
+ * into the step by the engine, computed here when NULL.
+ */
+static void measure_frame(measure_t* m, int i, long steps, uint8_t* frame,
+                          step_stats_t* stats, struct Options2D* opts)
 {
   int states = opts->states;
   size_t size = opts->size;
 
-  FILE* out_file = NULL;
-  char* fname = NULL;
+  /* Save steps every grain_write */
+  if (opts->grain_write > 0
+      && i % opts->grain_write == 0
+      && opts->save_steps == 1) {
 
-  FILE* mult_time_file = NULL;
-  char* mult_time_fname = NULL;
+    FILE* out_step_file;
+    char* step_fname;
 
-  FILE* entrop_file = NULL;
-  char* entrop_fname = NULL;
+    print_frame(m, i, frame, size);
+    if (opts->save_flag == TMP_FILE) {
+      asprintf(&step_fname, "%s/tmp_%i.step", opts->out_step_dir, i);
+    }
+    else {
+      asprintf(&step_fname, "%s/steps/out%s_%i.step",
+               opts->data_dir_name, m->rule_buf, i);
+    }
 
-  FILE* nn_file = NULL;
-  char* nn_fname = NULL;
+    out_step_file = fopen(step_fname, "w+");
+    free(step_fname);
+    fprintf(out_step_file, "%s", m->out_string);
+    fclose(out_step_file);
+  }
 
-  FILE* fisher_file = NULL;
-  char* fisher_fname = NULL;
+  if (opts->output_data == NO_OUTPUT) {
+    return;
+  }
 
-  int last_compressed_size;
-  int compressed_size;
-  int last_cell_count;
-  int cell_count = 0;
+  if (stats == NULL) {
+    frame_stats(&m->stats, size, states, frame, NULL);
+    stats = &m->stats;
+  }
 
-  ProcessF process_function = update_step_general;
+  /* Step, changed cells, bounding box (-1 when empty) and histogram */
+  int empty = stats->row_min > stats->row_max;
+  fprintf(m->stats_file, "%i    %"PRId64"    %li %li %li %li   ", i,
+          stats->changed, empty ? -1: (long) stats->row_min,
+          empty ? -1: (long) stats->row_max,
+          empty ? -1: (long) stats->col_min,
+          empty ? -1: (long) stats->col_max);
+  for (int k = 0; k < states; ++k) {
+    fprintf(m->stats_file, " %"PRIu64, stats->histogram[k]);
+  }
+  fprintf(m->stats_file, "\n");
 
-  uint8_t* (*frame1) = malloc(sizeof(uint8_t* (*)));
-  *frame1 = (uint8_t*) malloc(size * size * sizeof(uint8_t));
-  uint8_t* (*frame2) = malloc(sizeof(uint8_t* (*)));
-  *frame2 = (uint8_t*) malloc(size * size * sizeof(uint8_t));
-  uint8_t* (*temp_frame);
+  /* Stop mechanism, the frame being the state at generation i + 1 */
+  measure_cycle(m, i + 1, stats->hash, opts);
+  if (m->stopped) {
+    return;
+  }
 
-  int pert = (int) (opts->noise_rate * (double) size * (double) size);
+  if (i % opts->grain == 0) {
+    int k = m->n_grains++;
+    m->grain_steps[k] = i;
 
-  masking_element_t* mask = NULL;
-  if (opts->mask == MASK) {
-      mask = (masking_element_t*) calloc(pert, sizeof(masking_element_t));
+    /* Minority state cell count, plus one */
+    uint64_t minority = stats->histogram[0];
+    for (int s = 1; s < states; ++s) {
+      if (stats->histogram[s] < minority) {
+        minority = stats->histogram[s];
+      }
+    }
+    m->cell_counts[k] = (int) minority + 1;
+
+    if (opts->joint_complexity == 1) {
+      m->joint_sizes[k] = m->joint_lz ? frame_lz_size(m->joint_lz)
+        : compressor_flushed_size(m->joint);
+      measure_pair(m, k, i, frame, size);
+    }
+
+    if (m->queue) {
+      /* Frees a slot first if needed */
+      write_sizes(m, 0);
+      size_queue_push(m->queue, frame);
+    }
+    else {
+      m->sizes[k] = estimator_size(m->estimator, frame);
+    }
+    write_sizes(m, 0);
+  }
+
+  if (i == steps - WINDOW) {
+    print_bits(size, size, frame, m->out_string300);
+    m->res300 = populate_map(m->map300, size, frame, &m->window_a, states);
+    m->res300b = populate_map(m->map300b, size, frame, &m->window_b, states);
+
+    memcpy(m->automat300, frame, size * size * sizeof(uint8_t));
+  }
+  if (i > (steps - WINDOW) && (i - (steps - WINDOW)) % W_STEP == 0) {
+    memcpy(m->test_automata[((i - (steps - WINDOW)) / W_STEP) - 1],
+           frame, size * size * sizeof(uint8_t));
   }
 
+  if (i == steps - 51) {
+    print_bits(size, size, frame, m->out_string50);
+    m->res50 = populate_map(m->map50, size, frame, &m->window_a, states);
+    m->res50b = populate_map(m->map50b, size, frame, &m->window_b, states);
+
+    memcpy(m->automat50, frame, size * size * sizeof(uint8_t));
+  }
+  if (i == steps - 5) {
+    print_bits(size, size, frame, m->out_string5);
+    m->res5 = populate_map(m->map5, size, frame, &m->window_a, states);
+    m->res5b = populate_map(m->map5b, size, frame, &m->window_b, states);
+
+    memcpy(m->automat5, frame, size * size * sizeof(uint8_t));
+  }
+  if (i == steps - 1) {
+    /* The sizes are all written before the long metrics */
+    write_sizes(m, 1);
 
+    asprintf(&m->entrop_fname, "data_2d_%i/ent/ent%s.dat", states,
+             m->rule_buf);
+    m->entrop_file = fopen(m->entrop_fname, "w+");
+
+    add_entropy_results_to_file(m->map300, size, frame, states, &m->window_a,
+                        m->entrop_file, m->res300, &m->entropy[0]);
+    add_entropy_results_to_file(m->map50, size, frame, states, &m->window_a,
+                        m->entrop_file, m->res50, &m->entropy[2]);
+    add_entropy_results_to_file(m->map5, size, frame, states, &m->window_a,
+                        m->entrop_file, m->res5, &m->entropy[4]);
+    fprintf(m->entrop_file, "\n");
+
+
+    add_entropy_results_to_file(m->map300b, size, frame, states, &m->window_b,
+                        m->entrop_file, m->res300b, &m->entropy[6]);
+    add_entropy_results_to_file(m->map50b, size, frame, states, &m->window_b,
+                        m->entrop_file, m->res50b, &m->entropy[8]);
+    add_entropy_results_to_file(m->map5b, size, frame, states, &m->window_b,
+                        m->entrop_file, m->res5b, &m->entropy[10]);
+    fprintf(m->entrop_file, "\n");
+    m->has_entropy = 1;
+
+
+    asprintf(&m->nn_fname, "data_2d_%i/nn/nn%s.dat", states, m->rule_buf);
+    m->nn_file = fopen(m->nn_fname, "w+");
+
+    asprintf(&m->fisher_fname, "data_2d_%i/nn/fisher%s.dat", states,
+             m->rule_buf);
+    m->fisher_file = fopen(m->fisher_fname, "w+");
+
+    network_result_t res = {1., 1., 1., 0.};
+    network_opts_t n_opts = {10, 40, 3, MOMENTUM, DECAY, NO_FISHER, 1,
+      neighborhood_window_shape(&opts->neighborhood)};
+
+    for (int i = 4; i < 5; ++i) {
+      n_opts.num_hid = 10;
+      n_opts.offset = i;
+      n_opts.fisher = NO_FISHER;
+
+      train_nn_on_automaton(size, states, m->automat300, m->test_automata,
+                            WINDOW / W_STEP, &n_opts, &res);
+
+      add_nn_results_to_file(m->nn_file, &n_opts, &res, 50);
+      fprintf(m->fisher_file, "%f", res.error_var);
+
+      m->results->nn_tr_50 = res.error_var;
+      m->results->nn_te_50 = 1.;
+    }
+    m->nn = res;
+    m->has_nn = 1;
+  }
+}
+
+static void measure_free(measure_t* m)
+{
+  free_map(m->map5);
+  free_map(m->map300);
+  free_map(m->map50);
+  free_map(m->map5b);
+  free_map(m->map300b);
+  free_map(m->map50b);
+  estimator_free(m->estimator);
+  if (m->queue) {
+    size_queue_free(m->queue);
+  }
+  compressor_free(m->compressor);
+  neighborhood_free(&m->window_a);
+  neighborhood_free(&m->window_b);
+
+  for (int i = 0; i < WINDOW / W_STEP; ++i) {
+    free(m->test_automata[i]);
+  }
+  free(m->test_automata);
+
+  free(m->automat5);
+  free(m->automat50);
+  free(m->automat300);
+
+  if (m->joint) {
+    compressor_free(m->joint);
+  }
+  if (m->joint_lz) {
+    frame_lz_free(m->joint_lz);
+    frame_lz_free(m->pair_lz);
+  }
+  free(m->sizes);
+  free(m->grain_steps);
+  free(m->cell_counts);
+  free(m->joint_sizes);
+  free(m->alone_sizes);
+  free(m->pair_sizes);
+  free(m->last_grain);
+  free(m->pair_string);
+  free(m->out_string);
+  free(m->out_string300);
+  free(m->out_string50);
+  free(m->out_string5);
+
+  if (m->fname) {
+    free(m->fname);
+    fclose(m->out_file);
+  }
+
+  if (m->active_file) {
+    free(m->active_fname);
+    fclose(m->active_file);
+  }
+
+  if (m->stats_file) {
+    free(m->stats_fname);
+    fclose(m->stats_file);
+  }
+
+  if (m->entrop_file) {
+    free(m->entrop_fname);
+    fclose(m->entrop_file);
+  }
+  if (m->nn_file) {
+    free(m->nn_fname);
+    fclose(m->nn_file);
+  }
+  if (m->fisher_file) {
+    free(m->fisher_fname);
+    fclose(m->fisher_file);
+  }
+}
+
+/** Initial frame from the pattern file or the random initialization */
+static void init_frame(uint8_t* frame, struct Options2D* opts)
+{
   if (opts->init_pattern_file == NULL) {
-    init_automat(size, *frame1, states, opts->init_type);
+    init_automat(opts->size, frame, opts->states, opts->init_type);
   }
-  else if (parse_pattern(size, *frame1, opts->init_pattern_file) <= 0){
+  else if (parse_pattern(opts->size, frame, opts->init_pattern_file) <= 0){
     fprintf(stderr, "Error parsing initialization pattern\n");
     exit(EXIT_FAILURE);
   }
+}
+
+static void process_rule_ensemble(uint8_t* rule, char rule_buf[], long steps,
+                                  struct Options2D* opts,
+                                  results_nn_t* results);
 
-  memcpy(*frame2, *frame1, size * size * sizeof(uint8_t));
+/**
+ * Main entrypoint that handles all the automaton processing.
+ */
+void process_rule(uint64_t grule_size, uint8_t rule[grule_size],
+                  char rule_buf[],
+                  long steps,
+                  struct Options2D* opts,
+                  results_nn_t* results)
+{
+  if (opts->ensemble > 1) {
+    process_rule_ensemble(rule, rule_buf, steps, opts, results);
+    return;
+  }
 
-  uint8_t* automat5 = NULL;
-  uint8_t* automat50 = NULL;
-  uint8_t* automat300 = NULL;
+  size_t size = opts->size;
 
-  uint8_t** test_automata =
-    (uint8_t**) malloc(sizeof(uint8_t*) * (WINDOW / W_STEP));
+  engine_t* engine = engine_new(grule_size, rule, opts);
 
-  if (opts->output_data != NO_OUTPUT) {
-    asprintf(&fname, "%s/out/out%s.dat", opts->data_dir_name, rule_buf);
-    out_file = fopen(fname, "w+");
+  /* Flat frame on which all the measurements are done */
+  uint8_t* (*frame1) = malloc(sizeof(uint8_t* (*)));
+  *frame1 = (uint8_t*) malloc(size * size * sizeof(uint8_t));
 
-    automat5 = (uint8_t*) calloc(size * size, sizeof(uint8_t));
-    automat50 = (uint8_t*) calloc(size * size, sizeof(uint8_t));
-    automat300 = (uint8_t*) calloc(size * size, sizeof(uint8_t));
+  int pert = (int) (opts->noise_rate * (double) size * (double) size);
 
-    for (int i = 0; i < (WINDOW / W_STEP); ++i) {
-      test_automata[i] = (uint8_t*) calloc(size * size, sizeof(uint8_t));
-    }
+  masking_element_t* mask = NULL;
+  if (opts->mask == MASK) {
+      mask = (masking_element_t*) calloc(pert, sizeof(masking_element_t));
   }
 
-  char* dbl_pholder = (char*)
-    malloc(sizeof(char) * (steps  * ((size + 1) * size + 1)));
-  char out_string[(size + 1) * size + 1];
-  char out_string300[(size + 1) * size + 1];
-  char out_string50[(size + 1) * size + 1];
-  char out_string5[(size + 1) * size + 1];
+  init_frame(*frame1, opts);
+  engine->load(engine, *frame1);
 
-  map_t map300 = hashmap_new();
-  map_t map50 = hashmap_new();
-  map_t map5 = hashmap_new();
-  map_t map300b = hashmap_new();
-  map_t map50b = hashmap_new();
-  map_t map5b = hashmap_new();
-  entrop_state_ph_t *res300 = NULL, *res50 = NULL, *res5 = NULL,
-    *res300b = NULL, *res50b = NULL, *res5b = NULL;
+  measure_t m;
+  measure_init(&m, rule_buf, steps, opts, results, engine->activity != NULL,
+               opts->compress_threads);
+  m.engine = engine;
+
+  /* Masked frames differ from the ones the engine swept */
+  step_stats_t stats;
+  if (opts->mask != MASK && opts->output_data != NO_OUTPUT) {
+    engine->stats = &stats;
+  }
 
-  int flag = 0;
-  int neigs = (2 * opts->horizon + 1) * (2 * opts->horizon + 1);
+  /* Whether the generations that are not measured are hashed, which holds
+     while the engine fuses the statistics into its step. Temporal blocking
+     is kept by hashing only the measured frames. */
+  int hash_steps = engine->stats != NULL && opts->early == EARLY
+    && opts->time_block <= 1;
 
   #if PROFILE
   clock_t t = 0;
   #endif
 
-  uint32_t pows[neigs];
-  for (int i = 0; i < neigs; ++i) {
-    pows[i] = ipow(states, i);
-  }
-
   for (int i = 0; i < steps; ++i) {
 
     if (i % 20 == 0 && opts->mask == MASK) {
@@ -664,213 +1144,300 @@ void process_rule(uint64_t grule_size, uint8_t rule[grule_size],
 
     if (opts->mask == MASK) {
       mask_autom(pert, size, mask, *frame1);
+      engine->load(engine, *frame1);
     }
 
-    if (opts->joint_complexity == 1) {
-      print_bits(size, size, *frame1, out_string);
-      memcpy(&dbl_pholder[i * ((size + 1) * size + 1)],
-            out_string, (size + 1) * size + 1);
+    measure_joint(&m, i, *frame1, opts);
+
+    /* Steps whose frame is not measured are run in one go by the engine */
+    int run = 1;
+    while (i + run < steps && !frame_needed(i + run - 1, steps, opts)) {
+      ++run;
+    }
+
+    /* Unless they are hashed one at a time for the cycle detection */
+    while (hash_steps && run > 1 && !m.stopped) {
+      stats.fused = 0;
+      PROF(engine->step(engine, 1))
+      hash_steps = stats.fused;
+      if (hash_steps) {
+        measure_cycle(&m, i + 1, stats.hash, opts);
+      }
+      ++i;
+      --run;
     }
+    if (m.stopped) {
+      break;
+    }
+
+    stats.fused = 0;
 
     /* Macro to profile if flag is on */
     PROF(
-      /* Make update from frame1 to frame2 */
-      process_function(size, *frame2, rule, *frame1, opts->horizon, pows);
-      /* Swap pointers */
-      temp_frame = frame1;
-      frame1 = frame2;
-      frame2 = temp_frame;
+      engine->step(engine, run);
+      i += run - 1;
     )
 
-    /* Masking */
-    if (opts->mask == MASK) {
-      mask_autom(pert, size, mask, *frame1);
+    /* Fraction of active tiles, averaged over the steps of the run */
+    if (m.active_file) {
+      fprintf(m.active_file, "%i    %f\n", i, engine->activity(engine));
     }
 
-    /* Save steps every grain_write */
-    if (opts->grain_write > 0
-        && i % opts->grain_write == 0
-        && opts->save_steps == 1) {
-
-      FILE* out_step_file;
-      char* step_fname;
-
-      print_bits(size, size, *frame1, out_string);
-      if (opts->save_flag == TMP_FILE) {
-        asprintf(&step_fname, "%s/tmp_%i.step", opts->out_step_dir, i);
-      }
-      else {
-        asprintf(&step_fname, "%s/steps/out%s_%i.step",
-                 opts->data_dir_name, rule_buf, i);
-      }
-
-      out_step_file = fopen(step_fname, "w+");
-      free(step_fname);
-      fprintf(out_step_file, "%s", out_string);
-      fclose(out_step_file);
+    if (!frame_needed(i, steps, opts)) {
+      continue;
     }
+    engine->store(engine, *frame1);
 
-    if (opts->output_data == NO_OUTPUT) {
-      continue;
+    /* Masking */
+    if (opts->mask == MASK) {
+      mask_autom(pert, size, mask, *frame1);
     }
 
+    measure_frame(&m, i, steps, *frame1, stats.fused ? &stats: NULL, opts);
+    if (m.stopped) {
+      break;
+    }
+  }
+  write_sizes(&m, 1);
+  printf("\n");
 
-    if (i % opts->grain == 0) {
-      last_compressed_size = compressed_size;
-      last_cell_count = cell_count;
+  /* Cleanup before finishing */
+  measure_free(&m);
+  engine_free(engine);
+  free(*frame1);
+  free(frame1);
+  free(mask);
+}
 
-      print_bits(size, size, *frame1, out_string);
-      compressed_size = compress_memory_size(out_string, (size + 1) * size);
-      cell_count = count_cells(size, *frame1, states);
+/**
+ * Advance the rules from their initial frames in lockstep and measure them
+ * as process_rule does. The measures are left for the caller to free.
+ */
+static void simulate_batch(int n_rules, uint8_t* rules[], char* rule_bufs[],
+                           uint8_t* frames[], long steps,
+                           struct Options2D* opts, results_nn_t results[],
+                           measure_t measures[])
+{
+  size_t size = opts->size;
+  int running = n_rules;
 
-      /* Check if state has evolved from last time (stop mechanism) */
-      if (compressed_size == last_compressed_size
-          && flag == 1 && opts->early == EARLY) {
-        printf("\n");
-        break;
-      }
-      else if (compressed_size == last_compressed_size) {
-        flag = 1;
-      }
+  batch_t* batch = batch_new(n_rules, rules, opts);
 
-      if (opts->joint_complexity == 1) {
-        compress_double(i, out_file, dbl_pholder, size, out_string,
-                        compressed_size, last_compressed_size,
-                        cell_count, last_cell_count);
-      } else {
-        fprintf(out_file, "%i    %i\n", i, compressed_size);
-      }
+  int pert = (int) (opts->noise_rate * (double) size * (double) size);
 
-      printf("%i  ", compressed_size);
-      fflush(stdout);
-    }
+  masking_element_t* mask = NULL;
+  if (opts->mask == MASK) {
+      mask = (masking_element_t*) calloc(pert, sizeof(masking_element_t));
+  }
 
-    int offset_a = 2, offset_b = 1;
+  for (int k = 0; k < n_rules; ++k) {
+    batch_load(batch, k, frames[k]);
+    measure_init(&measures[k], rule_bufs[k], steps, opts, &results[k], 0,
+                 0);
+  }
 
-    if (i == steps - WINDOW) {
-      print_bits(size, size, *frame1, out_string300);
-      res300 = populate_map(map300, size, *frame1, offset_a, states);
-      res300b = populate_map(map300b, size, *frame1, offset_b, states);
+  for (int i = 0; i < steps && running > 0; ++i) {
 
-      memcpy(automat300, *frame1, size * size * sizeof(uint8_t));
-    }
-    if (i > (steps - WINDOW) && (i - (steps - WINDOW)) % W_STEP == 0) {
-      memcpy(test_automata[((i - (steps - WINDOW)) / W_STEP) - 1],
-             *frame1, size * size * sizeof(uint8_t));
+    if (i % 20 == 0 && opts->mask == MASK) {
+      make_mask(pert, mask, size, opts->states);
     }
 
-    if (i == steps - 51) {
-      print_bits(size, size, *frame1, out_string50);
-      res50 = populate_map(map50, size, *frame1, offset_a, states);
-      res50b = populate_map(map50b, size, *frame1, offset_b, states);
-
-      memcpy(automat50, *frame1, size * size * sizeof(uint8_t));
+    for (int k = 0; k < n_rules; ++k) {
+      if (opts->mask == MASK) {
+        mask_autom(pert, size, mask, frames[k]);
+        batch_load(batch, k, frames[k]);
+      }
+      if (!measures[k].stopped) {
+        measure_joint(&measures[k], i, frames[k], opts);
+      }
     }
-    if (i == steps - 5) {
-      print_bits(size, size, *frame1, out_string5);
-      res5 = populate_map(map5, size, *frame1, offset_a, states);
-      res5b = populate_map(map5b, size, *frame1, offset_b, states);
 
-      memcpy(automat5, *frame1, size * size * sizeof(uint8_t));
+    int run = 1;
+    while (i + run < steps && !frame_needed(i + run - 1, steps, opts)) {
+      ++run;
     }
-    if (i == steps - 1) {
 
-      asprintf(&entrop_fname, "data_2d_%i/ent/ent%s.dat", states, rule_buf);
-      entrop_file = fopen(entrop_fname, "w+");
+    /* Stopped rules are still stepped with the others */
+    batch_step(batch, run);
+    i += run - 1;
 
-      add_entropy_results_to_file(map300, size, *frame1, states, offset_a,
-                          entrop_file, res300);
-      add_entropy_results_to_file(map50, size, *frame1, states, offset_a,
-                          entrop_file, res50);
-      add_entropy_results_to_file(map5, size, *frame1, states, offset_a,
-                          entrop_file, res5);
-      fprintf(entrop_file, "\n");
+    if (!frame_needed(i, steps, opts)) {
+      continue;
+    }
 
+    for (int k = 0; k < n_rules; ++k) {
+      batch_store(batch, k, frames[k]);
 
-      add_entropy_results_to_file(map300b, size, *frame1, states, offset_b,
-                          entrop_file, res300b);
-      add_entropy_results_to_file(map50b, size, *frame1, states, offset_b,
-                          entrop_file, res50b);
-      add_entropy_results_to_file(map5b, size, *frame1, states, offset_b,
-                          entrop_file, res5b);
-      fprintf(entrop_file, "\n");
+      if (opts->mask == MASK) {
+        mask_autom(pert, size, mask, frames[k]);
+      }
 
+      if (!measures[k].stopped) {
+        measure_frame(&measures[k], i, steps, frames[k], NULL, opts);
+        running -= measures[k].stopped;
+      }
+    }
+  }
+  printf("\n");
 
-      asprintf(&nn_fname, "data_2d_%i/nn/nn%s.dat", states, rule_buf);
-      nn_file = fopen(nn_fname, "w+");
+  batch_free(batch);
+  free(mask);
+}
 
-      asprintf(&fisher_fname, "data_2d_%i/nn/fisher%s.dat", states, rule_buf);
-      fisher_file = fopen(fisher_fname, "w+");
+void process_rule_batch(int n_rules, uint8_t* rules[], char* rule_bufs[],
+                        long steps, struct Options2D* opts,
+                        results_nn_t results[])
+{
+  size_t size = opts->size;
+  uint8_t** frames = (uint8_t**) malloc(n_rules * sizeof(uint8_t*));
+  measure_t* measures = (measure_t*) malloc(n_rules * sizeof(measure_t));
+
+  /* All the rules start from the same frame */
+  for (int k = 0; k < n_rules; ++k) {
+    frames[k] = (uint8_t*) malloc(size * size * sizeof(uint8_t));
+    if (k == 0) {
+      init_frame(frames[0], opts);
+    }
+    else {
+      memcpy(frames[k], frames[0], size * size * sizeof(uint8_t));
+    }
+  }
 
-      network_result_t res = {1., 1., 1., 0.};
-      network_opts_t n_opts = {10, 40, 3, MOMENTUM, DECAY, NO_FISHER, 1};
+  simulate_batch(n_rules, rules, rule_bufs, frames, steps, opts, results,
+                 measures);
 
-      for (int i = 4; i < 5; ++i) {
-        n_opts.num_hid = 10;
-        n_opts.offset = i;
-        n_opts.fisher = NO_FISHER;
+  for (int k = 0; k < n_rules; ++k) {
+    measure_free(&measures[k]);
+    free(frames[k]);
+  }
+  free(measures);
+  free(frames);
+}
 
-        train_nn_on_automaton(size, states, automat300, test_automata,
-                              WINDOW / W_STEP, &n_opts, &res);
+/** Mean and variance of the n values x[k * stride] */
+static void mean_var(int n, double* x, int stride, double* mean, double* var)
+{
+  *mean = 0.;
+  *var = 0.;
+  for (int k = 0; k < n; ++k) {
+    *mean += x[k * stride];
+  }
+  *mean /= n;
+  for (int k = 0; k < n; ++k) {
+    *var += (x[k * stride] - *mean) * (x[k * stride] - *mean);
+  }
+  *var /= n;
+}
 
-        add_nn_results_to_file(nn_file, &n_opts, &res, 50);
-        fprintf(fisher_file, "%f", res.error_var);
+/**
+ * Simulate opts->ensemble seeds of the rule in lockstep and write the mean and
+ * variance of their metrics to out/ens<rule>.dat: the compressed size at each
+ * grain step (over the seeds still running), the entropy scores and the
+ * errors of the network. Seed k gets the files of process_rule under the name
+ * <rule>_<k>, results gets the mean of the results of the seeds.
+ */
+static void process_rule_ensemble(uint8_t* rule, char rule_buf[], long steps,
+                                  struct Options2D* opts,
+                                  results_nn_t* results)
+{
+  int seeds = opts->ensemble;
+  size_t size = opts->size;
+  uint8_t** rules = (uint8_t**) malloc(seeds * sizeof(uint8_t*));
+  char** names = (char**) malloc(seeds * sizeof(char*));
+  uint8_t** frames = (uint8_t**) malloc(seeds * sizeof(uint8_t*));
+  measure_t* measures = (measure_t*) malloc(seeds * sizeof(measure_t));
+  results_nn_t* seed_results =
+    (results_nn_t*) malloc(seeds * sizeof(results_nn_t));
+
+  for (int k = 0; k < seeds; ++k) {
+    rules[k] = rule;
+    asprintf(&names[k], "%s_%i", rule_buf, k);
+    seed_results[k] = *results;
+    frames[k] = (uint8_t*) malloc(size * size * sizeof(uint8_t));
+    /* A pattern file can only be parsed once */
+    if (k > 0 && opts->init_pattern_file != NULL) {
+      memcpy(frames[k], frames[0], size * size * sizeof(uint8_t));
+    }
+    else {
+      init_frame(frames[k], opts);
+    }
+  }
 
-        results->nn_tr_50 = res.error_var;
-        results->nn_te_50 = 1.;
+  simulate_batch(seeds, rules, names, frames, steps, opts, seed_results,
+                 measures);
+
+  char* fname;
+  asprintf(&fname, "%s/out/ens%s.dat", opts->data_dir_name, rule_buf);
+  FILE* file = fopen(fname, "w+");
+  double* values = (double*) malloc(seeds * sizeof(double));
+  double mean, var;
+  int n;
+
+  fprintf(file, "# step    seeds    size_mean    size_var\n");
+  for (int j = 0; j * opts->grain < steps; ++j) {
+    n = 0;
+    for (int k = 0; k < seeds; ++k) {
+      if (j < measures[k].n_sizes) {
+        values[n++] = measures[k].sizes[j];
       }
     }
+    if (n == 0) {
+      break;
+    }
+    mean_var(n, values, 1, &mean, &var);
+    fprintf(file, "%i    %i    %f    %f\n", j * opts->grain, n, mean, var);
   }
-  printf("\n");
 
-  /* Cleanup before finishing */
-  free_map(map5);
-  free_map(map300);
-  free_map(map50);
-  free_map(map5b);
-  free_map(map300b);
-  free_map(map50b);
-
-  if (test_automata) {
-    for (int i = 0; i < WINDOW / W_STEP; ++i) {
-      free(test_automata[i]);
+  /* Entropy scores, then train/test errors and error variance */
+  n = 0;
+  double entropy[seeds][ENTROPY_SCORES];
+  for (int k = 0; k < seeds; ++k) {
+    if (measures[k].has_entropy) {
+      memcpy(entropy[n++], measures[k].entropy, sizeof(entropy[0]));
     }
-    free(test_automata);
   }
-
-  if (automat5)
-    free(automat5);
-  if (automat50)
-    free(automat50);
-  if (automat300)
-    free(automat300);
-
-  if (fname) {
-    free(fname);
-    fclose(out_file);
+  fprintf(file, "# entropy    %i\n", n);
+  for (int e = 0; n > 0 && e < ENTROPY_SCORES; ++e) {
+    mean_var(n, &entropy[0][e], ENTROPY_SCORES, &mean, &var);
+    fprintf(file, "%f    %f\n", mean, var);
   }
 
-  if (mult_time_file) {
-    free(mult_time_fname);
-    fclose(mult_time_file);
+  n = 0;
+  double nn[seeds][3];
+  for (int k = 0; k < seeds; ++k) {
+    if (measures[k].has_nn) {
+      nn[n][0] = measures[k].nn.train_error;
+      nn[n][1] = measures[k].nn.test_error;
+      nn[n++][2] = measures[k].nn.error_var;
+    }
   }
-
-  free(*frame1);
-  free(frame1);
-  free(*frame2);
-  free(frame2);
-  free(mask);
-
-  if (entrop_file) {
-    free(entrop_fname);
-    fclose(entrop_file);
+  fprintf(file, "# nn    %i\n", n);
+  for (int e = 0; n > 0 && e < 3; ++e) {
+    mean_var(n, &nn[0][e], 3, &mean, &var);
+    fprintf(file, "%f    %f\n", mean, var);
   }
-  if (nn_file) {
-    free(nn_fname);
-    fclose(nn_file);
+
+  results_nn_t* r = results;
+  for (int k = 0; k < seeds; ++k) {
+    r->nn_tr_300 += (seed_results[k].nn_tr_300 - r->nn_tr_300) / (k + 1);
+    r->nn_te_300 += (seed_results[k].nn_te_300 - r->nn_te_300) / (k + 1);
+    r->nn_tr_50 += (seed_results[k].nn_tr_50 - r->nn_tr_50) / (k + 1);
+    r->nn_te_50 += (seed_results[k].nn_te_50 - r->nn_te_50) / (k + 1);
+    r->nn_tr_5 += (seed_results[k].nn_tr_5 - r->nn_tr_5) / (k + 1);
+    r->nn_te_5 += (seed_results[k].nn_te_5 - r->nn_te_5) / (k + 1);
   }
-  if (fisher_file) {
-    free(fisher_fname);
-    fclose(fisher_file);
+
+  for (int k = 0; k < seeds; ++k) {
+    measure_free(&measures[k]);
+    free(frames[k]);
+    free(names[k]);
   }
+  fclose(file);
+  free(fname);
+  free(values);
+  free(seed_results);
+  free(measures);
+  free(frames);
+  free(names);
+  free(rules);
 }
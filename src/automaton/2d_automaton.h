@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include "automaton/neighborhood.h"
+#include "utils/estimator.h"
 
 #ifndef TWOD_AUTOMATON_H /* Include guard */
 #define TWOD_AUTOMATON_H
@@ -14,6 +16,18 @@ enum WriteStepMode { TMP_FILE, STEP_FILE };
 enum EarlyStop { EARLY, NO_STOP };
 enum MaskEnum { MASK, NO_MASK };
 enum DataOutput { OUTPUT, NO_OUTPUT };
+enum EngineType { ENGINE_AUTO, ENGINE_GENERAL, ENGINE_SLIDING,
+                  ENGINE_BITSLICE, ENGINE_PACKED3,
+  ENGINE_HASHLIFE, ENGINE_ACTIVE, ENGINE_PLANE, ENGINE_SPECIALIZED,
+  ENGINE_GATHER, ENGINE_CIRCUIT, ENGINE_COMPILED, ENGINE_COMPACT,
+  ENGINE_MASKED };
+/** Shape of the rule tables, see automaton/totalistic.h and
+    automaton/sparse.h for the families */
+enum RuleFamily { FAMILY_TABLE, FAMILY_TOTALISTIC, FAMILY_OUTER,
+                  FAMILY_SPARSE };
+/** Compressor of the joint complexity: deflate on the printed frames or
+    utils/frame_lz.h on the cells */
+enum JointCompressor { JOINT_DEFLATE, JOINT_LONG };
 
 /** A set of options to pass for generating and processing an automaton from a
  *  rule.
@@ -38,6 +52,22 @@ struct Options2D {
                                   simulations */
   FILE* init_pattern_file;
   long init_type; /**< Size of the random initialization zone (-1 for full) */
+  enum EngineType engine; /**< Stepping engine (picked from the rule shape
+                             when ENGINE_AUTO) */
+  int threads; /**< Number of threads stepping the automaton */
+  int time_block; /**< Generations advanced at once by the lookup table
+                     engines between measurements (temporal blocking) */
+  int lockstep; /**< Whether the search processes its generations with
+                   process_rule_batch */
+  int ensemble; /**< Number of seeds simulated together by process_rule */
+  enum RuleFamily family; /**< Full neighborhood table or totalistic rule */
+  int transitions; /**< Transitions of the random sparse rules */
+  neighborhood_t neighborhood; /**< Cells read by the lookup table rules,
+                                  whose horizon is opts->horizon */
+  enum EstimatorType estimator; /**< Backend of the compressed sizes */
+  enum JointCompressor joint_compressor;
+  int compress_threads; /**< Threads computing the compressed sizes while
+                           process_rule steps the automaton, 0 for none */
 };
 
 typedef struct results_nn_s
@@ -51,16 +81,28 @@ typedef struct results_nn_s
 } results_nn_t;
 
 
+/**
+ * Update step from a padded frame to another, see automaton/kernels.h for
+ * the layout. Only the rows [row_begin, row_end) are computed, along with
+ * the halo cells mirroring them, so that bands can be updated in parallel.
+ */
 typedef void (*ProcessF)(size_t size, uint8_t*,
                          uint8_t[], uint8_t*,
-                         int, uint32_t*);
+                         int, uint32_t*,
+                         size_t row_begin, size_t row_end);
 
 unsigned long hash(char*);
 
+void update_step_general(size_t size, uint8_t* autom, uint8_t* rule,
+                         uint8_t* last_autom, int horizon, uint32_t* pows,
+                         size_t row_begin, size_t row_end);
+
 /**
  * @brief Main 2D rule processing function.
  *
- * Given a rule, create and simulate the corresponding automaton.
+ * Given a rule, create and simulate the corresponding automaton. With
+ * opts->ensemble > 1, that many seeds are simulated in lockstep and the
+ * results are averaged over the seeds.
  */
 void process_rule(uint64_t grule_size,
                   uint8_t rule[grule_size],
@@ -69,9 +111,26 @@ void process_rule(uint64_t grule_size,
                   struct Options2D*,
                   results_nn_t*);
 
+/**
+ * @brief Process several rules of the same shape in lockstep.
+ *
+ * The rules start from the same initial frame and are advanced together by a
+ * batch engine (see automaton/batch.h). Each rule gets the measurements and
+ * output files of process_rule, and its results in results[k]. Rules that
+ * stop early are still stepped until all of them have stopped.
+ */
+void process_rule_batch(int n_rules, uint8_t* rules[], char* rule_bufs[],
+                        long steps, struct Options2D*, results_nn_t results[]);
 
 void generate_general_rule(uint64_t grule_size,
                            uint8_t rule_array[grule_size],
-                           char rule_buf[grule_size + 1], int, int);
+                           char rule_buf[grule_size + 1], int,
+                           const neighborhood_t*, enum RuleFamily);
+
+/**
+ * Random initial frame, or random in the centered square of side init_type
+ * and 0 around it when init_type > 0
+ */
+void init_automat(size_t size, uint8_t* a, int states, long init_type);
 
 #endif // TWOD_AUTOMATON_H
@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+#include "automaton/active.h"
+#include "automaton/kernels.h"
+#include "utils/utils.h"
+
+#define TILE 32 /* Side of the tiles whose activity is tracked */
+
+/** Padded frame with the tiles that differ from two generations before */
+typedef struct active_frame_s
+{
+  uint8_t* cells;
+  uint8_t* changed;
+} active_frame_t;
+
+typedef struct active_s
+{
+  size_t size;
+  int horizon;
+  uint8_t* rule;
+  uint32_t* pows;
+  size_t tiles; /**< Number of tiles per side */
+  active_frame_t frames[2];
+  active_frame_t* grid;
+  active_frame_t* next;
+  /** Tiles (along one axis) within horizon of tile t are
+      around[around_begin[t]] to around[around_begin[t + 1] - 1] */
+  size_t* around_begin;
+  size_t* around;
+  pool_t* pool; /**< Workers updating row bands, NULL when serial */
+  size_t* counts; /**< Active tiles counted by each worker */
+  long steps; /**< Generations of the last call to step */
+} active_t;
+
+static void active_band(void* data, void* in, void* out,
+                        size_t row_begin, size_t row_end, int worker)
+{
+  active_t* a = (active_t*) data;
+  active_frame_t* grid = (active_frame_t*) in;
+  active_frame_t* next = (active_frame_t*) out;
+  size_t size = a->size;
+  size_t count = 0;
+
+  for (size_t tr = row_begin; tr < row_end; ++tr) {
+    size_t r0 = tr * TILE;
+    size_t r1 = (r0 + TILE < size) ? r0 + TILE: size;
+    int row_active = 0;
+
+    for (size_t tc = 0; tc < a->tiles; ++tc) {
+      size_t c0 = tc * TILE;
+      size_t c1 = (c0 + TILE < size) ? c0 + TILE: size;
+      int active = 0;
+
+      for (size_t u = a->around_begin[tr];
+           u < a->around_begin[tr + 1] && !active; ++u) {
+        for (size_t v = a->around_begin[tc]; v < a->around_begin[tc + 1]; ++v) {
+          if (grid->changed[a->around[u] * a->tiles + a->around[v]]) {
+            active = 1;
+            break;
+          }
+        }
+      }
+
+      /* The next state of an inactive tile is the one of two generations
+         before, which is already in the output frame */
+      if (active) {
+        next->changed[tr * a->tiles + tc] =
+          update_tile_sliding(size, next->cells, a->rule, grid->cells,
+                              a->horizon, a->pows, r0, r1, c0, c1);
+        row_active = 1;
+        ++count;
+      }
+      else {
+        next->changed[tr * a->tiles + tc] = 0;
+      }
+    }
+
+    if (row_active) {
+      refresh_halo_rows(size, next->cells, a->horizon, r0, r1);
+    }
+  }
+  a->counts[worker] += count;
+}
+
+static void active_step(engine_t* engine, long n)
+{
+  active_t* a = (active_t*) engine->data;
+  int workers = a->pool ? pool_size(a->pool): 1;
+
+  memset(a->counts, 0, workers * sizeof(size_t));
+  a->steps = n;
+  engine_run_bands(a->pool, active_band, a, a->tiles,
+                   (void**) &a->grid, (void**) &a->next, n);
+}
+
+static double active_activity(engine_t* engine)
+{
+  active_t* a = (active_t*) engine->data;
+  int workers = a->pool ? pool_size(a->pool): 1;
+  size_t total = 0;
+
+  if (a->steps == 0) {
+    return 0.;
+  }
+  for (int w = 0; w < workers; ++w) {
+    total += a->counts[w];
+  }
+  return (double) total / ((double) a->steps * a->tiles * a->tiles);
+}
+
+static void active_load(engine_t* engine, uint8_t* frame)
+{
+  active_t* a = (active_t*) engine->data;
+
+  /* The loaded frame stands for the two previous generations, so every
+     tile is recomputed once and then only if it changed */
+  for (int k = 0; k < 2; ++k) {
+    pad_frame(a->size, a->horizon, frame, a->frames[k].cells);
+  }
+  memset(a->grid->changed, 1, a->tiles * a->tiles);
+}
+
+static void active_store(engine_t* engine, uint8_t* frame)
+{
+  active_t* a = (active_t*) engine->data;
+  unpad_frame(a->size, a->horizon, a->grid->cells, frame);
+}
+
+static void active_free(engine_t* engine)
+{
+  active_t* a = (active_t*) engine->data;
+  if (a->pool) {
+    pool_free(a->pool);
+  }
+  for (int k = 0; k < 2; ++k) {
+    free(a->frames[k].cells);
+    free(a->frames[k].changed);
+  }
+  free(a->around_begin);
+  free(a->around);
+  free(a->counts);
+  free(a->pows);
+  free(a);
+}
+
+engine_t* active_engine_new(uint8_t* rule, struct Options2D* opts,
+                            pool_t* pool)
+{
+  active_t* a = (active_t*) calloc(1, sizeof(active_t));
+  size_t size = opts->size;
+  long h = opts->horizon;
+  int neigs = (2 * h + 1) * (2 * h + 1);
+  size_t pitch = size + 2 * h;
+
+  a->size = size;
+  a->horizon = h;
+  a->rule = rule;
+  a->pool = pool;
+  a->tiles = (size + TILE - 1) / TILE;
+  a->pows = (uint32_t*) malloc(neigs * sizeof(uint32_t));
+  for (int i = 0; i < neigs; ++i) {
+    a->pows[i] = ipow(opts->states, i);
+  }
+
+  for (int k = 0; k < 2; ++k) {
+    a->frames[k].cells = (uint8_t*) engine_alloc_rows(pool, pitch, pitch);
+    a->frames[k].changed = (uint8_t*) calloc(a->tiles * a->tiles, 1);
+  }
+  a->grid = &a->frames[0];
+  a->next = &a->frames[1];
+  a->counts = (size_t*) calloc(pool ? pool_size(pool): 1, sizeof(size_t));
+
+  /* Tiles covering [t * TILE - h, (t + 1) * TILE + h) along an axis */
+  uint8_t* mark = (uint8_t*) malloc(a->tiles);
+  a->around_begin = (size_t*) malloc((a->tiles + 1) * sizeof(size_t));
+  a->around = (size_t*) malloc(a->tiles * a->tiles * sizeof(size_t));
+  a->around_begin[0] = 0;
+  for (size_t t = 0; t < a->tiles; ++t) {
+    long end = ((t + 1) * TILE < size) ? (t + 1) * TILE: size;
+    memset(mark, 0, a->tiles);
+    for (long x = (long) (t * TILE) - h; x < end + h; ++x) {
+      mark[(((x % (long) size) + size) % size) / TILE] = 1;
+    }
+    a->around_begin[t + 1] = a->around_begin[t];
+    for (size_t u = 0; u < a->tiles; ++u) {
+      if (mark[u]) {
+        a->around[a->around_begin[t + 1]++] = u;
+      }
+    }
+  }
+  free(mark);
+
+  engine_t* engine = (engine_t*) malloc(sizeof(engine_t));
+  engine->name = "active";
+  engine->data = a;
+  engine->load = active_load;
+  engine->step = active_step;
+  engine->store = active_store;
+  engine->activity = active_activity;
+  engine->free = active_free;
+  engine->stats = NULL;
+  engine->state_hash = NULL;
+  return engine;
+}
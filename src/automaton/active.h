@@ -0,0 +1,21 @@
+#include <stdint.h>
+#include "automaton/engine.h"
+
+#ifndef ACTIVE_H /* Include guard */
+#define ACTIVE_H
+
+/**
+ * @brief Create a lookup table engine that only updates the active tiles.
+ *
+ * The torus is split in square tiles. A tile is only recomputed when a tile
+ * of its neighborhood differs from what it was two generations before;
+ * otherwise its next state is the one from two generations before, which is
+ * still in the output frame. This skips the quiescent regions whose
+ * background is a fixed point or blinks with period 2. The fraction of
+ * recomputed tiles is reported by engine->activity. Tiles are split across
+ * the workers of `pool` if not NULL, the engine takes ownership of the pool.
+ */
+engine_t* active_engine_new(uint8_t* rule, struct Options2D* opts,
+                            pool_t* pool);
+
+#endif // ACTIVE_H
@@ -0,0 +1,286 @@
+#include <stdlib.h>
+#include <string.h>
+#include "automaton/batch.h"
+#include "automaton/gather.h"
+#include "utils/utils.h"
+
+/* Size of a shared rule table from which interleaving the lanes pays off */
+#define SHARED_TABLE (1 << 23)
+
+/**
+ * Frames are padded like the ones of automaton/kernels.h, with cells of
+ * `lanes` bytes: state of lane r at padded position (p, q) is at
+ * frame[(p * pitch + q) * lanes + r].
+ */
+struct batch_s
+{
+  size_t size;
+  int horizon;
+  int states;
+  int lanes;
+  uint8_t** rules; /**< Rule of each lane */
+  int shared; /**< Whether all the lanes run the same rule */
+  uint8_t* table; /**< Padded copy of the shared rule, for gather_lookup */
+  uint32_t* pows;
+  uint8_t* frame1;
+  uint8_t* frame2;
+  pool_t* pool;
+  int n_scratch;
+  uint32_t** scratch; /**< Column codes and rule indices of a row, per
+                           worker */
+  engine_t** engines; /**< One engine per lane when the lanes are not
+                           interleaved, NULL otherwise */
+};
+
+/** Job stepping the lane engines split across the workers */
+typedef struct lanes_job_s
+{
+  batch_t* batch;
+  long steps;
+} lanes_job_t;
+
+/** refresh_halo_rows for interleaved frames */
+static void batch_refresh_halo(batch_t* b, uint8_t* frame,
+                               size_t row_begin, size_t row_end)
+{
+  size_t size = b->size;
+  size_t lanes = b->lanes;
+  size_t h = b->horizon;
+  size_t row_bytes = (size + 2 * h) * lanes;
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* row = &frame[(i + h) * row_bytes];
+    memcpy(row, &row[size * lanes], h * lanes);
+    memcpy(&row[(size + h) * lanes], &row[h * lanes], h * lanes);
+
+    if (i >= size - h) {
+      memcpy(&frame[(i + h - size) * row_bytes], row, row_bytes);
+    }
+    if (i < h) {
+      memcpy(&frame[(i + h + size) * row_bytes], row, row_bytes);
+    }
+  }
+}
+
+/** update_step_sliding over the lanes of each cell */
+static void batch_band(void* data, void* in, void* out,
+                       size_t row_begin, size_t row_end, int worker)
+{
+  batch_t* b = (batch_t*) data;
+  size_t size = b->size;
+  size_t lanes = b->lanes;
+  int h = b->horizon;
+  int side = 2 * h + 1;
+  uint32_t states = b->states;
+  size_t row_bytes = (size + 2 * h) * lanes;
+  uint32_t* codes = b->scratch[worker];
+  uint32_t* index = &codes[row_bytes];
+  uint32_t weights[side];
+
+  /* Local copy, the stores to codes could alias b->pows */
+  for (int k = 0; k < side; ++k) {
+    weights[k] = b->pows[k * side];
+  }
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* rows = &((uint8_t*) in)[i * row_bytes];
+    uint8_t* next = &((uint8_t*) out)[(i + h) * row_bytes + h * lanes];
+
+    /* The interleaving makes the column codes of all the lanes a single
+       loop over the row, with one pass per row of the neighborhood */
+    for (size_t x = 0; x < row_bytes; ++x) {
+      codes[x] = rows[x];
+    }
+    for (int k = 1; k < side; ++k) {
+      uint8_t* row = &rows[k * row_bytes];
+      for (size_t x = 0; x < row_bytes; ++x) {
+        codes[x] += row[x] * weights[k];
+      }
+    }
+
+    /* Same for the rule indices, the code of the column l cells to the
+       right of a cell being l * lanes further */
+    for (size_t x = 0; x < size * lanes; ++x) {
+      index[x] = codes[x + 2 * h * lanes];
+    }
+    for (int l = 2 * h - 1; l >= 0; --l) {
+      uint32_t* column = &codes[l * lanes];
+      for (size_t x = 0; x < size * lanes; ++x) {
+        index[x] = index[x] * states + column[x];
+      }
+    }
+
+    if (b->shared) {
+      gather_lookup(b->table, index, size * lanes, next);
+    }
+    else {
+      for (size_t j = 0; j < size; ++j) {
+        for (size_t r = 0; r < lanes; ++r) {
+          next[j * lanes + r] = b->rules[r][index[j * lanes + r]];
+        }
+      }
+    }
+  }
+
+  batch_refresh_halo(b, (uint8_t*) out, row_begin, row_end);
+}
+
+/**
+ * Whether interleaving the lanes beats stepping them one by one with the
+ * vectorized engines, which holds when the rule tables do not fit in cache.
+ * Distinct tables only pay off with horizon 2 rules, whose lookups miss the
+ * cache anyway and overlap better across the lanes. The interleaved kernel
+ * reads the whole square neighborhood.
+ */
+static int interleave(struct Options2D* opts, int shared,
+                      uint64_t grule_size)
+{
+  if (opts->engine != ENGINE_AUTO || opts->family != FAMILY_TABLE
+      || opts->neighborhood.shape != SHAPE_MOORE) {
+    return 0;
+  }
+  return shared ? grule_size >= SHARED_TABLE: opts->horizon > 1;
+}
+
+batch_t* batch_new(int lanes, uint8_t* rules[], struct Options2D* opts)
+{
+  batch_t* b = (batch_t*) calloc(1, sizeof(batch_t));
+  int neigs = (2 * opts->horizon + 1) * (2 * opts->horizon + 1);
+  uint64_t grule_size = ipow(opts->states, opts->neighborhood.cells);
+  size_t pitch = opts->size + 2 * opts->horizon;
+
+  b->size = opts->size;
+  b->horizon = opts->horizon;
+  b->states = opts->states;
+  b->lanes = lanes;
+  b->rules = (uint8_t**) malloc(lanes * sizeof(uint8_t*));
+  memcpy(b->rules, rules, lanes * sizeof(uint8_t*));
+  b->shared = 1;
+  for (int r = 1; r < lanes; ++r) {
+    b->shared &= rules[r] == rules[0];
+  }
+  b->pool = engine_pool_new(opts);
+
+  if (!interleave(opts, b->shared, grule_size)) {
+    /* The workers step whole lanes */
+    struct Options2D lane_opts = *opts;
+    lane_opts.threads = 1;
+    b->engines = (engine_t**) malloc(lanes * sizeof(engine_t*));
+    for (int r = 0; r < lanes; ++r) {
+      b->engines[r] = engine_new(grule_size, rules[r], &lane_opts);
+    }
+    return b;
+  }
+
+  if (b->shared) {
+    b->table = (uint8_t*) calloc(grule_size + RULE_PADDING, sizeof(uint8_t));
+    memcpy(b->table, rules[0], grule_size);
+  }
+  b->pows = (uint32_t*) malloc(neigs * sizeof(uint32_t));
+  neighborhood_pows(&opts->neighborhood, opts->states, b->pows);
+
+  b->frame1 = (uint8_t*) engine_alloc_rows(b->pool, pitch, pitch * lanes);
+  b->frame2 = (uint8_t*) engine_alloc_rows(b->pool, pitch, pitch * lanes);
+  b->n_scratch = b->pool ? pool_size(b->pool): 1;
+  b->scratch = (uint32_t**) malloc(b->n_scratch * sizeof(uint32_t*));
+  for (int w = 0; w < b->n_scratch; ++w) {
+    b->scratch[w] = (uint32_t*)
+      malloc((pitch + opts->size) * lanes * sizeof(uint32_t));
+  }
+  return b;
+}
+
+void batch_load(batch_t* b, int lane, uint8_t* frame)
+{
+  size_t size = b->size;
+  size_t lanes = b->lanes;
+  size_t h = b->horizon;
+  size_t pitch = size + 2 * h;
+
+  if (b->engines) {
+    b->engines[lane]->load(b->engines[lane], frame);
+    return;
+  }
+
+  for (size_t i = 0; i < size; ++i) {
+    uint8_t* row = &b->frame1[((i + h) * pitch + h) * lanes + lane];
+    for (size_t j = 0; j < size; ++j) {
+      row[j * lanes] = frame[i * size + j];
+    }
+  }
+  batch_refresh_halo(b, b->frame1, 0, size);
+}
+
+static void lanes_job(pool_t* pool, void* arg, int worker)
+{
+  lanes_job_t* job = (lanes_job_t*) arg;
+  engine_t** engines = job->batch->engines;
+  size_t begin, end;
+
+  pool_band(pool, worker, job->batch->lanes, &begin, &end);
+  for (size_t r = begin; r < end; ++r) {
+    engines[r]->step(engines[r], job->steps);
+  }
+}
+
+void batch_step(batch_t* b, long n)
+{
+  if (b->engines) {
+    lanes_job_t job = {b, n};
+    if (b->pool) {
+      pool_run(b->pool, lanes_job, &job);
+    }
+    else {
+      for (int r = 0; r < b->lanes; ++r) {
+        b->engines[r]->step(b->engines[r], n);
+      }
+    }
+    return;
+  }
+
+  engine_run_bands(b->pool, batch_band, b, b->size,
+                   (void**) &b->frame1, (void**) &b->frame2, n);
+}
+
+void batch_store(batch_t* b, int lane, uint8_t* frame)
+{
+  size_t size = b->size;
+  size_t lanes = b->lanes;
+  size_t h = b->horizon;
+  size_t pitch = size + 2 * h;
+
+  if (b->engines) {
+    b->engines[lane]->store(b->engines[lane], frame);
+    return;
+  }
+
+  for (size_t i = 0; i < size; ++i) {
+    uint8_t* row = &b->frame1[((i + h) * pitch + h) * lanes + lane];
+    for (size_t j = 0; j < size; ++j) {
+      frame[i * size + j] = row[j * lanes];
+    }
+  }
+}
+
+void batch_free(batch_t* b)
+{
+  if (b->pool) {
+    pool_free(b->pool);
+  }
+  for (int w = 0; w < b->n_scratch; ++w) {
+    free(b->scratch[w]);
+  }
+  free(b->scratch);
+  if (b->engines) {
+    for (int r = 0; r < b->lanes; ++r) {
+      engine_free(b->engines[r]);
+    }
+    free(b->engines);
+  }
+  free(b->frame1);
+  free(b->frame2);
+  free(b->pows);
+  free(b->rules);
+  free(b->table);
+  free(b);
+}
@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include "automaton/engine.h"
+
+#ifndef BATCH_H /* Include guard */
+#define BATCH_H
+
+/**
+ * @brief A group of automata with the same shape advanced in lockstep.
+ *
+ * The grids of the `lanes` rules are interleaved cell by cell (a cell is a
+ * vector of `lanes` states, one per rule) in padded frames, so that a single
+ * pass over the frames updates every rule. The column codes and rule indices
+ * are computed for all the lanes of a cell in one vector loop, only the table
+ * lookups go to a different rule per lane. When all the lanes run the same
+ * rule (an ensemble of seeds), its table is shared in cache and the lookups
+ * use gather_lookup.
+ *
+ * Interleaving only pays off for rule tables that do not fit in cache, other
+ * batches step each lane with its own engine from engine_new, the lanes being
+ * split across the workers.
+ */
+typedef struct batch_s batch_t;
+
+/**
+ * Create a batch of `lanes` rules sharing the size, states and horizon of
+ * `opts`. The rules are not copied. Rows (or lanes) are split across
+ * opts->threads workers.
+ */
+batch_t* batch_new(int lanes, uint8_t* rules[], struct Options2D* opts);
+
+/** Replace the grid of a lane with the flat `size * size` frame */
+void batch_load(batch_t*, int lane, uint8_t* frame);
+
+/** Advance all the lanes by n generations */
+void batch_step(batch_t*, long n);
+
+/** Write the grid of a lane to the flat `size * size` frame */
+void batch_store(batch_t*, int lane, uint8_t* frame);
+
+void batch_free(batch_t*);
+
+#endif // BATCH_H
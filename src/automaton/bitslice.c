@@ -0,0 +1,229 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "automaton/bitslice.h"
+
+#define NEIGHBORS 9
+#define RULE_SIZE (1 << NEIGHBORS)
+#define UNIQUE_SIZE 2048
+#define BLOCK 8 /* Words evaluated together for each diagram node */
+
+/**
+ * Node of the decision diagram: the output is `hi` when the neighbor `var` is
+ * alive and `lo` otherwise. Nodes 0 and 1 are the constant leaves.
+ */
+typedef struct bdd_node_s
+{
+  uint16_t var;
+  uint16_t lo;
+  uint16_t hi;
+} bdd_node_t;
+
+typedef struct bitslice_s
+{
+  size_t size;
+  size_t words; /**< Number of words per row */
+  uint64_t last_mask; /**< Valid bits of the last word of a row */
+  uint64_t* grid;
+  uint64_t* next;
+  pool_t* pool; /**< Workers updating row bands, NULL when serial */
+  int n_nodes;
+  int root;
+  bdd_node_t nodes[RULE_SIZE + 2];
+} bitslice_t;
+
+typedef struct bdd_builder_s
+{
+  bitslice_t* bs;
+  uint8_t* rule;
+  int unique[UNIQUE_SIZE]; /**< Hash-consing table of the nodes */
+} bdd_builder_t;
+
+static int make_node(bdd_builder_t* b, int var, int lo, int hi)
+{
+  if (lo == hi) {
+    return lo;
+  }
+
+  size_t h = ((size_t)var * 961 + (size_t)lo * 31 + (size_t)hi)
+    % UNIQUE_SIZE;
+  while (b->unique[h] != -1) {
+    bdd_node_t* node = &b->bs->nodes[b->unique[h]];
+    if (node->var == var && node->lo == lo && node->hi == hi) {
+      return b->unique[h];
+    }
+    h = (h + 1) % UNIQUE_SIZE;
+  }
+
+  int id = b->bs->n_nodes++;
+  b->bs->nodes[id].var = var;
+  b->bs->nodes[id].lo = lo;
+  b->bs->nodes[id].hi = hi;
+  b->unique[h] = id;
+  return id;
+}
+
+/**
+ * Build the node for the `2^k` rule entries starting at `offset`, in which
+ * the neighbors k and above are fixed. Children are always created before
+ * their parent so the nodes are stored in evaluation order.
+ */
+static int build_node(bdd_builder_t* b, int k, int offset)
+{
+  if (k == 0) {
+    return b->rule[offset] ? 1: 0;
+  }
+  int lo = build_node(b, k - 1, offset);
+  int hi = build_node(b, k - 1, offset + (1 << (k - 1)));
+  return make_node(b, k - 1, lo, hi);
+}
+
+/**
+ * Compute the 9 neighbor planes of `count` consecutive words of a row. The
+ * plane order matches the rule index: plane (k + 1) * 3 + (l + 1) holds the
+ * neighbor at row offset k and column offset l.
+ */
+static void neighbor_planes(bitslice_t* bs, uint64_t* rows[3],
+                            size_t first, size_t count,
+                            uint64_t planes[NEIGHBORS][BLOCK])
+{
+  size_t words = bs->words;
+  int last_bit = (bs->size - 1) & 63;
+
+  for (int k = 0; k < 3; ++k) {
+    uint64_t* x = rows[k];
+    for (size_t c = 0; c < count; ++c) {
+      size_t w = first + c;
+      uint64_t carry_l = (w > 0) ? x[w - 1] >> 63
+        : (x[words - 1] >> last_bit) & 1;
+      uint64_t carry_r = (w < words - 1) ? x[w + 1] & 1: x[0] & 1;
+      int top = (w < words - 1) ? 63: last_bit;
+
+      planes[k * 3][c] = (x[w] << 1) | carry_l;
+      planes[k * 3 + 1][c] = x[w];
+      planes[k * 3 + 2][c] = (x[w] >> 1) | (carry_r << top);
+    }
+  }
+}
+
+static void bitslice_band(void* data, void* in, void* out,
+                          size_t row_begin, size_t row_end, int worker)
+{
+  (void)(worker); /* Unused parameter */
+  bitslice_t* bs = (bitslice_t*) data;
+  uint64_t* grid = (uint64_t*) in;
+  size_t size = bs->size;
+  size_t words = bs->words;
+  uint64_t planes[NEIGHBORS][BLOCK];
+  uint64_t values[RULE_SIZE + 2][BLOCK];
+
+  for (size_t c = 0; c < BLOCK; ++c) {
+    values[0][c] = 0;
+    values[1][c] = ~(uint64_t)0;
+  }
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint64_t* rows[3] = {
+      &grid[((i + size - 1) % size) * words],
+      &grid[i * words],
+      &grid[((i + 1) % size) * words]
+    };
+    uint64_t* row_out = &((uint64_t*) out)[i * words];
+
+    for (size_t w = 0; w < words; w += BLOCK) {
+      size_t count = (words - w < BLOCK) ? words - w: BLOCK;
+      neighbor_planes(bs, rows, w, count, planes);
+
+      /* Evaluate the diagram bottom-up as a chain of multiplexers */
+      for (int n = 2; n < bs->n_nodes; ++n) {
+        bdd_node_t node = bs->nodes[n];
+        for (size_t c = 0; c < BLOCK; ++c) {
+          uint64_t lo = values[node.lo][c];
+          values[n][c] = lo ^ (planes[node.var][c]
+                               & (lo ^ values[node.hi][c]));
+        }
+      }
+      memcpy(&row_out[w], values[bs->root], count * sizeof(uint64_t));
+    }
+    row_out[words - 1] &= bs->last_mask;
+  }
+}
+
+static void bitslice_step(engine_t* engine, long n)
+{
+  bitslice_t* bs = (bitslice_t*) engine->data;
+  engine_run_bands(bs->pool, bitslice_band, bs, bs->size,
+                   (void**) &bs->grid, (void**) &bs->next, n);
+}
+
+static void bitslice_load(engine_t* engine, uint8_t* frame)
+{
+  bitslice_t* bs = (bitslice_t*) engine->data;
+  memset(bs->grid, 0, bs->size * bs->words * sizeof(uint64_t));
+  for (size_t i = 0; i < bs->size; ++i) {
+    for (size_t j = 0; j < bs->size; ++j) {
+      bs->grid[i * bs->words + j / 64] |=
+        (uint64_t)(frame[i * bs->size + j] & 1) << (j % 64);
+    }
+  }
+}
+
+static void bitslice_store(engine_t* engine, uint8_t* frame)
+{
+  bitslice_t* bs = (bitslice_t*) engine->data;
+  for (size_t i = 0; i < bs->size; ++i) {
+    for (size_t j = 0; j < bs->size; ++j) {
+      frame[i * bs->size + j] =
+        (uint8_t)((bs->grid[i * bs->words + j / 64] >> (j % 64)) & 1);
+    }
+  }
+}
+
+static void bitslice_free(engine_t* engine)
+{
+  bitslice_t* bs = (bitslice_t*) engine->data;
+  if (bs->pool) {
+    pool_free(bs->pool);
+  }
+  free(bs->grid);
+  free(bs->next);
+  free(bs);
+}
+
+engine_t* bitslice_engine_new(size_t size, uint8_t rule[RULE_SIZE],
+                              pool_t* pool)
+{
+  bitslice_t* bs = (bitslice_t*) calloc(1, sizeof(bitslice_t));
+  bs->size = size;
+  bs->words = (size + 63) / 64;
+  bs->last_mask = (size % 64 == 0) ? ~(uint64_t)0
+    : ((uint64_t)1 << (size % 64)) - 1;
+  bs->pool = pool;
+  bs->grid = (uint64_t*)
+    engine_alloc_rows(pool, size, bs->words * sizeof(uint64_t));
+  bs->next = (uint64_t*)
+    engine_alloc_rows(pool, size, bs->words * sizeof(uint64_t));
+
+  /* Leaves first, then the diagram is built bottom-up from the rule table */
+  bdd_builder_t builder;
+  builder.bs = bs;
+  builder.rule = rule;
+  for (int h = 0; h < UNIQUE_SIZE; ++h) {
+    builder.unique[h] = -1;
+  }
+  bs->n_nodes = 2;
+  bs->root = build_node(&builder, NEIGHBORS, 0);
+  assert(bs->n_nodes <= RULE_SIZE + 2);
+
+  engine_t* engine = (engine_t*) malloc(sizeof(engine_t));
+  engine->name = "bitslice";
+  engine->data = bs;
+  engine->load = bitslice_load;
+  engine->step = bitslice_step;
+  engine->store = bitslice_store;
+  engine->activity = NULL;
+  engine->free = bitslice_free;
+  engine->stats = NULL;
+  engine->state_hash = NULL;
+  return engine;
+}
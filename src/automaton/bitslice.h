@@ -0,0 +1,17 @@
+#include <stdint.h>
+#include "automaton/engine.h"
+
+#ifndef BITSLICE_H /* Include guard */
+#define BITSLICE_H
+
+/**
+ * @brief Create a bit-packed engine for 2 states, horizon 1 rules.
+ *
+ * The grid is stored as 64 cells per word and the 512 entries rule table is
+ * compiled to a reduced decision diagram evaluated with bitwise logic on 64
+ * cells at once. Rows are split across the workers of `pool` if not NULL,
+ * the engine takes ownership of the pool.
+ */
+engine_t* bitslice_engine_new(size_t size, uint8_t rule[512], pool_t* pool);
+
+#endif // BITSLICE_H
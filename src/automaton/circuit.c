@@ -0,0 +1,465 @@
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "automaton/circuit.h"
+
+#define NEIGHBORS 9
+#define MAX_BITS 2 /* Bits per cell, up to 4 states */
+#define INPUTS (NEIGHBORS * MAX_BITS)
+#define BLOCK 8 /* Words evaluated together for each node */
+#define MAX_NODES (1 << 11) /* Larger circuits lose to a table lookup */
+#define UNIQUE_SIZE (1 << 13)
+#define ORDERS 4
+
+/**
+ * Node of the decision diagram: the output is `hi` when the input bit `var`
+ * (bit var % bits of neighbor var / bits) is set and `lo` otherwise. Nodes 0
+ * and 1 are the constant leaves.
+ */
+typedef struct node_s
+{
+  uint32_t var;
+  uint32_t lo;
+  uint32_t hi;
+} node_t;
+
+/** Compiled circuit computing the output planes of a block of cells */
+typedef void (*CircuitF)(uint64_t in[][BLOCK], uint64_t out[][BLOCK]);
+
+typedef struct circuit_s
+{
+  size_t size;
+  size_t words; /**< Number of words per row */
+  uint64_t last_mask; /**< Valid bits of the last word of a row */
+  int bits; /**< Bit planes per cell */
+  uint64_t* grid; /**< `bits` planes of size rows */
+  uint64_t* next;
+  pool_t* pool; /**< Workers updating row bands, NULL when serial */
+  int n_nodes;
+  node_t* nodes;
+  uint32_t roots[MAX_BITS]; /**< Node of each output bit */
+  CircuitF kernel; /**< Compiled circuit, NULL when evaluated */
+  void* library;
+  int n_scratch;
+  uint64_t** scratch; /**< Inputs and node values of a block, per worker */
+} circuit_t;
+
+typedef struct builder_s
+{
+  uint8_t* rule;
+  int states;
+  int bits;
+  const int* order; /**< Neighbors from the root of the diagram down */
+  uint32_t pows[NEIGHBORS];
+  int output; /**< Bit of the output being built */
+  int n_nodes;
+  node_t* nodes;
+  int32_t* unique; /**< Hash-consing table of the nodes */
+} builder_t;
+
+/** Neighbor orders tried, row-major, reversed, and from the center out */
+static const int orders[ORDERS][NEIGHBORS] = {
+  {0, 1, 2, 3, 4, 5, 6, 7, 8},
+  {8, 7, 6, 5, 4, 3, 2, 1, 0},
+  {4, 1, 3, 5, 7, 0, 2, 6, 8},
+  {0, 2, 6, 8, 1, 3, 5, 7, 4}
+};
+
+static uint32_t make_node(builder_t* b, uint32_t var, uint32_t lo,
+                          uint32_t hi)
+{
+  if (lo == hi || b->n_nodes >= MAX_NODES) {
+    return lo;
+  }
+
+  size_t h = ((size_t)var * 1000003 + (size_t)lo * 8191 + (size_t)hi)
+    % UNIQUE_SIZE;
+  while (b->unique[h] != -1) {
+    node_t* node = &b->nodes[b->unique[h]];
+    if (node->var == var && node->lo == lo && node->hi == hi) {
+      return b->unique[h];
+    }
+    h = (h + 1) % UNIQUE_SIZE;
+  }
+
+  int id = b->n_nodes++;
+  b->nodes[id].var = var;
+  b->nodes[id].lo = lo;
+  b->nodes[id].hi = hi;
+  b->unique[h] = id;
+  return id;
+}
+
+static uint32_t build_node(builder_t* b, int depth, uint32_t offset);
+
+/**
+ * Node deciding on the bits k and below of `neighbor`, the higher ones
+ * giving `prefix`. Branches whose values are all above the number of states
+ * are don't cares and replaced by the other branch.
+ */
+static uint32_t build_bits(builder_t* b, int depth, int neighbor, int k,
+                           uint32_t prefix, uint32_t offset)
+{
+  if (k < 0) {
+    return build_node(b, depth + 1, offset + prefix * b->pows[neighbor]);
+  }
+  uint32_t lo = build_bits(b, depth, neighbor, k - 1, 2 * prefix, offset);
+  if (((2 * prefix + 1) << k) >= (uint32_t) b->states) {
+    return lo;
+  }
+  uint32_t hi = build_bits(b, depth, neighbor, k - 1, 2 * prefix + 1,
+                           offset);
+  return make_node(b, neighbor * b->bits + k, lo, hi);
+}
+
+/**
+ * Build the node for the rule entries starting at `offset`, in which the
+ * neighbors before `depth` in the order are fixed. Children are always
+ * created before their parent so the nodes are stored in evaluation order.
+ */
+static uint32_t build_node(builder_t* b, int depth, uint32_t offset)
+{
+  if (depth == NEIGHBORS) {
+    return (b->rule[offset] >> b->output) & 1;
+  }
+  return build_bits(b, depth, b->order[depth], b->bits - 1, 0, offset);
+}
+
+/** Build the diagrams of all the output bits, 0 if they are too large */
+static int build_circuit(builder_t* b, uint32_t roots[MAX_BITS])
+{
+  for (int h = 0; h < UNIQUE_SIZE; ++h) {
+    b->unique[h] = -1;
+  }
+  b->n_nodes = 2;
+  for (int o = 0; o < b->bits; ++o) {
+    b->output = o;
+    roots[o] = build_node(b, 0, 0);
+  }
+  return (b->n_nodes < MAX_NODES) ? b->n_nodes: 0;
+}
+
+/** Evaluate the diagram bottom-up as a chain of multiplexers */
+static void evaluate(circuit_t* ct, uint64_t in[][BLOCK],
+                     uint64_t out[][BLOCK], uint64_t values[][BLOCK])
+{
+  for (size_t c = 0; c < BLOCK; ++c) {
+    values[0][c] = 0;
+    values[1][c] = ~(uint64_t)0;
+  }
+  for (int n = 2; n < ct->n_nodes; ++n) {
+    node_t node = ct->nodes[n];
+    for (size_t c = 0; c < BLOCK; ++c) {
+      uint64_t lo = values[node.lo][c];
+      values[n][c] = lo ^ (in[node.var][c] & (lo ^ values[node.hi][c]));
+    }
+  }
+  for (int o = 0; o < ct->bits; ++o) {
+    memcpy(out[o], values[ct->roots[o]], sizeof(out[o]));
+  }
+}
+
+/**
+ * Input planes of `count` consecutive words of a row, input neighbor * bits
+ * + bit holding `bit` of the neighbor at row offset neighbor / 3 - 1 and
+ * column offset neighbor % 3 - 1.
+ */
+static void input_planes(circuit_t* ct, uint64_t* rows[3], int bit,
+                         size_t first, size_t count, uint64_t in[][BLOCK])
+{
+  size_t words = ct->words;
+  int last_bit = (ct->size - 1) & 63;
+  int bits = ct->bits;
+
+  for (int k = 0; k < 3; ++k) {
+    uint64_t* x = rows[k];
+    for (size_t c = 0; c < count; ++c) {
+      size_t w = first + c;
+      uint64_t carry_l = (w > 0) ? x[w - 1] >> 63
+        : (x[words - 1] >> last_bit) & 1;
+      uint64_t carry_r = (w < words - 1) ? x[w + 1] & 1: x[0] & 1;
+      int top = (w < words - 1) ? 63: last_bit;
+
+      in[(k * 3) * bits + bit][c] = (x[w] << 1) | carry_l;
+      in[(k * 3 + 1) * bits + bit][c] = x[w];
+      in[(k * 3 + 2) * bits + bit][c] = (x[w] >> 1) | (carry_r << top);
+    }
+  }
+}
+
+static void circuit_band(void* data, void* in, void* out,
+                         size_t row_begin, size_t row_end, int worker)
+{
+  circuit_t* ct = (circuit_t*) data;
+  uint64_t* grid = (uint64_t*) in;
+  size_t size = ct->size;
+  size_t words = ct->words;
+  size_t plane = size * words;
+  uint64_t (*inputs)[BLOCK] = (uint64_t (*)[BLOCK]) ct->scratch[worker];
+  uint64_t (*values)[BLOCK] = &inputs[INPUTS];
+  uint64_t outputs[MAX_BITS][BLOCK];
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    for (size_t w = 0; w < words; w += BLOCK) {
+      size_t count = (words - w < BLOCK) ? words - w: BLOCK;
+
+      for (int bit = 0; bit < ct->bits; ++bit) {
+        uint64_t* rows[3] = {
+          &grid[bit * plane + ((i + size - 1) % size) * words],
+          &grid[bit * plane + i * words],
+          &grid[bit * plane + ((i + 1) % size) * words]
+        };
+        input_planes(ct, rows, bit, w, count, inputs);
+      }
+
+      if (ct->kernel) {
+        ct->kernel(inputs, outputs);
+      }
+      else {
+        evaluate(ct, inputs, outputs, values);
+      }
+
+      for (int bit = 0; bit < ct->bits; ++bit) {
+        uint64_t* row_out = &((uint64_t*) out)[bit * plane + i * words];
+        memcpy(&row_out[w], outputs[bit], count * sizeof(uint64_t));
+      }
+    }
+    for (int bit = 0; bit < ct->bits; ++bit) {
+      ((uint64_t*) out)[bit * plane + i * words + words - 1] &=
+        ct->last_mask;
+    }
+  }
+}
+
+/** C expression of the value of a node */
+static void node_expression(char* buf, size_t n, uint32_t node)
+{
+  if (node < 2) {
+    snprintf(buf, n, node ? "~(uint64_t)0": "(uint64_t)0");
+  }
+  else {
+    snprintf(buf, n, "n%u", node);
+  }
+}
+
+/** Emit the circuit as straight-line C, with the constant muxes simplified */
+static void emit_circuit(circuit_t* ct, FILE* f)
+{
+  char lo[32], hi[32];
+
+  fprintf(f, "#include <stdint.h>\n\n"
+          "void circuit_kernel(uint64_t in[][%i], uint64_t out[][%i])\n"
+          "{\n  for (int c = 0; c < %i; ++c) {\n", BLOCK, BLOCK, BLOCK);
+  for (int n = 2; n < ct->n_nodes; ++n) {
+    node_t node = ct->nodes[n];
+    node_expression(lo, sizeof(lo), node.lo);
+    node_expression(hi, sizeof(hi), node.hi);
+
+    fprintf(f, "    const uint64_t n%i = ", n);
+    if (node.lo == 0 && node.hi == 1) {
+      fprintf(f, "in[%u][c];\n", node.var);
+    }
+    else if (node.lo == 1 && node.hi == 0) {
+      fprintf(f, "~in[%u][c];\n", node.var);
+    }
+    else if (node.lo == 0) {
+      fprintf(f, "in[%u][c] & %s;\n", node.var, hi);
+    }
+    else if (node.hi == 0) {
+      fprintf(f, "~in[%u][c] & %s;\n", node.var, lo);
+    }
+    else if (node.lo == 1) {
+      fprintf(f, "~in[%u][c] | %s;\n", node.var, hi);
+    }
+    else if (node.hi == 1) {
+      fprintf(f, "in[%u][c] | %s;\n", node.var, lo);
+    }
+    else {
+      fprintf(f, "%s ^ (in[%u][c] & (%s ^ %s));\n", lo, node.var, lo, hi);
+    }
+  }
+  for (int o = 0; o < ct->bits; ++o) {
+    node_expression(lo, sizeof(lo), ct->roots[o]);
+    fprintf(f, "    out[%i][c] = %s;\n", o, lo);
+  }
+  fprintf(f, "  }\n}\n");
+}
+
+/** Build the emitted circuit with the system compiler and load it */
+static void compile_circuit(circuit_t* ct)
+{
+  char dir[] = "/tmp/circuitXXXXXX";
+  char source[64], library[64], command[256];
+  const char* cc = getenv("CC") ? getenv("CC"): "cc";
+
+  if (mkdtemp(dir) == NULL) {
+    perror(dir);
+    return;
+  }
+  snprintf(source, sizeof(source), "%s/kernel.c", dir);
+  snprintf(library, sizeof(library), "%s/kernel.so", dir);
+  snprintf(command, sizeof(command),
+           "%s -O3 -march=native -fPIC -shared -o %s %s", cc, library, source);
+
+  FILE* f = fopen(source, "w");
+  if (f) {
+    emit_circuit(ct, f);
+    fclose(f);
+    if (system(command) == 0) {
+      ct->library = dlopen(library, RTLD_NOW);
+    }
+  }
+  if (ct->library) {
+    ct->kernel = (CircuitF) dlsym(ct->library, "circuit_kernel");
+  }
+  else {
+    fprintf(stderr, "Could not build the circuit kernel, evaluating it"
+            " instead\n");
+  }
+
+  unlink(source);
+  unlink(library);
+  rmdir(dir);
+}
+
+static void circuit_step(engine_t* engine, long n)
+{
+  circuit_t* ct = (circuit_t*) engine->data;
+  engine_run_bands(ct->pool, circuit_band, ct, ct->size,
+                   (void**) &ct->grid, (void**) &ct->next, n);
+}
+
+static void circuit_load(engine_t* engine, uint8_t* frame)
+{
+  circuit_t* ct = (circuit_t*) engine->data;
+  size_t plane = ct->size * ct->words;
+
+  memset(ct->grid, 0, ct->bits * plane * sizeof(uint64_t));
+  for (int bit = 0; bit < ct->bits; ++bit) {
+    for (size_t i = 0; i < ct->size; ++i) {
+      for (size_t j = 0; j < ct->size; ++j) {
+        ct->grid[bit * plane + i * ct->words + j / 64] |=
+          (uint64_t)((frame[i * ct->size + j] >> bit) & 1) << (j % 64);
+      }
+    }
+  }
+}
+
+static void circuit_store(engine_t* engine, uint8_t* frame)
+{
+  circuit_t* ct = (circuit_t*) engine->data;
+  size_t plane = ct->size * ct->words;
+
+  memset(frame, 0, ct->size * ct->size * sizeof(uint8_t));
+  for (int bit = 0; bit < ct->bits; ++bit) {
+    for (size_t i = 0; i < ct->size; ++i) {
+      for (size_t j = 0; j < ct->size; ++j) {
+        frame[i * ct->size + j] |= (uint8_t)
+          (((ct->grid[bit * plane + i * ct->words + j / 64] >> (j % 64)) & 1)
+           << bit);
+      }
+    }
+  }
+}
+
+static void circuit_free(engine_t* engine)
+{
+  circuit_t* ct = (circuit_t*) engine->data;
+  if (ct->pool) {
+    pool_free(ct->pool);
+  }
+  if (ct->library) {
+    dlclose(ct->library);
+  }
+  for (int w = 0; w < ct->n_scratch; ++w) {
+    free(ct->scratch[w]);
+  }
+  free(ct->scratch);
+  free(ct->nodes);
+  free(ct->grid);
+  free(ct->next);
+  free(ct);
+}
+
+engine_t* circuit_engine_new(uint8_t* rule, struct Options2D* opts,
+                             pool_t* pool, int compile)
+{
+  builder_t b;
+  uint32_t roots[MAX_BITS];
+  node_t* best = NULL;
+  int best_nodes = 0;
+
+  b.rule = rule;
+  b.states = opts->states;
+  b.bits = (opts->states > 2) ? 2: 1;
+  b.pows[0] = 1;
+  for (int k = 1; k < NEIGHBORS; ++k) {
+    b.pows[k] = b.pows[k - 1] * opts->states;
+  }
+  b.nodes = (node_t*) malloc(MAX_NODES * sizeof(node_t));
+  b.unique = (int32_t*) malloc(UNIQUE_SIZE * sizeof(int32_t));
+
+  circuit_t* ct = (circuit_t*) calloc(1, sizeof(circuit_t));
+
+  /* Keep the smallest circuit over the neighbor orders */
+  for (int k = 0; k < ORDERS; ++k) {
+    b.order = orders[k];
+    int n_nodes = build_circuit(&b, roots);
+    if (n_nodes > 0 && (best == NULL || n_nodes < best_nodes)) {
+      best_nodes = n_nodes;
+      best = (node_t*) realloc(best, n_nodes * sizeof(node_t));
+      memcpy(best, b.nodes, n_nodes * sizeof(node_t));
+      memcpy(ct->roots, roots, sizeof(roots));
+    }
+  }
+  free(b.nodes);
+  free(b.unique);
+
+  if (best == NULL) {
+    free(ct);
+    if (pool) {
+      pool_free(pool);
+    }
+    return NULL;
+  }
+
+  size_t size = opts->size;
+  ct->size = size;
+  ct->words = (size + 63) / 64;
+  ct->last_mask = (size % 64 == 0) ? ~(uint64_t)0
+    : ((uint64_t)1 << (size % 64)) - 1;
+  ct->bits = b.bits;
+  ct->n_nodes = best_nodes;
+  ct->nodes = best;
+  ct->pool = pool;
+  ct->grid = (uint64_t*)
+    engine_alloc_rows(pool, size, ct->bits * ct->words * sizeof(uint64_t));
+  ct->next = (uint64_t*)
+    engine_alloc_rows(pool, size, ct->bits * ct->words * sizeof(uint64_t));
+
+  if (compile) {
+    compile_circuit(ct);
+  }
+
+  ct->n_scratch = pool ? pool_size(pool): 1;
+  ct->scratch = (uint64_t**) malloc(ct->n_scratch * sizeof(uint64_t*));
+  for (int w = 0; w < ct->n_scratch; ++w) {
+    ct->scratch[w] = (uint64_t*)
+      malloc((INPUTS + (ct->kernel ? 0: best_nodes)) * BLOCK
+             * sizeof(uint64_t));
+  }
+
+  engine_t* engine = (engine_t*) malloc(sizeof(engine_t));
+  engine->name = ct->kernel ? "compiled": "circuit";
+  engine->data = ct;
+  engine->load = circuit_load;
+  engine->step = circuit_step;
+  engine->store = circuit_store;
+  engine->activity = NULL;
+  engine->free = circuit_free;
+  engine->stats = NULL;
+  engine->state_hash = NULL;
+  return engine;
+}
@@ -0,0 +1,29 @@
+#include <stdint.h>
+#include "automaton/engine.h"
+
+#ifndef CIRCUIT_H /* Include guard */
+#define CIRCUIT_H
+
+/**
+ * @brief Create an engine running a horizon 1 rule as a boolean circuit.
+ *
+ * The states are encoded on ceil(log2(states)) bit planes of 64 cells per
+ * word. Each bit of the output is compiled to a reduced ordered decision
+ * diagram over the bits of the 9 neighbors, the diagrams of all the output
+ * bits sharing their common nodes, and the encodings of states above
+ * `states` being don't cares. The smallest diagram over a few neighbor
+ * orders is kept.
+ *
+ * The diagram is evaluated as a chain of multiplexers on blocks of 512
+ * cells. With `compile`, it is instead emitted as C, built with the system
+ * compiler (the CC environment variable, cc by default) and loaded with
+ * dlopen, falling back to the evaluation when that fails.
+ *
+ * Returns NULL for rules whose circuit is too large to pay off. Rows are
+ * split across the workers of `pool` if not NULL, the engine takes ownership
+ * of the pool.
+ */
+engine_t* circuit_engine_new(uint8_t* rule, struct Options2D* opts,
+                             pool_t* pool, int compile);
+
+#endif // CIRCUIT_H
@@ -0,0 +1,341 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "automaton/compact.h"
+#include "automaton/gather.h"
+#include "automaton/kernels.h"
+#include "utils/utils.h"
+
+#define NEIGHBORS 9
+#define TRIAL_ROWS 64 /* Rows of the band timed for each encoding */
+#define TRIAL_RUNS 3
+#define MAX_SHIFT_BYTES (1 << 20) /* Largest table with shifted digits when
+                                     states is not a power of 2 */
+
+/* Flags of an encoding */
+#define ENCODE_COLUMNS 1 /* Digits grouped by column */
+#define ENCODE_PACKED 2 /* Outputs on `bits` bits */
+#define ENCODE_SHIFT 4 /* Digits on `bits` bits */
+#define ENCODINGS 8
+
+static const char* encoding_names[ENCODINGS] = {
+  "compact", "compact/columns", "compact/packed", "compact/packed+columns",
+  "compact/shift", "compact/shift+columns", "compact/shift+packed",
+  "compact/shift+packed+columns"
+};
+
+typedef struct compact_s
+{
+  size_t size;
+  int states;
+  int bits; /**< Bits of a state */
+  uint8_t* rule;
+  uint8_t* table; /**< Encoded rule, padded for the gathers */
+  int encoding; /**< ENCODE_ flags, -1 until the first step */
+  uint8_t* frame1;
+  uint8_t* frame2;
+  pool_t* pool;
+} compact_t;
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1E-9;
+}
+
+/** Index in the encoded table of the neighbor at row k and column l */
+static int digit_position(int encoding, int k, int l)
+{
+  return (encoding & ENCODE_COLUMNS) ? 3 * (2 - l) + k: 3 * k + l;
+}
+
+static uint64_t table_entries(compact_t* ct, int encoding)
+{
+  return (encoding & ENCODE_SHIFT) ? (uint64_t)1 << (NEIGHBORS * ct->bits)
+    : ipow(ct->states, NEIGHBORS);
+}
+
+static uint64_t table_bytes(compact_t* ct, int encoding)
+{
+  uint64_t entries = table_entries(ct, encoding);
+  return ((encoding & ENCODE_PACKED) ? (entries * ct->bits + 7) / 8: entries)
+    + RULE_PADDING;
+}
+
+/**
+ * Whether the encoding is worth a trial: shifted digits are the plain ones
+ * when states is a power of 2, and waste too much space otherwise unless
+ * the table is small.
+ */
+static int encoding_valid(compact_t* ct, int encoding)
+{
+  int power_of_2 = (ct->states & (ct->states - 1)) == 0;
+  if (encoding & ENCODE_SHIFT) {
+    return !power_of_2 && table_bytes(ct, encoding) <= MAX_SHIFT_BYTES;
+  }
+  return 1;
+}
+
+/** Encoded copy of the rule */
+static uint8_t* encode_table(compact_t* ct, int encoding)
+{
+  int states = ct->states;
+  int bits = ct->bits;
+  uint64_t base = (encoding & ENCODE_SHIFT) ? (uint64_t)1 << bits: states;
+  uint64_t weights[NEIGHBORS];
+  int digits[NEIGHBORS] = {0};
+
+  for (int k = 0; k < 3; ++k) {
+    for (int l = 0; l < 3; ++l) {
+      weights[3 * k + l] = ipow(base, digit_position(encoding, k, l));
+    }
+  }
+
+  uint8_t* table = (uint8_t*) calloc(table_bytes(ct, encoding),
+                                     sizeof(uint8_t));
+  uint64_t entries = ipow(states, NEIGHBORS);
+  uint64_t e = 0;
+
+  /* Walk the rule indices like an odometer, e following the digits */
+  for (uint64_t index = 0; index < entries; ++index) {
+    if (encoding & ENCODE_PACKED) {
+      uint64_t bit = e * bits;
+      table[bit / 8] |= ct->rule[index] << (bit % 8);
+      table[bit / 8 + 1] |= (ct->rule[index] << (bit % 8)) >> 8;
+    }
+    else {
+      table[e] = ct->rule[index];
+    }
+
+    for (int p = 0; p < NEIGHBORS; ++p) {
+      e += weights[p];
+      if (++digits[p] < states) {
+        break;
+      }
+      digits[p] = 0;
+      e -= states * weights[p];
+    }
+  }
+  return table;
+}
+
+/**
+ * Update the rows [row_begin, row_end) like update_step_sliding with the
+ * given encoding, the lookups of a row going through the gathers. The flags
+ * are constants in each call of compact_band so that every encoding gets its
+ * own index loops.
+ */
+static inline __attribute__((always_inline))
+void compact_rows(compact_t* ct, uint8_t* autom, uint8_t* last_autom,
+                  size_t row_begin, size_t row_end, const int encoding)
+{
+  size_t size = ct->size;
+  size_t pitch = size + 2;
+  const int bits = ct->bits;
+  const uint32_t base = (encoding & ENCODE_SHIFT) ? 1 << bits: ct->states;
+  const uint32_t base2 = base * base;
+  const uint32_t base3 = base2 * base;
+  const uint32_t base6 = base3 * base3;
+  uint32_t codes[pitch];
+  uint32_t index[size];
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* rows = &last_autom[i * pitch];
+    uint8_t* out = &autom[(i + 1) * pitch + 1];
+
+    for (size_t c = 0; c < pitch; ++c) {
+      uint32_t s0 = rows[c];
+      uint32_t s1 = rows[pitch + c];
+      uint32_t s2 = rows[2 * pitch + c];
+      if (encoding & ENCODE_SHIFT) {
+        codes[c] = (encoding & ENCODE_COLUMNS)
+          ? s0 | s1 << bits | s2 << (2 * bits)
+          : s0 | s1 << (3 * bits) | s2 << (6 * bits);
+      }
+      else {
+        codes[c] = (encoding & ENCODE_COLUMNS)
+          ? s0 + s1 * base + s2 * base2
+          : s0 + s1 * base3 + s2 * base6;
+      }
+    }
+
+    for (size_t j = 0; j < size; ++j) {
+      if (encoding & ENCODE_SHIFT) {
+        index[j] = (encoding & ENCODE_COLUMNS)
+          ? codes[j + 2] | codes[j + 1] << (3 * bits)
+            | codes[j] << (6 * bits)
+          : codes[j] | codes[j + 1] << bits | codes[j + 2] << (2 * bits);
+      }
+      else {
+        index[j] = (encoding & ENCODE_COLUMNS)
+          ? codes[j + 2] + codes[j + 1] * base3 + codes[j] * base6
+          : codes[j] + codes[j + 1] * base + codes[j + 2] * base2;
+      }
+    }
+
+    if (encoding & ENCODE_PACKED) {
+      gather_lookup_packed(ct->table, bits, index, size, out);
+    }
+    else {
+      gather_lookup(ct->table, index, size, out);
+    }
+  }
+
+  refresh_halo_rows(size, autom, 1, row_begin, row_end);
+}
+
+static void compact_band(void* data, void* in, void* out,
+                         size_t row_begin, size_t row_end, int worker)
+{
+  (void)(worker); /* Unused parameter */
+  compact_t* ct = (compact_t*) data;
+  uint8_t* autom = (uint8_t*) out;
+  uint8_t* last_autom = (uint8_t*) in;
+
+  switch (ct->encoding) {
+  case 0:
+    compact_rows(ct, autom, last_autom, row_begin, row_end, 0);
+    break;
+  case 1:
+    compact_rows(ct, autom, last_autom, row_begin, row_end, 1);
+    break;
+  case 2:
+    compact_rows(ct, autom, last_autom, row_begin, row_end, 2);
+    break;
+  case 3:
+    compact_rows(ct, autom, last_autom, row_begin, row_end, 3);
+    break;
+  case 4:
+    compact_rows(ct, autom, last_autom, row_begin, row_end, 4);
+    break;
+  case 5:
+    compact_rows(ct, autom, last_autom, row_begin, row_end, 5);
+    break;
+  case 6:
+    compact_rows(ct, autom, last_autom, row_begin, row_end, 6);
+    break;
+  default:
+    compact_rows(ct, autom, last_autom, row_begin, row_end, 7);
+    break;
+  }
+}
+
+/**
+ * Time every valid encoding on the first rows of the loaded grid and keep
+ * the fastest. The band is written to the next frame, which the following
+ * step overwrites.
+ */
+static void choose_encoding(compact_t* ct)
+{
+  size_t rows = (ct->size < TRIAL_ROWS) ? ct->size: TRIAL_ROWS;
+  double best_time = 0;
+  int best = -1;
+  uint8_t* best_table = NULL;
+
+  for (int encoding = 0; encoding < ENCODINGS; ++encoding) {
+    if (!encoding_valid(ct, encoding)) {
+      continue;
+    }
+    ct->encoding = encoding;
+    ct->table = encode_table(ct, encoding);
+
+    /* The first run brings the touched part of the table in cache */
+    double elapsed = 0;
+    for (int r = 0; r <= TRIAL_RUNS; ++r) {
+      double start = now();
+      compact_band(ct, ct->frame1, ct->frame2, 0, rows, 0);
+      double run = now() - start;
+      if (r == 1 || (r > 1 && run < elapsed)) {
+        elapsed = run;
+      }
+    }
+
+    if (best < 0 || elapsed < best_time) {
+      free(best_table);
+      best = encoding;
+      best_time = elapsed;
+      best_table = ct->table;
+    }
+    else {
+      free(ct->table);
+    }
+  }
+
+  ct->encoding = best;
+  ct->table = best_table;
+}
+
+static void compact_load(engine_t* engine, uint8_t* frame)
+{
+  compact_t* ct = (compact_t*) engine->data;
+  pad_frame(ct->size, 1, frame, ct->frame1);
+}
+
+static void compact_step(engine_t* engine, long n)
+{
+  compact_t* ct = (compact_t*) engine->data;
+
+  if (ct->encoding < 0 && n > 0) {
+    choose_encoding(ct);
+    engine->name = encoding_names[ct->encoding];
+  }
+  /* The last generation is swept along with its statistics */
+  long fused = (engine->stats && n > 0) ? 1: 0;
+  engine_run_bands(ct->pool, compact_band, ct, ct->size,
+                   (void**) &ct->frame1, (void**) &ct->frame2, n - fused);
+  if (fused) {
+    engine_run_stats(ct->pool, compact_band, ct, ct->size, 1, ct->states,
+                     (void**) &ct->frame1, (void**) &ct->frame2,
+                     engine->stats);
+  }
+}
+
+static void compact_store(engine_t* engine, uint8_t* frame)
+{
+  compact_t* ct = (compact_t*) engine->data;
+  unpad_frame(ct->size, 1, ct->frame1, frame);
+}
+
+static void compact_free(engine_t* engine)
+{
+  compact_t* ct = (compact_t*) engine->data;
+  if (ct->pool) {
+    pool_free(ct->pool);
+  }
+  free(ct->table);
+  free(ct->frame1);
+  free(ct->frame2);
+  free(ct);
+}
+
+engine_t* compact_engine_new(uint8_t* rule, struct Options2D* opts)
+{
+  compact_t* ct = (compact_t*) malloc(sizeof(compact_t));
+  size_t pitch = opts->size + 2;
+
+  ct->size = opts->size;
+  ct->states = opts->states;
+  ct->bits = 1;
+  while ((1 << ct->bits) < opts->states) {
+    ++ct->bits;
+  }
+  ct->rule = rule;
+  ct->table = NULL;
+  ct->encoding = -1;
+  ct->pool = engine_pool_new(opts);
+  ct->frame1 = (uint8_t*) engine_alloc_rows(ct->pool, pitch, pitch);
+  ct->frame2 = (uint8_t*) engine_alloc_rows(ct->pool, pitch, pitch);
+
+  engine_t* engine = (engine_t*) malloc(sizeof(engine_t));
+  engine->name = encoding_names[0];
+  engine->data = ct;
+  engine->load = compact_load;
+  engine->step = compact_step;
+  engine->store = compact_store;
+  engine->activity = NULL;
+  engine->free = compact_free;
+  engine->stats = NULL;
+  engine->state_hash = NULL;
+  return engine;
+}
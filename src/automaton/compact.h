@@ -0,0 +1,32 @@
+#include <stdint.h>
+#include "automaton/engine.h"
+
+#ifndef COMPACT_H /* Include guard */
+#define COMPACT_H
+
+/** Smallest number of states whose table the automatic engine compacts */
+#define COMPACT_MIN_STATES 5
+/** Largest number of states of the compact encodings */
+#define COMPACT_MAX_STATES 8
+
+/**
+ * @brief Create a lookup table engine for horizon 1 rules whose table does
+ * not fit in cache.
+ *
+ * The table is re-encoded to shrink the part of it touched by a grid:
+ * outputs packed on ceil(log2(states)) bits instead of a byte, neighbor
+ * digits on that many bits so the index is built with shifts instead of
+ * multiplications (when the larger table stays small), and the digits
+ * grouped by column instead of by row, the newest column of the sliding
+ * window being the least significant so that neighborhoods entering the
+ * same pattern share cache lines.
+ *
+ * The indices of a row are computed first and looked up with gather_lookup
+ * or gather_lookup_packed. The encoding is picked on the first step by
+ * timing every candidate on a band of the loaded grid, the time of a lookup
+ * being dominated by its cache misses. Rows are split across opts->threads
+ * workers.
+ */
+engine_t* compact_engine_new(uint8_t* rule, struct Options2D* opts);
+
+#endif // COMPACT_H
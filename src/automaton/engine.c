@@ -0,0 +1,505 @@
+#include <stdlib.h>
+#include <string.h>
+#include "automaton/engine.h"
+#include "automaton/active.h"
+#include "automaton/bitslice.h"
+#include "automaton/circuit.h"
+#include "automaton/compact.h"
+#include "automaton/gather.h"
+#include "automaton/hashlife.h"
+#include "automaton/kernels.h"
+#include "automaton/packed3.h"
+#include "automaton/plane.h"
+#include "automaton/sparse.h"
+#include "automaton/specialized.h"
+#include "automaton/totalistic.h"
+
+#define TILE 256 /* Side of the tiles advanced together by temporal blocking */
+#define STATS_ROWS 8 /* Rows updated before their statistics are taken */
+
+/** State of the lookup table engines: two padded frames updated by a
+    ProcessF */
+typedef struct dense_s
+{
+  size_t size;
+  int horizon;
+  int states;
+  uint8_t* rule;
+  uint8_t* table; /**< Padded copy of the rule owned by the engine, or NULL */
+  uint32_t* pows;
+  ProcessF process_function;
+  uint8_t* frame1;
+  uint8_t* frame2;
+  pool_t* pool;
+  int time_block; /**< Generations advanced per tile, 1 without blocking */
+  size_t tile; /**< Side of a tile */
+  size_t local; /**< Side of the local frames: tile + 2 time_block horizon */
+  int n_scratch;
+  uint8_t** scratch; /**< Two local frames per worker */
+} dense_t;
+
+/** Job shared by the workers of engine_run_bands */
+typedef struct band_job_s
+{
+  BandF band;
+  void* data;
+  size_t rows;
+  void* grid;
+  void* next;
+  long steps;
+} band_job_t;
+
+static void band_job(pool_t* pool, void* arg, int worker)
+{
+  band_job_t* job = (band_job_t*) arg;
+  void* grid = job->grid;
+  void* next = job->next;
+  void* temp;
+  size_t begin, end;
+
+  pool_band(pool, worker, job->rows, &begin, &end);
+  for (long i = 0; i < job->steps; ++i) {
+    job->band(job->data, grid, next, begin, end, worker);
+    /* All the bands must be written before the next step reads them */
+    pool_barrier(pool);
+    temp = grid;
+    grid = next;
+    next = temp;
+  }
+}
+
+void engine_run_bands(pool_t* pool, BandF band, void* data, size_t rows,
+                      void** grid, void** next, long n)
+{
+  void* temp;
+
+  if (pool == NULL) {
+    for (long i = 0; i < n; ++i) {
+      band(data, *grid, *next, 0, rows, 0);
+      temp = *grid;
+      *grid = *next;
+      *next = temp;
+    }
+    return;
+  }
+
+  band_job_t job = {band, data, rows, *grid, *next, n};
+  pool_run(pool, band_job, &job);
+  if (n % 2 == 1) {
+    temp = *grid;
+    *grid = *next;
+    *next = temp;
+  }
+}
+
+/** Band updating rows and taking their statistics, see engine_run_stats */
+typedef struct stats_job_s
+{
+  BandF band;
+  void* data;
+  size_t size;
+  int horizon;
+  int states;
+  step_stats_t* parts; /**< Statistics of the rows of each worker */
+} stats_job_t;
+
+static void stats_band(void* data, void* in, void* out,
+                       size_t row_begin, size_t row_end, int worker)
+{
+  stats_job_t* job = (stats_job_t*) data;
+
+  for (size_t r = row_begin; r < row_end; r += STATS_ROWS) {
+    size_t end = (row_end - r < STATS_ROWS) ? row_end: r + STATS_ROWS;
+    job->band(job->data, in, out, r, end, worker);
+    stats_rows(&job->parts[worker], job->size, job->horizon, job->states,
+               (uint8_t*) out, (uint8_t*) in, r, end);
+  }
+}
+
+void engine_run_stats(pool_t* pool, BandF band, void* data, size_t size,
+                      int horizon, int states, void** grid, void** next,
+                      step_stats_t* stats)
+{
+  int workers = pool ? pool_size(pool): 1;
+  stats_job_t job = {band, data, size, horizon, states,
+                     (step_stats_t*) malloc(workers * sizeof(step_stats_t))};
+
+  for (int w = 0; w < workers; ++w) {
+    stats_clear(&job.parts[w]);
+  }
+  engine_run_bands(pool, stats_band, &job, size, grid, next, 1);
+
+  stats_clear(stats);
+  for (int w = 0; w < workers; ++w) {
+    stats_merge(stats, &job.parts[w]);
+  }
+  stats->fused = 1;
+  free(job.parts);
+}
+
+typedef struct touch_job_s
+{
+  uint8_t* buffer;
+  size_t rows;
+  size_t row_bytes;
+} touch_job_t;
+
+static void touch_job(pool_t* pool, void* arg, int worker)
+{
+  touch_job_t* job = (touch_job_t*) arg;
+  size_t begin, end;
+
+  pool_band(pool, worker, job->rows, &begin, &end);
+  memset(&job->buffer[begin * job->row_bytes], 0,
+         (end - begin) * job->row_bytes);
+}
+
+void* engine_alloc_rows(pool_t* pool, size_t rows, size_t row_bytes)
+{
+  if (pool == NULL) {
+    return calloc(rows, row_bytes);
+  }
+
+  touch_job_t job = {(uint8_t*) malloc(rows * row_bytes), rows, row_bytes};
+  pool_run(pool, touch_job, &job);
+  return job.buffer;
+}
+
+pool_t* engine_pool_new(struct Options2D* opts)
+{
+  return (opts->threads > 1) ? pool_new(opts->threads): NULL;
+}
+
+static void dense_band(void* data, void* in, void* out,
+                       size_t row_begin, size_t row_end, int worker)
+{
+  (void)(worker); /* Unused parameter */
+  dense_t* d = (dense_t*) data;
+  d->process_function(d->size, (uint8_t*) out, d->rule, (uint8_t*) in,
+                      d->horizon, d->pows, row_begin, row_end);
+}
+
+/**
+ * Copy `length` cells of a torus row starting at column `begin`, which may
+ * wrap around the row any number of times.
+ */
+static void copy_wrapped(uint8_t* dst, uint8_t* row, size_t size,
+                         size_t begin, size_t length)
+{
+  while (length > 0) {
+    size_t count = size - begin;
+    if (count > length) {
+      count = length;
+    }
+    memcpy(dst, &row[begin], count);
+    dst += count;
+    length -= count;
+    begin = 0;
+  }
+}
+
+/**
+ * @brief Advance the tile rows [row_begin, row_end) by time_block
+ * generations.
+ *
+ * Each tile is copied to a local frame along with the time_block * horizon
+ * cells around it, which is stepped in cache with the dense kernel. The
+ * valid part of the local frame shrinks by horizon cells on each side per
+ * generation (a trapezoid in time), the rows outside of it are skipped and
+ * the columns outside of it are computed but never read back.
+ */
+static void dense_block_band(void* data, void* in, void* out,
+                             size_t row_begin, size_t row_end, int worker)
+{
+  dense_t* d = (dense_t*) data;
+  size_t size = d->size;
+  size_t h = d->horizon;
+  size_t pitch = size + 2 * h;
+  size_t local = d->local;
+  size_t margin = d->time_block * h;
+  uint8_t* frame_in = (uint8_t*) in;
+  uint8_t* frame_out = (uint8_t*) out;
+  uint8_t* local1 = d->scratch[2 * worker];
+  uint8_t* local2 = d->scratch[2 * worker + 1];
+  uint8_t* temp;
+
+  size_t first_row = row_begin * d->tile;
+  size_t last_row = row_end * d->tile < size ? row_end * d->tile: size;
+
+  for (size_t r0 = first_row; r0 < last_row; r0 += d->tile) {
+    size_t rows = (last_row - r0 < d->tile) ? last_row - r0: d->tile;
+
+    for (size_t c0 = 0; c0 < size; c0 += d->tile) {
+      size_t cols = (size - c0 < d->tile) ? size - c0: d->tile;
+
+      /* Local cell (p, q) is cell (r0 - margin + p, c0 - margin + q) */
+      for (size_t p = 0; p < local; ++p) {
+        size_t i = (r0 + p + size * (margin / size + 1) - margin) % size;
+        copy_wrapped(&local1[p * local], &frame_in[(i + h) * pitch + h], size,
+                     (c0 + size * (margin / size + 1) - margin) % size,
+                     local);
+      }
+
+      for (int s = 0; s < d->time_block; ++s) {
+        d->process_function(local - 2 * h, local2, d->rule, local1, h,
+                            d->pows, s * h, local - 2 * h - s * h);
+        temp = local1;
+        local1 = local2;
+        local2 = temp;
+      }
+
+      for (size_t p = 0; p < rows; ++p) {
+        memcpy(&frame_out[(r0 + p + h) * pitch + c0 + h],
+               &local1[(p + margin) * local + margin], cols);
+      }
+    }
+  }
+
+  if (first_row < last_row) {
+    refresh_halo_rows(size, frame_out, h, first_row, last_row);
+  }
+}
+
+static void dense_load(engine_t* engine, uint8_t* frame)
+{
+  dense_t* d = (dense_t*) engine->data;
+  pad_frame(d->size, d->horizon, frame, d->frame1);
+}
+
+static void dense_step(engine_t* engine, long n)
+{
+  dense_t* d = (dense_t*) engine->data;
+  /* The last generation is swept along with its statistics */
+  long fused = (engine->stats && n > 0) ? 1: 0;
+  n -= fused;
+  long blocks = n / d->time_block;
+
+  /* Whole blocks are advanced tile by tile, the remainder one step at a
+     time */
+  if (d->time_block > 1 && blocks > 0) {
+    engine_run_bands(d->pool, dense_block_band, d,
+                     (d->size + d->tile - 1) / d->tile,
+                     (void**) &d->frame1, (void**) &d->frame2, blocks);
+    n -= blocks * d->time_block;
+  }
+  engine_run_bands(d->pool, dense_band, d, d->size,
+                   (void**) &d->frame1, (void**) &d->frame2, n);
+  if (fused) {
+    engine_run_stats(d->pool, dense_band, d, d->size, d->horizon, d->states,
+                     (void**) &d->frame1, (void**) &d->frame2, engine->stats);
+  }
+}
+
+static void dense_store(engine_t* engine, uint8_t* frame)
+{
+  dense_t* d = (dense_t*) engine->data;
+  unpad_frame(d->size, d->horizon, d->frame1, frame);
+}
+
+static void dense_free(engine_t* engine)
+{
+  dense_t* d = (dense_t*) engine->data;
+  if (d->pool) {
+    pool_free(d->pool);
+  }
+  free(d->frame1);
+  free(d->frame2);
+  free(d->pows);
+  free(d->table);
+  for (int k = 0; k < 2 * d->n_scratch; ++k) {
+    free(d->scratch[k]);
+  }
+  free(d->scratch);
+  free(d);
+}
+
+static engine_t* dense_engine_new(uint8_t* rule, struct Options2D* opts,
+                                  const char* name, ProcessF function)
+{
+  dense_t* d = (dense_t*) malloc(sizeof(dense_t));
+  int neigs = (2 * opts->horizon + 1) * (2 * opts->horizon + 1);
+  size_t pitch = opts->size + 2 * opts->horizon;
+
+  d->size = opts->size;
+  d->horizon = opts->horizon;
+  d->states = opts->states;
+  d->rule = rule;
+  d->table = NULL;
+  d->process_function = function;
+  d->pool = engine_pool_new(opts);
+  d->frame1 = (uint8_t*) engine_alloc_rows(d->pool, pitch, pitch);
+  d->frame2 = (uint8_t*) engine_alloc_rows(d->pool, pitch, pitch);
+  d->pows = (uint32_t*) malloc(neigs * sizeof(uint32_t));
+  neighborhood_pows(&opts->neighborhood, opts->states, d->pows);
+
+  d->time_block = (opts->time_block > 1) ? opts->time_block: 1;
+  d->tile = (opts->size < TILE) ? opts->size: TILE;
+  d->local = d->tile + 2 * d->time_block * opts->horizon;
+  d->n_scratch = 0;
+  d->scratch = NULL;
+  if (d->time_block > 1) {
+    d->n_scratch = d->pool ? pool_size(d->pool): 1;
+    d->scratch = (uint8_t**) malloc(2 * d->n_scratch * sizeof(uint8_t*));
+    /* Cells outside of the valid part are still used as rule indices so
+       the local frames must hold states from the start */
+    for (int k = 0; k < 2 * d->n_scratch; ++k) {
+      d->scratch[k] = (uint8_t*) calloc(d->local * d->local, sizeof(uint8_t));
+    }
+  }
+
+  engine_t* engine = (engine_t*) malloc(sizeof(engine_t));
+  engine->name = name;
+  engine->data = d;
+  engine->load = dense_load;
+  engine->step = dense_step;
+  engine->store = dense_store;
+  engine->activity = NULL;
+  engine->free = dense_free;
+  engine->stats = NULL;
+  engine->state_hash = NULL;
+  return engine;
+}
+
+/** Lookup table engine with the gather kernel, on a padded copy of the rule */
+static engine_t* gather_engine_new(uint64_t grule_size, uint8_t* rule,
+                                   struct Options2D* opts)
+{
+  uint8_t* table = (uint8_t*) calloc(grule_size + RULE_PADDING,
+                                     sizeof(uint8_t));
+  memcpy(table, rule, grule_size);
+
+  engine_t* engine = dense_engine_new(table, opts, "gather", gather_kernel());
+  ((dense_t*) engine->data)->table = table;
+  return engine;
+}
+
+/** Lookup table engine for any neighborhood, on a padded copy of the rule */
+static engine_t* masked_engine_new(uint64_t grule_size, uint8_t* rule,
+                                   struct Options2D* opts)
+{
+  uint8_t* table = (uint8_t*) calloc(grule_size + RULE_PADDING,
+                                     sizeof(uint8_t));
+  memcpy(table, rule, grule_size);
+
+  engine_t* engine = dense_engine_new(table, opts, "masked",
+                                      update_step_masked);
+  ((dense_t*) engine->data)->table = table;
+  return engine;
+}
+
+int engine_supported(enum EngineType type, int states, int horizon,
+                     size_t size)
+{
+  switch (type) {
+  case ENGINE_BITSLICE:
+    return states == 2 && horizon == 1;
+  case ENGINE_PACKED3:
+    return states == 3 && horizon == 1;
+  case ENGINE_HASHLIFE:
+    /* The quadtree covers a power of 2 torus */
+    return horizon == 1 && size >= 2 && (size & (size - 1)) == 0;
+  case ENGINE_PLANE:
+    /* A chunk only reads its 8 neighbors */
+    return horizon <= 64;
+  case ENGINE_CIRCUIT:
+  case ENGINE_COMPILED:
+    return horizon == 1 && states >= 2 && states <= 4;
+  case ENGINE_COMPACT:
+    return horizon == 1 && states <= COMPACT_MAX_STATES;
+  default:
+    return 1;
+  }
+}
+
+engine_t* engine_new(uint64_t grule_size, uint8_t rule[grule_size],
+                     struct Options2D* opts)
+{
+  enum EngineType type = opts->engine;
+
+  if (opts->family == FAMILY_SPARSE) {
+    return sparse_engine_new(rule, opts, engine_pool_new(opts));
+  }
+  if (opts->family != FAMILY_TABLE) {
+    return totalistic_engine_new(rule, opts, engine_pool_new(opts));
+  }
+
+  if (opts->neighborhood.shape != SHAPE_MOORE && type != ENGINE_GENERAL) {
+    /* The other kernels read the whole square */
+    type = ENGINE_MASKED;
+  }
+
+  if (type == ENGINE_AUTO) {
+    if (engine_supported(ENGINE_BITSLICE, opts->states, opts->horizon,
+                         opts->size)) {
+      type = ENGINE_BITSLICE;
+    }
+    else if (opts->init_type >= 0) {
+      /* Most of the grid stays in the background with a small random
+         initialization zone */
+      type = ENGINE_ACTIVE;
+    }
+    else if (opts->horizon == 1 && opts->states >= COMPACT_MIN_STATES
+             && opts->states <= COMPACT_MAX_STATES) {
+      /* The table spills out of the L2 cache, shrinking it pays off */
+      type = ENGINE_COMPACT;
+    }
+    else if (gather_kernel_lanes() >= 16) {
+      /* AVX-512 gathers outrun the compile time specialization */
+      type = ENGINE_GATHER;
+    }
+    else if (specialized_kernel(opts->states, opts->horizon)) {
+      /* Faster than packed3 for 3 states, which only saves memory */
+      type = ENGINE_SPECIALIZED;
+    }
+    else {
+      type = ENGINE_GATHER;
+    }
+  }
+
+  switch (type) {
+  case ENGINE_BITSLICE:
+    return bitslice_engine_new(opts->size, rule, engine_pool_new(opts));
+  case ENGINE_PACKED3:
+    return packed3_engine_new(opts->size, rule, engine_pool_new(opts));
+  case ENGINE_HASHLIFE:
+    return hashlife_engine_new(opts->size, opts->states, rule);
+  case ENGINE_ACTIVE:
+    return active_engine_new(rule, opts, engine_pool_new(opts));
+  case ENGINE_PLANE:
+    return plane_engine_new(rule, opts);
+  case ENGINE_SPECIALIZED:
+    /* The sliding kernel is the generic fallback */
+    if (specialized_kernel(opts->states, opts->horizon)) {
+      return dense_engine_new(rule, opts, "specialized",
+                              specialized_kernel(opts->states, opts->horizon));
+    }
+    return dense_engine_new(rule, opts, "sliding", update_step_sliding);
+  case ENGINE_SLIDING:
+    return dense_engine_new(rule, opts, "sliding", update_step_sliding);
+  case ENGINE_GATHER:
+    return gather_engine_new(grule_size, rule, opts);
+  case ENGINE_CIRCUIT:
+  case ENGINE_COMPILED: {
+    engine_t* engine = circuit_engine_new(rule, opts, engine_pool_new(opts),
+                                          type == ENGINE_COMPILED);
+    if (engine) {
+      return engine;
+    }
+    fprintf(stderr, "The circuit of the rule is too large, using the gather"
+            " engine\n");
+    return gather_engine_new(grule_size, rule, opts);
+  }
+  case ENGINE_COMPACT:
+    return compact_engine_new(rule, opts);
+  case ENGINE_MASKED:
+    return masked_engine_new(grule_size, rule, opts);
+  default:
+    return dense_engine_new(rule, opts, "general", update_step_general);
+  }
+}
+
+void engine_free(engine_t* engine)
+{
+  engine->free(engine);
+  free(engine);
+}
@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include "automaton/2d_automaton.h"
+#include "automaton/stats.h"
+#include "utils/pool.h"
+
+#ifndef ENGINE_H /* Include guard */
+#define ENGINE_H
+
+/**
+ * @brief A stepping engine.
+ *
+ * An engine owns the representation of the automaton between two
+ * measurements. It is free to store the grid in any layout (bit-packed,
+ * padded, ...): the flat one byte per cell frame used by the metrics is only
+ * exchanged through `load` and `store`.
+ */
+typedef struct engine_s
+{
+  const char* name;
+  void* data; /**< Engine specific state */
+  /** Replace the engine state with the flat `size * size` frame */
+  void (*load)(struct engine_s*, uint8_t* frame);
+  /** Advance the automaton by n generations */
+  void (*step)(struct engine_s*, long n);
+  /** Write the current state to the flat `size * size` frame */
+  void (*store)(struct engine_s*, uint8_t* frame);
+  /** Fraction of the grid recomputed per generation by the last call to
+      step, NULL for engines that always recompute everything */
+  double (*activity)(struct engine_s*);
+  void (*free)(struct engine_s*);
+  /** Set by the caller to get the statistics of the generation reached by
+      each call to step, which the engines fusing them into their sweep fill
+      with `fused` set. NULL when not needed. */
+  step_stats_t* stats;
+  /** Hash of the whole state of the automaton, for the engines whose stored
+      frame only holds part of it. NULL when the frame holds it all. */
+  uint64_t (*state_hash)(struct engine_s*);
+} engine_t;
+
+/**
+ * Update the rows [row_begin, row_end) of the grid `out` from the grid `in`.
+ * `worker` is the index of the calling worker, for per thread scratch space.
+ */
+typedef void (*BandF)(void* data, void* in, void* out,
+                      size_t row_begin, size_t row_end, int worker);
+
+/**
+ * @brief Run n steps of a double buffered engine.
+ *
+ * The rows are split in bands updated in parallel by the workers of the pool
+ * with a barrier after every step (serially when pool is NULL). The grid
+ * pointers are swapped after every step.
+ */
+void engine_run_bands(pool_t* pool, BandF band, void* data, size_t rows,
+                      void** grid, void** next, long n);
+
+/**
+ * Run one step of an engine on padded frames (see automaton/kernels.h) like
+ * engine_run_bands, accumulating the statistics of the new generation a few
+ * rows at a time right after `band` updated them, while they are in cache.
+ */
+void engine_run_stats(pool_t* pool, BandF band, void* data, size_t size,
+                      int horizon, int states, void** grid, void** next,
+                      step_stats_t* stats);
+
+/**
+ * Allocate a buffer of `rows` rows whose pages are first touched by the
+ * worker that will update them, so they are placed on its NUMA node.
+ */
+void* engine_alloc_rows(pool_t* pool, size_t rows, size_t row_bytes);
+
+/** Worker pool for the engine, NULL for a single thread */
+pool_t* engine_pool_new(struct Options2D*);
+
+/**
+ * @brief Create the stepping engine matching the options and the rule.
+ *
+ * With ENGINE_AUTO the bitsliced engine is picked for the rules it supports,
+ * then the active tiles engine when only a small zone is randomly
+ * initialized, then the compact table engine for horizon 1 rules of 5 states
+ * or more, then the lookup table engine with the AVX-512 gather kernel,
+ * or else a kernel specialized for the rule shape, the gather kernel being
+ * the fallback. The hashlife engine is never picked automatically since it
+ * only pays off on repetitive patterns, nor the plane engine which changes
+ * the topology. Rules of the other families always run on the engine of
+ * automaton/totalistic.h or automaton/sparse.h, and neighborhoods other
+ * than the full square on update_step_masked unless ENGINE_GENERAL is
+ * asked for.
+ */
+engine_t* engine_new(uint64_t grule_size, uint8_t rule[grule_size],
+                     struct Options2D*);
+
+/**
+ * Check that an engine can run rules with the given states/horizon on a
+ * grid of the given size
+ */
+int engine_supported(enum EngineType, int states, int horizon, size_t size);
+
+void engine_free(engine_t*);
+
+#endif // ENGINE_H
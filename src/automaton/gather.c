@@ -0,0 +1,402 @@
+#include <string.h>
+#include "automaton/gather.h"
+#include "automaton/kernels.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86 1
+#endif
+
+/** Scalar packed lookups of [x, n) */
+static inline __attribute__((always_inline))
+void lookup_packed_tail(uint8_t* table, int bits, uint32_t* index, size_t x,
+                        size_t n, uint8_t* out)
+{
+  uint32_t mask = (1 << bits) - 1;
+  for (; x < n; ++x) {
+    uint32_t bit = index[x] * bits;
+    uint32_t word;
+    memcpy(&word, &table[bit / 8], sizeof(word));
+    out[x] = (word >> (bit % 8)) & mask;
+  }
+}
+
+#if X86
+
+/** Scalar column codes of the columns [c, pitch), see update_step_sliding */
+static inline __attribute__((always_inline))
+void codes_tail(uint8_t* rows, size_t pitch, int side, uint32_t* pows,
+                size_t c, uint32_t* codes)
+{
+  for (; c < pitch; ++c) {
+    uint32_t code = 0;
+    for (int k = 0; k < side; ++k) {
+      code += rows[k * pitch + c] * pows[k * side];
+    }
+    codes[c] = code;
+  }
+}
+
+/** Scalar lookups of the cells [j, size) */
+static inline __attribute__((always_inline))
+void lookup_tail(uint32_t* codes, size_t size, int side, uint32_t* pows,
+                 uint8_t* rule, size_t j, uint8_t* out)
+{
+  for (; j < size; ++j) {
+    uint32_t position = 0;
+    for (int l = 0; l < side; ++l) {
+      position += codes[j + l] * pows[l];
+    }
+    out[j] = rule[position];
+  }
+}
+
+__attribute__((target("sse4.2")))
+static void update_step_sse42(size_t size, uint8_t* autom, uint8_t* rule,
+                              uint8_t* last_autom, int horizon,
+                              uint32_t* pows, size_t row_begin,
+                              size_t row_end)
+{
+  size_t pitch = size + 2 * horizon;
+  int side = 2 * horizon + 1;
+  uint32_t codes[pitch];
+  uint32_t index[4];
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* rows = &last_autom[i * pitch];
+    uint8_t* out = &autom[(i + horizon) * pitch + horizon];
+    size_t c = 0, j = 0;
+
+    for (; c + 4 <= pitch; c += 4) {
+      __m128i code = _mm_setzero_si128();
+      for (int k = 0; k < side; ++k) {
+        int32_t cells;
+        memcpy(&cells, &rows[k * pitch + c], sizeof(int32_t));
+        __m128i v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(cells));
+        code = _mm_add_epi32(code, _mm_mullo_epi32(
+                               v, _mm_set1_epi32(pows[k * side])));
+      }
+      _mm_storeu_si128((__m128i*) &codes[c], code);
+    }
+    codes_tail(rows, pitch, side, pows, c, codes);
+
+    /* No gather instruction before AVX2, the lookups stay scalar */
+    for (; j + 4 <= size; j += 4) {
+      __m128i position = _mm_setzero_si128();
+      for (int l = 0; l < side; ++l) {
+        __m128i v = _mm_loadu_si128((__m128i*) &codes[j + l]);
+        position = _mm_add_epi32(position, _mm_mullo_epi32(
+                                   v, _mm_set1_epi32(pows[l])));
+      }
+      _mm_storeu_si128((__m128i*) index, position);
+      for (int k = 0; k < 4; ++k) {
+        out[j + k] = rule[index[k]];
+      }
+    }
+    lookup_tail(codes, size, side, pows, rule, j, out);
+  }
+
+  refresh_halo_rows(size, autom, horizon, row_begin, row_end);
+}
+
+__attribute__((target("avx2")))
+static void update_step_avx2(size_t size, uint8_t* autom, uint8_t* rule,
+                             uint8_t* last_autom, int horizon,
+                             uint32_t* pows, size_t row_begin,
+                             size_t row_end)
+{
+  size_t pitch = size + 2 * horizon;
+  int side = 2 * horizon + 1;
+  uint32_t codes[pitch];
+
+  /* Low byte of each 32 bit lane, then the two 128 bit lanes together */
+  const __m256i low_bytes = _mm256_setr_epi8(
+    0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m256i join = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* rows = &last_autom[i * pitch];
+    uint8_t* out = &autom[(i + horizon) * pitch + horizon];
+    size_t c = 0, j = 0;
+
+    for (; c + 8 <= pitch; c += 8) {
+      __m256i code = _mm256_setzero_si256();
+      for (int k = 0; k < side; ++k) {
+        __m256i v = _mm256_cvtepu8_epi32(
+          _mm_loadl_epi64((__m128i*) &rows[k * pitch + c]));
+        code = _mm256_add_epi32(code, _mm256_mullo_epi32(
+                                  v, _mm256_set1_epi32(pows[k * side])));
+      }
+      _mm256_storeu_si256((__m256i*) &codes[c], code);
+    }
+    codes_tail(rows, pitch, side, pows, c, codes);
+
+    for (; j + 8 <= size; j += 8) {
+      __m256i position = _mm256_setzero_si256();
+      for (int l = 0; l < side; ++l) {
+        __m256i v = _mm256_loadu_si256((__m256i*) &codes[j + l]);
+        position = _mm256_add_epi32(position, _mm256_mullo_epi32(
+                                      v, _mm256_set1_epi32(pows[l])));
+      }
+      __m256i next = _mm256_i32gather_epi32((const int*) rule, position, 1);
+      next = _mm256_permutevar8x32_epi32(
+        _mm256_shuffle_epi8(next, low_bytes), join);
+      _mm_storel_epi64((__m128i*) &out[j], _mm256_castsi256_si128(next));
+    }
+    lookup_tail(codes, size, side, pows, rule, j, out);
+  }
+
+  refresh_halo_rows(size, autom, horizon, row_begin, row_end);
+}
+
+__attribute__((target("avx512f")))
+static void update_step_avx512(size_t size, uint8_t* autom, uint8_t* rule,
+                               uint8_t* last_autom, int horizon,
+                               uint32_t* pows, size_t row_begin,
+                               size_t row_end)
+{
+  size_t pitch = size + 2 * horizon;
+  int side = 2 * horizon + 1;
+  uint32_t codes[pitch];
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* rows = &last_autom[i * pitch];
+    uint8_t* out = &autom[(i + horizon) * pitch + horizon];
+    size_t c = 0, j = 0;
+
+    for (; c + 16 <= pitch; c += 16) {
+      __m512i code = _mm512_setzero_si512();
+      for (int k = 0; k < side; ++k) {
+        __m512i v = _mm512_cvtepu8_epi32(
+          _mm_loadu_si128((__m128i*) &rows[k * pitch + c]));
+        code = _mm512_add_epi32(code, _mm512_mullo_epi32(
+                                  v, _mm512_set1_epi32(pows[k * side])));
+      }
+      _mm512_storeu_si512(&codes[c], code);
+    }
+    codes_tail(rows, pitch, side, pows, c, codes);
+
+    for (; j + 16 <= size; j += 16) {
+      __m512i position = _mm512_setzero_si512();
+      for (int l = 0; l < side; ++l) {
+        __m512i v = _mm512_loadu_si512(&codes[j + l]);
+        position = _mm512_add_epi32(position, _mm512_mullo_epi32(
+                                      v, _mm512_set1_epi32(pows[l])));
+      }
+      __m512i next = _mm512_i32gather_epi32(position, rule, 1);
+      _mm_storeu_si128((__m128i*) &out[j], _mm512_cvtepi32_epi8(next));
+    }
+    lookup_tail(codes, size, side, pows, rule, j, out);
+  }
+
+  refresh_halo_rows(size, autom, horizon, row_begin, row_end);
+}
+
+/** Scalar lookups of [x, n) */
+static inline __attribute__((always_inline))
+void lookup_flat_tail(uint8_t* rule, uint32_t* index, size_t x, size_t n,
+                      uint8_t* out)
+{
+  for (; x < n; ++x) {
+    out[x] = rule[index[x]];
+  }
+}
+
+__attribute__((target("avx2")))
+static void lookup_avx2(uint8_t* rule, uint32_t* index, size_t n,
+                        uint8_t* out)
+{
+  const __m256i low_bytes = _mm256_setr_epi8(
+    0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m256i join = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+  size_t x = 0;
+
+  for (; x + 8 <= n; x += 8) {
+    __m256i position = _mm256_loadu_si256((__m256i*) &index[x]);
+    __m256i next = _mm256_i32gather_epi32((const int*) rule, position, 1);
+    next = _mm256_permutevar8x32_epi32(
+      _mm256_shuffle_epi8(next, low_bytes), join);
+    _mm_storel_epi64((__m128i*) &out[x], _mm256_castsi256_si128(next));
+  }
+  lookup_flat_tail(rule, index, x, n, out);
+}
+
+__attribute__((target("avx512f")))
+static void lookup_avx512(uint8_t* rule, uint32_t* index, size_t n,
+                          uint8_t* out)
+{
+  size_t x = 0;
+
+  for (; x + 16 <= n; x += 16) {
+    __m512i position = _mm512_loadu_si512(&index[x]);
+    __m512i next = _mm512_i32gather_epi32(position, rule, 1);
+    _mm_storeu_si128((__m128i*) &out[x], _mm512_cvtepi32_epi8(next));
+  }
+  lookup_flat_tail(rule, index, x, n, out);
+}
+
+/**
+ * Shift the 32 bits read at the byte of each packed entry down to the entry,
+ * see gather_lookup_packed
+ */
+__attribute__((target("avx2")))
+static void lookup_packed_avx2(uint8_t* table, int bits, uint32_t* index,
+                               size_t n, uint8_t* out)
+{
+  const __m256i low_bytes = _mm256_setr_epi8(
+    0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m256i join = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+  const __m256i mask = _mm256_set1_epi32((1 << bits) - 1);
+  const __m256i seven = _mm256_set1_epi32(7);
+  size_t x = 0;
+
+  for (; x + 8 <= n; x += 8) {
+    __m256i bit = _mm256_mullo_epi32(
+      _mm256_loadu_si256((__m256i*) &index[x]), _mm256_set1_epi32(bits));
+    __m256i word = _mm256_i32gather_epi32(
+      (const int*) table, _mm256_srli_epi32(bit, 3), 1);
+    __m256i next = _mm256_and_si256(
+      _mm256_srlv_epi32(word, _mm256_and_si256(bit, seven)), mask);
+    next = _mm256_permutevar8x32_epi32(
+      _mm256_shuffle_epi8(next, low_bytes), join);
+    _mm_storel_epi64((__m128i*) &out[x], _mm256_castsi256_si128(next));
+  }
+  lookup_packed_tail(table, bits, index, x, n, out);
+}
+
+__attribute__((target("avx512f")))
+static void lookup_packed_avx512(uint8_t* table, int bits, uint32_t* index,
+                                 size_t n, uint8_t* out)
+{
+  const __m512i mask = _mm512_set1_epi32((1 << bits) - 1);
+  const __m512i seven = _mm512_set1_epi32(7);
+  size_t x = 0;
+
+  for (; x + 16 <= n; x += 16) {
+    __m512i bit = _mm512_mullo_epi32(_mm512_loadu_si512(&index[x]),
+                                     _mm512_set1_epi32(bits));
+    __m512i word = _mm512_i32gather_epi32(_mm512_srli_epi32(bit, 3),
+                                          table, 1);
+    __m512i next = _mm512_and_si512(
+      _mm512_srlv_epi32(word, _mm512_and_si512(bit, seven)), mask);
+    _mm_storeu_si128((__m128i*) &out[x], _mm512_cvtepi32_epi8(next));
+  }
+  lookup_packed_tail(table, bits, index, x, n, out);
+}
+
+#endif // X86
+
+static void lookup_packed_scalar(uint8_t* table, int bits, uint32_t* index,
+                                 size_t n, uint8_t* out)
+{
+  lookup_packed_tail(table, bits, index, 0, n, out);
+}
+
+static void lookup_scalar(uint8_t* rule, uint32_t* index, size_t n,
+                          uint8_t* out)
+{
+  for (size_t x = 0; x < n; ++x) {
+    out[x] = rule[index[x]];
+  }
+}
+
+typedef void (*LookupF)(uint8_t* rule, uint32_t* index, size_t n,
+                        uint8_t* out);
+typedef void (*LookupPackedF)(uint8_t* table, int bits, uint32_t* index,
+                              size_t n, uint8_t* out);
+
+typedef struct gather_variant_s
+{
+  const char* name;
+  ProcessF function;
+  LookupF lookup;
+  LookupPackedF lookup_packed;
+  int lanes;
+} gather_variant_t;
+
+static gather_variant_t pick_variant(void)
+{
+#if X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return (gather_variant_t) {"avx512", update_step_avx512,
+                                lookup_avx512, lookup_packed_avx512, 16};
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return (gather_variant_t) {"avx2", update_step_avx2,
+                                lookup_avx2, lookup_packed_avx2, 8};
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return (gather_variant_t) {"sse4.2", update_step_sse42,
+                                lookup_scalar, lookup_packed_scalar, 4};
+  }
+#endif
+  return (gather_variant_t) {"sliding", update_step_sliding,
+                              lookup_scalar, lookup_packed_scalar, 1};
+}
+
+ProcessF gather_kernel(void)
+{
+  return pick_variant().function;
+}
+
+const char* gather_kernel_name(void)
+{
+  return pick_variant().name;
+}
+
+int gather_kernel_lanes(void)
+{
+  return pick_variant().lanes;
+}
+
+void gather_lookup(uint8_t* rule, uint32_t* index, size_t n, uint8_t* out)
+{
+  pick_variant().lookup(rule, index, n, out);
+}
+
+void gather_lookup_packed(uint8_t* table, int bits, uint32_t* index, size_t n,
+                          uint8_t* out)
+{
+  pick_variant().lookup_packed(table, bits, index, n, out);
+}
+
+void update_step_masked(size_t size, uint8_t* autom, uint8_t* rule,
+                        uint8_t* last_autom, int horizon, uint32_t* pows,
+                        size_t row_begin, size_t row_end)
+{
+  size_t pitch = size + 2 * horizon;
+  int side = 2 * horizon + 1;
+  size_t offsets[side * side];
+  uint32_t weights[side * side];
+  uint32_t index[size];
+  int cells = 0;
+
+  /* Cells of the neighborhood, as offsets from the top left of the window */
+  for (int p = 0; p < side * side; ++p) {
+    if (pows[p] != 0) {
+      offsets[cells] = (p / side) * pitch + p % side;
+      weights[cells++] = pows[p];
+    }
+  }
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* window = &last_autom[i * pitch];
+
+    for (size_t j = 0; j < size; ++j) {
+      index[j] = window[offsets[0] + j] * weights[0];
+    }
+    for (int p = 1; p < cells; ++p) {
+      uint8_t* cell = &window[offsets[p]];
+      uint32_t weight = weights[p];
+      for (size_t j = 0; j < size; ++j) {
+        index[j] += cell[j] * weight;
+      }
+    }
+    gather_lookup(rule, index, size, &autom[(i + horizon) * pitch + horizon]);
+  }
+
+  refresh_halo_rows(size, autom, horizon, row_begin, row_end);
+}
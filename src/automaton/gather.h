@@ -0,0 +1,56 @@
+#include <stdint.h>
+#include "automaton/2d_automaton.h"
+
+#ifndef GATHER_H /* Include guard */
+#define GATHER_H
+
+/** Bytes that vectorized kernels may read past the end of the rule table */
+#define RULE_PADDING 3
+
+/**
+ * @brief Vectorized lookup table kernel for the running CPU.
+ *
+ * The neighborhood indices of 4 (SSE4.2), 8 (AVX2) or 16 (AVX-512) cells are
+ * computed per instruction, and fetched from the rule table with hardware
+ * gathers (AVX2 and AVX-512). The variant is picked with CPUID at runtime,
+ * so a binary built for a portable baseline still uses the widest vectors
+ * of the node it runs on. Falls back to update_step_sliding.
+ *
+ * The gathers load 4 bytes per cell, so the rule table passed to the kernel
+ * must be readable RULE_PADDING bytes past its end.
+ */
+ProcessF gather_kernel(void);
+
+/** Name of the variant returned by gather_kernel */
+const char* gather_kernel_name(void);
+
+/**
+ * out[x] = rule[index[x]] for x in [0, n), with hardware gathers when
+ * available. The rule must be padded as for gather_kernel.
+ */
+void gather_lookup(uint8_t* rule, uint32_t* index, size_t n, uint8_t* out);
+
+/**
+ * Same as gather_lookup for a table whose entry x is stored on `bits` bits
+ * (at most 8) starting at bit x * bits, least significant first. The table
+ * must be padded as for gather_kernel.
+ */
+void gather_lookup_packed(uint8_t* table, int bits, uint32_t* index,
+                          size_t n, uint8_t* out);
+
+/**
+ * @brief Update step for the neighborhoods other than the full square.
+ *
+ * Same signature and result as update_step_general, whose cells of weight 0
+ * in pows (see neighborhood_pows) are skipped. The indices of a row are
+ * accumulated one cell of the neighborhood at a time and looked up with
+ * gather_lookup, so the rule must be padded as for gather_kernel.
+ */
+void update_step_masked(size_t size, uint8_t* autom, uint8_t* rule,
+                        uint8_t* last_autom, int horizon, uint32_t* pows,
+                        size_t row_begin, size_t row_end);
+
+/** Cells updated per instruction by the variant, 1 for the fallback */
+int gather_kernel_lanes(void);
+
+#endif // GATHER_H
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "automaton/hashlife.h"
+#include "utils/utils.h"
+
+#define NEIGHBORS 9
+#define MAX_NODES (1 << 22) /* Nodes kept before unreachable ones are freed */
+
+/**
+ * Node of the quadtree. Nodes of level 0 are the cells, whose id is their
+ * state, and a node of level k covers 2^k x 2^k cells with its children in
+ * the order north-west, north-east, south-west, south-east.
+ */
+typedef struct hl_node_s
+{
+  int32_t child[4];
+  int32_t level;
+} hl_node_t;
+
+/** Memoized future of a node after 2^step generations */
+typedef struct hl_memo_s
+{
+  int32_t node;
+  int32_t step;
+  int32_t result;
+} hl_memo_t;
+
+typedef struct hashlife_s
+{
+  size_t size;
+  int states;
+  int depth; /**< Level of the node covering the torus */
+  uint8_t* rule;
+  uint32_t pows[NEIGHBORS];
+  hl_node_t* nodes;
+  size_t n_nodes;
+  size_t cap_nodes;
+  size_t max_nodes; /**< Number of nodes above which a collection runs */
+  int32_t* unique; /**< Hash-consing table of the nodes, -1 when empty */
+  size_t unique_size;
+  hl_memo_t* memo; /**< Results of next, node -1 when empty */
+  size_t memo_size;
+  size_t n_memo;
+  int32_t root;
+} hashlife_t;
+
+static size_t hash_children(int32_t a, int32_t b, int32_t c, int32_t d)
+{
+  uint64_t h = (uint64_t) a * 0x9E3779B97F4A7C15ULL;
+  h = (h ^ (uint32_t) b) * 0xBF58476D1CE4E5B9ULL;
+  h = (h ^ (uint32_t) c) * 0x94D049BB133111EBULL;
+  h = (h ^ (uint32_t) d) * 0x9E3779B97F4A7C15ULL;
+  return (size_t) (h ^ (h >> 29));
+}
+
+static size_t hash_memo(int32_t node, int32_t step)
+{
+  uint64_t h = ((uint64_t) node << 6 | (uint32_t) step)
+    * 0x9E3779B97F4A7C15ULL;
+  return (size_t) (h ^ (h >> 31));
+}
+
+static void unique_insert(hashlife_t* hl, int32_t id)
+{
+  int32_t* c = hl->nodes[id].child;
+  size_t mask = hl->unique_size - 1;
+  size_t h = hash_children(c[0], c[1], c[2], c[3]) & mask;
+  while (hl->unique[h] != -1) {
+    h = (h + 1) & mask;
+  }
+  hl->unique[h] = id;
+}
+
+static void unique_resize(hashlife_t* hl, size_t unique_size)
+{
+  free(hl->unique);
+  hl->unique_size = unique_size;
+  hl->unique = (int32_t*) malloc(unique_size * sizeof(int32_t));
+  memset(hl->unique, -1, unique_size * sizeof(int32_t));
+  for (size_t id = hl->states; id < hl->n_nodes; ++id) {
+    unique_insert(hl, id);
+  }
+}
+
+static void memo_resize(hashlife_t* hl, size_t memo_size)
+{
+  hl_memo_t* old = hl->memo;
+  size_t old_size = hl->memo_size;
+
+  hl->memo_size = memo_size;
+  hl->memo = (hl_memo_t*) malloc(memo_size * sizeof(hl_memo_t));
+  for (size_t h = 0; h < memo_size; ++h) {
+    hl->memo[h].node = -1;
+  }
+  for (size_t k = 0; k < old_size; ++k) {
+    if (old[k].node != -1) {
+      size_t h = hash_memo(old[k].node, old[k].step) & (memo_size - 1);
+      while (hl->memo[h].node != -1) {
+        h = (h + 1) & (memo_size - 1);
+      }
+      hl->memo[h] = old[k];
+    }
+  }
+  free(old);
+}
+
+static int32_t push_node(hashlife_t* hl, int32_t a, int32_t b, int32_t c,
+                         int32_t d)
+{
+  if (hl->n_nodes == hl->cap_nodes) {
+    hl->cap_nodes *= 2;
+    hl->nodes = (hl_node_t*)
+      realloc(hl->nodes, hl->cap_nodes * sizeof(hl_node_t));
+  }
+  int32_t id = hl->n_nodes++;
+  hl_node_t* node = &hl->nodes[id];
+  node->child[0] = a;
+  node->child[1] = b;
+  node->child[2] = c;
+  node->child[3] = d;
+  node->level = hl->nodes[a].level + 1;
+  return id;
+}
+
+/** Get the unique node with the given children */
+static int32_t make_node(hashlife_t* hl, int32_t a, int32_t b, int32_t c,
+                         int32_t d)
+{
+  size_t mask = hl->unique_size - 1;
+  size_t h = hash_children(a, b, c, d) & mask;
+
+  while (hl->unique[h] != -1) {
+    int32_t* child = hl->nodes[hl->unique[h]].child;
+    if (child[0] == a && child[1] == b && child[2] == c && child[3] == d) {
+      return hl->unique[h];
+    }
+    h = (h + 1) & mask;
+  }
+
+  int32_t id = push_node(hl, a, b, c, d);
+  hl->unique[h] = id;
+  if (2 * hl->n_nodes > hl->unique_size) {
+    unique_resize(hl, 2 * hl->unique_size);
+  }
+  return id;
+}
+
+/** Node of level k - 1 at the center of a node of level k */
+static int32_t center(hashlife_t* hl, int32_t id)
+{
+  hl_node_t n = hl->nodes[id];
+  return make_node(hl, hl->nodes[n.child[0]].child[3],
+                   hl->nodes[n.child[1]].child[2],
+                   hl->nodes[n.child[2]].child[1],
+                   hl->nodes[n.child[3]].child[0]);
+}
+
+/** Node straddling the border of two horizontally adjacent nodes */
+static int32_t horizontal(hashlife_t* hl, int32_t west, int32_t east)
+{
+  hl_node_t w = hl->nodes[west];
+  hl_node_t e = hl->nodes[east];
+  return make_node(hl, w.child[1], e.child[0], w.child[3], e.child[2]);
+}
+
+/** Node straddling the border of two vertically adjacent nodes */
+static int32_t vertical(hashlife_t* hl, int32_t north, int32_t south)
+{
+  hl_node_t n = hl->nodes[north];
+  hl_node_t s = hl->nodes[south];
+  return make_node(hl, n.child[2], n.child[3], s.child[0], s.child[1]);
+}
+
+/** Center 2x2 cells of a 4x4 node after one generation */
+static int32_t next_base(hashlife_t* hl, int32_t id)
+{
+  uint8_t cells[4][4];
+  int32_t out[4];
+
+  for (int r = 0; r < 4; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      int32_t quad = hl->nodes[id].child[(r / 2) * 2 + c / 2];
+      cells[r][c] = hl->nodes[quad].child[(r % 2) * 2 + c % 2];
+    }
+  }
+
+  for (int r = 1; r < 3; ++r) {
+    for (int c = 1; c < 3; ++c) {
+      uint32_t position = 0;
+      int inc = 0;
+      for (int k = -1; k <= 1; ++k) {
+        for (int l = -1; l <= 1; ++l) {
+          position += cells[r + k][c + l] * hl->pows[inc];
+          ++inc;
+        }
+      }
+      out[(r - 1) * 2 + c - 1] = hl->rule[position];
+    }
+  }
+  return make_node(hl, out[0], out[1], out[2], out[3]);
+}
+
+/**
+ * Center node of level k - 1 of the node `id` of level k after 2^step
+ * generations, with step <= k - 2.
+ */
+static int32_t next(hashlife_t* hl, int32_t id, int step)
+{
+  int level = hl->nodes[id].level;
+  if (level == 2) {
+    return next_base(hl, id);
+  }
+
+  size_t mask = hl->memo_size - 1;
+  size_t h = hash_memo(id, step) & mask;
+  while (hl->memo[h].node != -1) {
+    if (hl->memo[h].node == id && hl->memo[h].step == step) {
+      return hl->memo[h].result;
+    }
+    h = (h + 1) & mask;
+  }
+
+  /* Nine overlapping nodes of level k - 1 covering the node */
+  hl_node_t n = hl->nodes[id];
+  int32_t sub[9] = {
+    n.child[0], horizontal(hl, n.child[0], n.child[1]), n.child[1],
+    vertical(hl, n.child[0], n.child[2]), center(hl, id),
+    vertical(hl, n.child[1], n.child[3]),
+    n.child[2], horizontal(hl, n.child[2], n.child[3]), n.child[3]
+  };
+
+  /* At full speed both halves advance 2^(k - 3) generations, otherwise only
+     the second one advances */
+  int full = (step == level - 2);
+  for (int k = 0; k < 9; ++k) {
+    sub[k] = full ? next(hl, sub[k], step - 1): center(hl, sub[k]);
+  }
+
+  int32_t quads[4] = {
+    make_node(hl, sub[0], sub[1], sub[3], sub[4]),
+    make_node(hl, sub[1], sub[2], sub[4], sub[5]),
+    make_node(hl, sub[3], sub[4], sub[6], sub[7]),
+    make_node(hl, sub[4], sub[5], sub[7], sub[8])
+  };
+  for (int k = 0; k < 4; ++k) {
+    quads[k] = next(hl, quads[k], full ? step - 1: step);
+  }
+  int32_t result = make_node(hl, quads[0], quads[1], quads[2], quads[3]);
+
+  /* The table may have grown during the recursion */
+  if (2 * (hl->n_memo + 1) > hl->memo_size) {
+    memo_resize(hl, 2 * hl->memo_size);
+  }
+  mask = hl->memo_size - 1;
+  h = hash_memo(id, step) & mask;
+  while (hl->memo[h].node != -1) {
+    h = (h + 1) & mask;
+  }
+  hl->memo[h].node = id;
+  hl->memo[h].step = step;
+  hl->memo[h].result = result;
+  ++hl->n_memo;
+  return result;
+}
+
+static int32_t copy_node(hashlife_t* hl, hl_node_t* old, int32_t* remap,
+                         int32_t id)
+{
+  if (remap[id] == -1) {
+    int32_t c[4];
+    for (int k = 0; k < 4; ++k) {
+      c[k] = copy_node(hl, old, remap, old[id].child[k]);
+    }
+    remap[id] = push_node(hl, c[0], c[1], c[2], c[3]);
+  }
+  return remap[id];
+}
+
+/** Free the nodes that are not reachable from the root and the memo table */
+static void collect(hashlife_t* hl)
+{
+  hl_node_t* old = hl->nodes;
+  size_t n_old = hl->n_nodes;
+  int32_t* remap = (int32_t*) malloc(n_old * sizeof(int32_t));
+
+  memset(remap, -1, n_old * sizeof(int32_t));
+  for (int s = 0; s < hl->states; ++s) {
+    remap[s] = s;
+  }
+  hl->nodes = (hl_node_t*) malloc(hl->cap_nodes * sizeof(hl_node_t));
+  memcpy(hl->nodes, old, hl->states * sizeof(hl_node_t));
+  hl->n_nodes = hl->states;
+  hl->root = copy_node(hl, old, remap, hl->root);
+  unique_resize(hl, hl->unique_size);
+
+  for (size_t h = 0; h < hl->memo_size; ++h) {
+    hl->memo[h].node = -1;
+  }
+  hl->n_memo = 0;
+
+  /* Grow if most of the nodes are still in use */
+  if (2 * hl->n_nodes > hl->max_nodes) {
+    hl->max_nodes *= 2;
+  }
+  free(remap);
+  free(old);
+}
+
+static void hashlife_step(engine_t* engine, long n)
+{
+  hashlife_t* hl = (hashlife_t*) engine->data;
+
+  while (n > 0) {
+    /* Largest power of 2 generations that the torus node allows */
+    int step = 0;
+    while (step < hl->depth - 1 && (2L << step) <= n) {
+      ++step;
+    }
+
+    /* The torus is the center of a 2x2 tiling of itself, shifted by half
+       its size, hence the swapped quadrants */
+    int32_t tiling = make_node(hl, hl->root, hl->root, hl->root, hl->root);
+    int32_t result = next(hl, tiling, step);
+    hl_node_t r = hl->nodes[result];
+    hl->root = make_node(hl, r.child[3], r.child[2], r.child[1], r.child[0]);
+    n -= 1L << step;
+
+    if (hl->n_nodes > hl->max_nodes) {
+      collect(hl);
+    }
+  }
+}
+
+static int32_t build(hashlife_t* hl, uint8_t* frame, int level, size_t i,
+                     size_t j)
+{
+  if (level == 0) {
+    return frame[i * hl->size + j];
+  }
+  size_t half = (size_t) 1 << (level - 1);
+  return make_node(hl, build(hl, frame, level - 1, i, j),
+                   build(hl, frame, level - 1, i, j + half),
+                   build(hl, frame, level - 1, i + half, j),
+                   build(hl, frame, level - 1, i + half, j + half));
+}
+
+static void flatten(hashlife_t* hl, uint8_t* frame, int32_t id, size_t i,
+                    size_t j)
+{
+  int level = hl->nodes[id].level;
+  if (level == 0) {
+    frame[i * hl->size + j] = id;
+    return;
+  }
+  size_t half = (size_t) 1 << (level - 1);
+  hl_node_t n = hl->nodes[id];
+  flatten(hl, frame, n.child[0], i, j);
+  flatten(hl, frame, n.child[1], i, j + half);
+  flatten(hl, frame, n.child[2], i + half, j);
+  flatten(hl, frame, n.child[3], i + half, j + half);
+}
+
+static void hashlife_load(engine_t* engine, uint8_t* frame)
+{
+  hashlife_t* hl = (hashlife_t*) engine->data;
+  hl->root = build(hl, frame, hl->depth, 0, 0);
+}
+
+static void hashlife_store(engine_t* engine, uint8_t* frame)
+{
+  hashlife_t* hl = (hashlife_t*) engine->data;
+  flatten(hl, frame, hl->root, 0, 0);
+}
+
+static void hashlife_free(engine_t* engine)
+{
+  hashlife_t* hl = (hashlife_t*) engine->data;
+  free(hl->nodes);
+  free(hl->unique);
+  free(hl->memo);
+  free(hl);
+}
+
+engine_t* hashlife_engine_new(size_t size, int states, uint8_t* rule)
+{
+  hashlife_t* hl = (hashlife_t*) calloc(1, sizeof(hashlife_t));
+  hl->size = size;
+  hl->states = states;
+  hl->rule = rule;
+  while (((size_t) 1 << hl->depth) < size) {
+    ++hl->depth;
+  }
+  for (int i = 0; i < NEIGHBORS; ++i) {
+    hl->pows[i] = ipow(states, i);
+  }
+
+  /* Leaves are the states */
+  hl->cap_nodes = 1024;
+  hl->nodes = (hl_node_t*) malloc(hl->cap_nodes * sizeof(hl_node_t));
+  for (int s = 0; s < states; ++s) {
+    hl->nodes[s].level = 0;
+  }
+  hl->n_nodes = states;
+  hl->max_nodes = MAX_NODES;
+  unique_resize(hl, 1024);
+  memo_resize(hl, 1024);
+
+  engine_t* engine = (engine_t*) malloc(sizeof(engine_t));
+  engine->name = "hashlife";
+  engine->data = hl;
+  engine->load = hashlife_load;
+  engine->step = hashlife_step;
+  engine->store = hashlife_store;
+  engine->activity = NULL;
+  engine->free = hashlife_free;
+  engine->stats = NULL;
+  engine->state_hash = NULL;
+  return engine;
+}
@@ -0,0 +1,18 @@
+#include <stdint.h>
+#include "automaton/engine.h"
+
+#ifndef HASHLIFE_H /* Include guard */
+#define HASHLIFE_H
+
+/**
+ * @brief Create a memoized quadtree engine for horizon 1 rules.
+ *
+ * The torus is stored as a hash-consed quadtree and the future of every
+ * macro-cell is memoized (HashLife), so that repetitive patterns such as
+ * still lifes, oscillators and spaceships are advanced by 2^k generations
+ * in time roughly logarithmic in the number of steps. The size of the grid
+ * must be a power of 2.
+ */
+engine_t* hashlife_engine_new(size_t size, int states, uint8_t* rule);
+
+#endif // HASHLIFE_H
@@ -0,0 +1,119 @@
+#include <string.h>
+#include "automaton/kernels.h"
+
+void refresh_halo_rows(size_t size, uint8_t* frame, int horizon,
+                       size_t row_begin, size_t row_end)
+{
+  size_t pitch = size + 2 * horizon;
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    /* Left and right columns first */
+    uint8_t* row = &frame[(i + horizon) * pitch];
+    memcpy(row, &row[size], horizon);
+    memcpy(&row[size + horizon], &row[horizon], horizon);
+
+    /* Then the full row if it is mirrored by a top or bottom halo row,
+       which also fills the corners */
+    if (i >= size - horizon) {
+      memcpy(&frame[(i + horizon - size) * pitch], row, pitch);
+    }
+    if (i < (size_t) horizon) {
+      memcpy(&frame[(i + horizon + size) * pitch], row, pitch);
+    }
+  }
+}
+
+void refresh_halo(size_t size, uint8_t* frame, int horizon)
+{
+  refresh_halo_rows(size, frame, horizon, 0, size);
+}
+
+void pad_frame(size_t size, int horizon, uint8_t* flat, uint8_t* padded)
+{
+  size_t pitch = size + 2 * horizon;
+  for (size_t i = 0; i < size; ++i) {
+    memcpy(&padded[(i + horizon) * pitch + horizon], &flat[i * size], size);
+  }
+  refresh_halo(size, padded, horizon);
+}
+
+void unpad_frame(size_t size, int horizon, uint8_t* padded, uint8_t* flat)
+{
+  size_t pitch = size + 2 * horizon;
+  for (size_t i = 0; i < size; ++i) {
+    memcpy(&flat[i * size], &padded[(i + horizon) * pitch + horizon], size);
+  }
+}
+
+void update_step_sliding(size_t size, uint8_t* autom, uint8_t* rule,
+                         uint8_t* last_autom, int horizon, uint32_t* pows,
+                         size_t row_begin, size_t row_end)
+{
+  size_t pitch = size + 2 * horizon;
+  int side = 2 * horizon + 1;
+  uint32_t states = pows[1];
+  uint32_t codes[pitch];
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    /* Rows i - horizon to i + horizon of the torus */
+    uint8_t* rows = &last_autom[i * pitch];
+    uint8_t* out = &autom[(i + horizon) * pitch + horizon];
+
+    /* Column codes hold the digits of a column: codes[c] is the code of
+       column c - horizon */
+    for (size_t c = 0; c < pitch; ++c) {
+      uint32_t code = 0;
+      for (int k = 0; k < side; ++k) {
+        code += rows[k * pitch + c] * pows[k * side];
+      }
+      codes[c] = code;
+    }
+
+    /* Horner scheme on the window, rightmost column is most significant */
+    for (size_t j = 0; j < size; ++j) {
+      uint32_t position = codes[j + 2 * horizon];
+      for (int l = 2 * horizon - 1; l >= 0; --l) {
+        position = position * states + codes[j + l];
+      }
+      out[j] = rule[position];
+    }
+  }
+
+  refresh_halo_rows(size, autom, horizon, row_begin, row_end);
+}
+
+int update_tile_sliding(size_t size, uint8_t* autom, uint8_t* rule,
+                        uint8_t* last_autom, int horizon, uint32_t* pows,
+                        size_t row_begin, size_t row_end,
+                        size_t col_begin, size_t col_end)
+{
+  size_t pitch = size + 2 * horizon;
+  size_t width = col_end - col_begin;
+  int side = 2 * horizon + 1;
+  uint32_t states = pows[1];
+  uint32_t codes[width + 2 * horizon];
+  uint8_t changed = 0;
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* rows = &last_autom[i * pitch + col_begin];
+    uint8_t* out = &autom[(i + horizon) * pitch + horizon + col_begin];
+
+    for (size_t c = 0; c < width + 2 * horizon; ++c) {
+      uint32_t code = 0;
+      for (int k = 0; k < side; ++k) {
+        code += rows[k * pitch + c] * pows[k * side];
+      }
+      codes[c] = code;
+    }
+
+    for (size_t j = 0; j < width; ++j) {
+      uint32_t position = codes[j + 2 * horizon];
+      for (int l = 2 * horizon - 1; l >= 0; --l) {
+        position = position * states + codes[j + l];
+      }
+      changed |= out[j] ^ rule[position];
+      out[j] = rule[position];
+    }
+  }
+  return changed != 0;
+}
@@ -0,0 +1,55 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef KERNELS_H /* Include guard */
+#define KERNELS_H
+
+/**
+ * @file
+ * @brief Update step kernels working on padded frames.
+ *
+ * A padded frame of a size x size torus is a (size + 2 horizon)^2 buffer
+ * whose cell (i, j) is stored at (i + horizon) * (size + 2 horizon) + j +
+ * horizon. The ghost cells around it (the halo) mirror the opposite side of
+ * the torus so kernels never wrap coordinates. Kernels keep the halo of the
+ * frame they write up to date.
+ */
+
+/**
+ * Copy the rows [row_begin, row_end) of the torus to the halo cells that
+ * mirror them.
+ */
+void refresh_halo_rows(size_t size, uint8_t* frame, int horizon,
+                       size_t row_begin, size_t row_end);
+
+/** Copy the cells of the torus facing each border into the halo */
+void refresh_halo(size_t size, uint8_t* frame, int horizon);
+
+/** Copy a flat size x size frame to a padded frame and fill its halo */
+void pad_frame(size_t size, int horizon, uint8_t* flat, uint8_t* padded);
+
+/** Copy the inside of a padded frame to a flat size x size frame */
+void unpad_frame(size_t size, int horizon, uint8_t* padded, uint8_t* flat);
+
+/**
+ * @brief Update step computing the rule index from column codes.
+ *
+ * Same signature and result as update_step_general, but the code of each
+ * column of the neighborhood is computed once per row and the index of a
+ * cell is built from the (2 * horizon + 1) codes of its window.
+ */
+void update_step_sliding(size_t size, uint8_t* autom, uint8_t* rule,
+                         uint8_t* last_autom, int horizon, uint32_t* pows,
+                         size_t row_begin, size_t row_end);
+
+/**
+ * Update the cells [row_begin, row_end) x [col_begin, col_end) of a padded
+ * frame like update_step_sliding, without refreshing the halo. Returns
+ * whether any of the cells differs from its previous value in `autom`.
+ */
+int update_tile_sliding(size_t size, uint8_t* autom, uint8_t* rule,
+                        uint8_t* last_autom, int horizon, uint32_t* pows,
+                        size_t row_begin, size_t row_end,
+                        size_t col_begin, size_t col_end);
+
+#endif // KERNELS_H
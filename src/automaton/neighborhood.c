@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "automaton/neighborhood.h"
+
+/** Symmetries as matrices, (dy, dx) -> (a dy + b dx, c dy + d dx) */
+static const int symmetries[SYMMETRIES][4] = {
+  {1, 0, 0, 1}, {0, 1, -1, 0}, {-1, 0, 0, -1}, {0, -1, 1, 0},
+  {1, 0, 0, -1}, {-1, 0, 0, 1}, {0, 1, 1, 0}, {0, -1, -1, 0}
+};
+
+static int in_shape(enum NeighborhoodShape shape, int horizon, int dy, int dx)
+{
+  switch (shape) {
+  case SHAPE_VON_NEUMANN:
+    return abs(dy) + abs(dx) <= horizon;
+  case SHAPE_HEX:
+    return abs(dy - dx) <= horizon;
+  default:
+    return 1;
+  }
+}
+
+/** Fill the offsets from a (2 horizon + 1)^2 map of the cells, row by row */
+static void set_cells(neighborhood_t* nb, int horizon, uint8_t* cells)
+{
+  int side = 2 * horizon + 1;
+
+  nb->horizon = horizon;
+  nb->cells = 0;
+  nb->dy = (int*) malloc(side * side * sizeof(int));
+  nb->dx = (int*) malloc(side * side * sizeof(int));
+  for (int p = 0; p < side * side; ++p) {
+    if (cells[p]) {
+      nb->dy[nb->cells] = p / side - horizon;
+      nb->dx[nb->cells] = p % side - horizon;
+      ++nb->cells;
+    }
+  }
+}
+
+void neighborhood_init(neighborhood_t* nb, enum NeighborhoodShape shape,
+                       int horizon)
+{
+  int side = 2 * horizon + 1;
+  uint8_t* cells = (uint8_t*) malloc(side * side * sizeof(uint8_t));
+
+  for (int p = 0; p < side * side; ++p) {
+    cells[p] = in_shape(shape, horizon, p / side - horizon,
+                        p % side - horizon);
+  }
+  nb->shape = shape;
+  set_cells(nb, horizon, cells);
+  free(cells);
+}
+
+int neighborhood_parse(neighborhood_t* nb, const char* arg, int horizon)
+{
+  if (strcmp("moore", arg) == 0) {
+    neighborhood_init(nb, SHAPE_MOORE, horizon);
+    return 1;
+  }
+  if (strcmp("vonneumann", arg) == 0) {
+    neighborhood_init(nb, SHAPE_VON_NEUMANN, horizon);
+    return 1;
+  }
+  if (strcmp("hex", arg) == 0) {
+    neighborhood_init(nb, SHAPE_HEX, horizon);
+    return 1;
+  }
+
+  /* List of offsets, read twice: for the horizon, then for the cells */
+  int largest = 1;
+  for (int pass = 0; pass < 2; ++pass) {
+    int side = 2 * largest + 1;
+    uint8_t* cells = (pass == 1)
+      ? (uint8_t*) calloc(side * side, sizeof(uint8_t)): NULL;
+    const char* c = arg;
+
+    while (1) {
+      char* end;
+      long dy = strtol(c, &end, 10);
+      if (end == c || *end != ':') {
+        free(cells);
+        return 0;
+      }
+      c = end + 1;
+      long dx = strtol(c, &end, 10);
+      if (end == c || (*end != ',' && *end != '\0')) {
+        free(cells);
+        return 0;
+      }
+      c = end + 1;
+
+      if (pass == 0) {
+        largest = (labs(dy) > largest) ? labs(dy): largest;
+        largest = (labs(dx) > largest) ? labs(dx): largest;
+      }
+      else {
+        cells[(dy + largest) * side + dx + largest] = 1;
+      }
+      if (*end == '\0') {
+        break;
+      }
+    }
+
+    if (pass == 1) {
+      set_cells(nb, largest, cells);
+      free(cells);
+    }
+  }
+  /* A list covering the square is the Moore neighborhood */
+  nb->shape = (nb->cells == (2 * largest + 1) * (2 * largest + 1))
+    ? SHAPE_MOORE: SHAPE_OFFSETS;
+  return 1;
+}
+
+void neighborhood_free(neighborhood_t* nb)
+{
+  free(nb->dy);
+  free(nb->dx);
+  nb->dy = NULL;
+  nb->dx = NULL;
+}
+
+enum NeighborhoodShape neighborhood_window_shape(const neighborhood_t* nb)
+{
+  return (nb->shape == SHAPE_OFFSETS) ? SHAPE_MOORE: nb->shape;
+}
+
+int neighborhood_find(const neighborhood_t* nb, int dy, int dx)
+{
+  for (int p = 0; p < nb->cells; ++p) {
+    if (nb->dy[p] == dy && nb->dx[p] == dx) {
+      return p;
+    }
+  }
+  return -1;
+}
+
+void neighborhood_pows(const neighborhood_t* nb, int states, uint32_t* pows)
+{
+  int side = 2 * nb->horizon + 1;
+  uint32_t weight = 1;
+
+  memset(pows, 0, side * side * sizeof(uint32_t));
+  for (int p = 0; p < nb->cells; ++p) {
+    pows[(nb->dy[p] + nb->horizon) * side + nb->dx[p] + nb->horizon] = weight;
+    weight *= states;
+  }
+}
+
+int neighborhood_symmetries(const neighborhood_t* nb, int* perms)
+{
+  int count = 0;
+
+  for (int t = 0; t < SYMMETRIES; ++t) {
+    const int* m = symmetries[t];
+    int* perm = &perms[count * nb->cells];
+    int p = 0;
+
+    for (; p < nb->cells; ++p) {
+      perm[p] = neighborhood_find(nb, m[0] * nb->dy[p] + m[1] * nb->dx[p],
+                                  m[2] * nb->dy[p] + m[3] * nb->dx[p]);
+      if (perm[p] < 0) {
+        break;
+      }
+    }
+    /* The images are distinct, so covering the cells is mapping them onto
+       themselves */
+    count += p == nb->cells;
+  }
+  return count;
+}
+
+const char* neighborhood_name(const neighborhood_t* nb)
+{
+  switch (nb->shape) {
+  case SHAPE_MOORE:
+    return "moore";
+  case SHAPE_VON_NEUMANN:
+    return "vonneumann";
+  case SHAPE_HEX:
+    return "hex";
+  default:
+    return "offsets";
+  }
+}
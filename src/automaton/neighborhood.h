@@ -0,0 +1,73 @@
+#include <stdint.h>
+
+#ifndef NEIGHBORHOOD_H /* Include guard */
+#define NEIGHBORHOOD_H
+
+/** Symmetries of the square: identity, 3 rotations and 4 flips */
+#define SYMMETRIES 8
+
+enum NeighborhoodShape { SHAPE_MOORE, SHAPE_VON_NEUMANN, SHAPE_HEX,
+                         SHAPE_OFFSETS };
+
+/**
+ * @brief Cells read by a lookup table rule, as offsets from the updated cell.
+ *
+ * Cell p of the neighborhood is digit p of the rule index, with weight
+ * states^p. Cells are sorted row by row, so the Moore neighborhood gives the
+ * digit layout of the full (2 horizon + 1)^2 tables and a neighborhood of m
+ * cells a table of states^m transitions.
+ */
+typedef struct neighborhood_s
+{
+  enum NeighborhoodShape shape;
+  int horizon; /**< Largest coordinate of an offset */
+  int cells; /**< Number of cells */
+  int* dy; /**< Row offset of each cell */
+  int* dx; /**< Column offset of each cell */
+} neighborhood_t;
+
+/**
+ * Neighborhood of a given shape and radius: the (2 horizon + 1)^2 square
+ * (Moore), the cells within Manhattan distance horizon (von Neumann) or the
+ * hexagonal neighborhood on the square grid, the square without the top
+ * right and bottom left corners (the cells with |dy - dx| <= horizon).
+ */
+void neighborhood_init(neighborhood_t*, enum NeighborhoodShape, int horizon);
+
+/**
+ * Read a neighborhood from "moore", "vonneumann" or "hex" with the given
+ * horizon, or from a list of offsets "dy:dx,dy:dx,..." whose horizon is the
+ * largest coordinate. Returns 0 when the argument is not valid.
+ */
+int neighborhood_parse(neighborhood_t*, const char* arg, int horizon);
+
+void neighborhood_free(neighborhood_t*);
+
+/**
+ * Shape of the windows from which the metrics predict a cell of an automaton
+ * with this neighborhood: its own shape, the square for lists of offsets.
+ */
+enum NeighborhoodShape neighborhood_window_shape(const neighborhood_t*);
+
+/** Position of the cell (dy, dx) in the neighborhood, -1 if not in it */
+int neighborhood_find(const neighborhood_t*, int dy, int dx);
+
+/**
+ * Weights of the (2 horizon + 1)^2 cells of the square window in the rule
+ * index, row by row: states^p for cell p of the neighborhood and 0 for the
+ * cells out of it. update_step_general steps any neighborhood with them.
+ */
+void neighborhood_pows(const neighborhood_t*, int states, uint32_t* pows);
+
+/**
+ * Symmetries of the square that map the neighborhood onto itself, the
+ * identity first. perms[t * cells + p] is the position of the image of cell
+ * p by symmetry t, perms holding SYMMETRIES * cells positions. Returns the
+ * number of symmetries.
+ */
+int neighborhood_symmetries(const neighborhood_t*, int* perms);
+
+/** Name of the shape, for the messages */
+const char* neighborhood_name(const neighborhood_t*);
+
+#endif // NEIGHBORHOOD_H
@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <string.h>
+#include "automaton/packed3.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86 1
+#endif
+
+#define STATES 3
+#define CELLS_PER_WORD 32
+#define VEC 32 /* Padding of the row buffers, a multiple of every vector size */
+
+/**
+ * Scratch space of a worker. The step works on three unpacked rows (one byte
+ * per cell with a wrapped cell on each side) that are rolled down the grid.
+ */
+typedef struct scratch_s
+{
+  uint8_t* rows[3]; /**< Unpacked rows i - 1, i and i + 1 */
+  uint16_t* codes; /**< Column codes of the current row */
+  uint16_t* index; /**< Rule indices of the current row */
+  uint8_t* out; /**< Unpacked output row */
+} scratch_t;
+
+/** State of the packed engine, rows are packed 2 bits per cell */
+typedef struct packed3_s
+{
+  size_t size;
+  size_t words; /**< Number of words per row */
+  uint8_t* rule;
+  uint64_t* grid;
+  uint64_t* next;
+  pool_t* pool; /**< Workers updating row bands, NULL when serial */
+  /** Vector variants for the running CPU */
+  void (*column_codes)(size_t n, uint8_t* rows[3], uint16_t* codes);
+  void (*neighbor_indices)(size_t n, uint16_t* codes, uint16_t* index);
+  int n_scratch;
+  scratch_t* scratch; /**< One scratch space per worker */
+} packed3_t;
+
+/**
+ * Unpack a packed row to one byte per cell, starting at row[1]. Cells past
+ * the end of the row are zero since the padding bits of the grid are kept
+ * clear.
+ */
+static void unpack_row(size_t words, uint64_t* packed, uint8_t* row)
+{
+  uint8_t* bytes = (uint8_t*) packed;
+  size_t n_bytes = words * sizeof(uint64_t);
+  size_t b = 0;
+
+#if defined(__SSSE3__)
+  /* Split each byte in nibbles and look the two cells of a nibble up */
+  const __m128i low_cell = _mm_setr_epi8(0, 1, 2, 3, 0, 1, 2, 3,
+                                         0, 1, 2, 3, 0, 1, 2, 3);
+  const __m128i high_cell = _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1,
+                                          2, 2, 2, 2, 3, 3, 3, 3);
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+
+  for (; b + 16 <= n_bytes; b += 16) {
+    __m128i in = _mm_loadu_si128((__m128i*) &bytes[b]);
+    __m128i lo = _mm_and_si128(in, nibble);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(in, 4), nibble);
+
+    __m128i c0 = _mm_shuffle_epi8(low_cell, lo);
+    __m128i c1 = _mm_shuffle_epi8(high_cell, lo);
+    __m128i c2 = _mm_shuffle_epi8(low_cell, hi);
+    __m128i c3 = _mm_shuffle_epi8(high_cell, hi);
+
+    __m128i c01 = _mm_unpacklo_epi8(c0, c1);
+    __m128i c23 = _mm_unpacklo_epi8(c2, c3);
+    _mm_storeu_si128((__m128i*) &row[1 + 4 * b],
+                     _mm_unpacklo_epi16(c01, c23));
+    _mm_storeu_si128((__m128i*) &row[1 + 4 * b + 16],
+                     _mm_unpackhi_epi16(c01, c23));
+
+    c01 = _mm_unpackhi_epi8(c0, c1);
+    c23 = _mm_unpackhi_epi8(c2, c3);
+    _mm_storeu_si128((__m128i*) &row[1 + 4 * b + 32],
+                     _mm_unpacklo_epi16(c01, c23));
+    _mm_storeu_si128((__m128i*) &row[1 + 4 * b + 48],
+                     _mm_unpackhi_epi16(c01, c23));
+  }
+#endif
+
+  for (; b < n_bytes; ++b) {
+    for (int c = 0; c < 4; ++c) {
+      row[1 + 4 * b + c] = (bytes[b] >> (2 * c)) & 3;
+    }
+  }
+}
+
+/**
+ * Column codes of the three rows: up + 27 * middle + 729 * down, which are the
+ * digits of a column in the rule index.
+ */
+static void column_codes(size_t n, uint8_t* rows[3], uint16_t* codes)
+{
+  size_t c = 0;
+
+#if defined(__SSSE3__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i mid_weight = _mm_set1_epi16(27);
+  const __m128i down_weight = _mm_set1_epi16(729);
+
+  for (; c < n; c += 8) {
+    __m128i up = _mm_unpacklo_epi8(
+      _mm_loadl_epi64((__m128i*) &rows[0][c]), zero);
+    __m128i mid = _mm_unpacklo_epi8(
+      _mm_loadl_epi64((__m128i*) &rows[1][c]), zero);
+    __m128i down = _mm_unpacklo_epi8(
+      _mm_loadl_epi64((__m128i*) &rows[2][c]), zero);
+    __m128i code = _mm_add_epi16(up, _mm_mullo_epi16(mid, mid_weight));
+    code = _mm_add_epi16(code, _mm_mullo_epi16(down, down_weight));
+    _mm_storeu_si128((__m128i*) &codes[c], code);
+  }
+#else
+  for (; c < n; ++c) {
+    codes[c] = rows[0][c] + 27 * rows[1][c] + 729 * rows[2][c];
+  }
+#endif
+}
+
+/**
+ * Rule indices of the cells of a row from the codes of their left, center and
+ * right columns.
+ */
+static void neighbor_indices(size_t n, uint16_t* codes, uint16_t* index)
+{
+  size_t j = 0;
+
+#if defined(__SSSE3__)
+  const __m128i three = _mm_set1_epi16(3);
+  const __m128i nine = _mm_set1_epi16(9);
+
+  for (; j < n; j += 8) {
+    __m128i left = _mm_loadu_si128((__m128i*) &codes[j]);
+    __m128i center = _mm_loadu_si128((__m128i*) &codes[j + 1]);
+    __m128i right = _mm_loadu_si128((__m128i*) &codes[j + 2]);
+    __m128i idx = _mm_add_epi16(left, _mm_mullo_epi16(center, three));
+    idx = _mm_add_epi16(idx, _mm_mullo_epi16(right, nine));
+    _mm_storeu_si128((__m128i*) &index[j], idx);
+  }
+#else
+  for (; j < n; ++j) {
+    index[j] = codes[j] + 3 * codes[j + 1] + 9 * codes[j + 2];
+  }
+#endif
+}
+
+#if X86
+/** AVX2 variant of column_codes, picked at runtime */
+__attribute__((target("avx2")))
+static void column_codes_avx2(size_t n, uint8_t* rows[3], uint16_t* codes)
+{
+  size_t c = 0;
+
+  const __m256i mid_weight = _mm256_set1_epi16(27);
+  const __m256i down_weight = _mm256_set1_epi16(729);
+
+  for (; c < n; c += 16) {
+    __m256i up =
+      _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &rows[0][c]));
+    __m256i mid =
+      _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &rows[1][c]));
+    __m256i down =
+      _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &rows[2][c]));
+    __m256i code = _mm256_add_epi16(up, _mm256_mullo_epi16(mid, mid_weight));
+    code = _mm256_add_epi16(code, _mm256_mullo_epi16(down, down_weight));
+    _mm256_storeu_si256((__m256i*) &codes[c], code);
+  }
+}
+
+/** AVX2 variant of neighbor_indices, picked at runtime */
+__attribute__((target("avx2")))
+static void neighbor_indices_avx2(size_t n, uint16_t* codes, uint16_t* index)
+{
+  size_t j = 0;
+
+  const __m256i three = _mm256_set1_epi16(3);
+  const __m256i nine = _mm256_set1_epi16(9);
+
+  for (; j < n; j += 16) {
+    __m256i left = _mm256_loadu_si256((__m256i*) &codes[j]);
+    __m256i center = _mm256_loadu_si256((__m256i*) &codes[j + 1]);
+    __m256i right = _mm256_loadu_si256((__m256i*) &codes[j + 2]);
+    __m256i idx = _mm256_add_epi16(left, _mm256_mullo_epi16(center, three));
+    idx = _mm256_add_epi16(idx, _mm256_mullo_epi16(right, nine));
+    _mm256_storeu_si256((__m256i*) &index[j], idx);
+  }
+}
+#endif // X86
+
+/** Pack a row of one byte per cell back to 2 bits per cell */
+static void pack_row(size_t words, uint8_t* row, uint64_t* packed)
+{
+  uint8_t* bytes = (uint8_t*) packed;
+  size_t n_bytes = words * sizeof(uint64_t);
+  size_t b = 0;
+
+#if defined(__SSSE3__)
+  const __m128i pair = _mm_setr_epi8(1, 4, 1, 4, 1, 4, 1, 4,
+                                     1, 4, 1, 4, 1, 4, 1, 4);
+  const __m128i quad = _mm_setr_epi16(1, 16, 1, 16, 1, 16, 1, 16);
+  const __m128i gather = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1,
+                                       -1, -1, -1, -1, -1, -1, -1, -1);
+
+  for (; b + 4 <= n_bytes; b += 4) {
+    __m128i cells = _mm_loadu_si128((__m128i*) &row[4 * b]);
+    __m128i v = _mm_madd_epi16(_mm_maddubs_epi16(cells, pair), quad);
+    int32_t out = _mm_cvtsi128_si32(_mm_shuffle_epi8(v, gather));
+    memcpy(&bytes[b], &out, sizeof(int32_t));
+  }
+#endif
+
+  for (; b < n_bytes; ++b) {
+    bytes[b] = row[4 * b] | (row[4 * b + 1] << 2)
+      | (row[4 * b + 2] << 4) | (row[4 * b + 3] << 6);
+  }
+}
+
+static void packed3_unpack(packed3_t* p, uint64_t* grid, size_t i,
+                           uint8_t* row)
+{
+  size_t size = p->size;
+  unpack_row(p->words, &grid[i * p->words], row);
+  /* Wrapped cells of the torus */
+  row[0] = row[size];
+  row[size + 1] = row[1];
+}
+
+static void packed3_band(void* data, void* in, void* out,
+                         size_t row_begin, size_t row_end, int worker)
+{
+  packed3_t* p = (packed3_t*) data;
+  scratch_t* s = &p->scratch[worker];
+  uint64_t* grid = (uint64_t*) in;
+  size_t size = p->size;
+  size_t padded = p->words * CELLS_PER_WORD;
+  uint8_t* temp;
+
+  packed3_unpack(p, grid, (row_begin + size - 1) % size, s->rows[0]);
+  packed3_unpack(p, grid, row_begin, s->rows[1]);
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    packed3_unpack(p, grid, (i + 1) % size, s->rows[2]);
+
+    p->column_codes(size + 2, s->rows, s->codes);
+    p->neighbor_indices(size, s->codes, s->index);
+    for (size_t j = 0; j < size; ++j) {
+      s->out[j] = p->rule[s->index[j]];
+    }
+    memset(&s->out[size], 0, padded - size);
+    pack_row(p->words, s->out, &((uint64_t*) out)[i * p->words]);
+
+    /* Roll the unpacked rows down */
+    temp = s->rows[0];
+    s->rows[0] = s->rows[1];
+    s->rows[1] = s->rows[2];
+    s->rows[2] = temp;
+  }
+}
+
+static void packed3_step(engine_t* engine, long n)
+{
+  packed3_t* p = (packed3_t*) engine->data;
+  engine_run_bands(p->pool, packed3_band, p, p->size,
+                   (void**) &p->grid, (void**) &p->next, n);
+}
+
+static void packed3_load(engine_t* engine, uint8_t* frame)
+{
+  packed3_t* p = (packed3_t*) engine->data;
+  size_t padded = p->words * CELLS_PER_WORD;
+  uint8_t* out = p->scratch[0].out;
+
+  for (size_t i = 0; i < p->size; ++i) {
+    memcpy(out, &frame[i * p->size], p->size * sizeof(uint8_t));
+    memset(&out[p->size], 0, padded - p->size);
+    pack_row(p->words, out, &p->grid[i * p->words]);
+  }
+}
+
+static void packed3_store(engine_t* engine, uint8_t* frame)
+{
+  packed3_t* p = (packed3_t*) engine->data;
+  uint8_t* row = p->scratch[0].rows[0];
+
+  for (size_t i = 0; i < p->size; ++i) {
+    unpack_row(p->words, &p->grid[i * p->words], row);
+    memcpy(&frame[i * p->size], &row[1], p->size * sizeof(uint8_t));
+  }
+}
+
+static void packed3_free(engine_t* engine)
+{
+  packed3_t* p = (packed3_t*) engine->data;
+  if (p->pool) {
+    pool_free(p->pool);
+  }
+  free(p->grid);
+  free(p->next);
+  for (int w = 0; w < p->n_scratch; ++w) {
+    for (int k = 0; k < 3; ++k) {
+      free(p->scratch[w].rows[k]);
+    }
+    free(p->scratch[w].codes);
+    free(p->scratch[w].index);
+    free(p->scratch[w].out);
+  }
+  free(p->scratch);
+  free(p);
+}
+
+engine_t* packed3_engine_new(size_t size, uint8_t rule[19683], pool_t* pool)
+{
+  packed3_t* p = (packed3_t*) calloc(1, sizeof(packed3_t));
+  p->size = size;
+  p->words = (size + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+  p->rule = rule;
+  p->pool = pool;
+  p->column_codes = column_codes;
+  p->neighbor_indices = neighbor_indices;
+#if X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    p->column_codes = column_codes_avx2;
+    p->neighbor_indices = neighbor_indices_avx2;
+  }
+#endif
+  p->grid = (uint64_t*)
+    engine_alloc_rows(pool, size, p->words * sizeof(uint64_t));
+  p->next = (uint64_t*)
+    engine_alloc_rows(pool, size, p->words * sizeof(uint64_t));
+
+  /* Row buffers are padded so that vector loops never need a tail */
+  size_t length = p->words * CELLS_PER_WORD + 2 * VEC;
+  p->n_scratch = pool ? pool_size(pool): 1;
+  p->scratch = (scratch_t*) malloc(p->n_scratch * sizeof(scratch_t));
+  for (int w = 0; w < p->n_scratch; ++w) {
+    for (int k = 0; k < 3; ++k) {
+      p->scratch[w].rows[k] = (uint8_t*) calloc(length, sizeof(uint8_t));
+    }
+    p->scratch[w].codes = (uint16_t*) calloc(length, sizeof(uint16_t));
+    p->scratch[w].index = (uint16_t*) calloc(length, sizeof(uint16_t));
+    p->scratch[w].out = (uint8_t*) calloc(length, sizeof(uint8_t));
+  }
+
+  engine_t* engine = (engine_t*) malloc(sizeof(engine_t));
+  engine->name = "packed3";
+  engine->data = p;
+  engine->load = packed3_load;
+  engine->step = packed3_step;
+  engine->store = packed3_store;
+  engine->activity = NULL;
+  engine->free = packed3_free;
+  engine->stats = NULL;
+  engine->state_hash = NULL;
+  return engine;
+}
@@ -0,0 +1,17 @@
+#include <stdint.h>
+#include "automaton/engine.h"
+
+#ifndef PACKED3_H /* Include guard */
+#define PACKED3_H
+
+/**
+ * @brief Create a 2 bits per cell engine for 3 states, horizon 1 rules.
+ *
+ * Rows are unpacked with byte shuffles and the rule indices of 16 (AVX2) or 8
+ * (SSSE3) cells are computed at once before the table lookups. The result is
+ * bit-exact with update_step_general. Rows are split across the workers of
+ * `pool` if not NULL, the engine takes ownership of the pool.
+ */
+engine_t* packed3_engine_new(size_t size, uint8_t rule[19683], pool_t* pool);
+
+#endif // PACKED3_H
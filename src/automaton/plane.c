@@ -0,0 +1,451 @@
+#include <stdlib.h>
+#include <string.h>
+#include "automaton/plane.h"
+#include "automaton/kernels.h"
+#include "utils/cycle.h"
+#include "utils/utils.h"
+
+#define CHUNK 64 /* Side of the chunks of the plane */
+
+/** Chunk (x, y) holds the cells [y * CHUNK, (y + 1) * CHUNK) x [x * CHUNK,
+    (x + 1) * CHUNK) of the plane, row major */
+typedef struct chunk_s
+{
+  int64_t x;
+  int64_t y;
+  uint8_t* cells; /**< NULL for an empty slot */
+} chunk_t;
+
+/** Open addressing hash map of the chunks */
+typedef struct chunk_map_s
+{
+  chunk_t* slots;
+  size_t n_slots; /**< Power of 2 */
+  size_t count;
+} chunk_map_t;
+
+typedef struct plane_s
+{
+  size_t size; /**< Side of the window exchanged with load and store */
+  int horizon;
+  int states;
+  uint8_t* rule;
+  uint32_t* pows;
+  uint8_t background; /**< State of every cell outside of the chunks */
+  chunk_map_t maps[2];
+  chunk_map_t* grid;
+  chunk_map_t* next;
+  chunk_map_t visited; /**< Chunks already computed during a step */
+  uint8_t** spare; /**< Cell buffers of freed chunks */
+  size_t n_spare;
+  size_t cap_spare;
+  uint8_t* local_in; /**< Padded chunk and the cells around it */
+  uint8_t* local_out;
+  int64_t origin_row; /**< Plane coordinates of the window corner */
+  int64_t origin_col;
+} plane_t;
+
+static uint8_t visited_mark;
+
+static int64_t floor_div(int64_t a, int64_t b)
+{
+  return (a >= 0) ? a / b: -((-a + b - 1) / b);
+}
+
+static size_t hash_chunk(int64_t x, int64_t y)
+{
+  uint64_t h = (uint64_t) x * 0x9E3779B97F4A7C15ULL;
+  h = (h ^ (uint64_t) y) * 0xBF58476D1CE4E5B9ULL;
+  return (size_t) (h ^ (h >> 31));
+}
+
+static void map_init(chunk_map_t* map, size_t n_slots)
+{
+  map->slots = (chunk_t*) calloc(n_slots, sizeof(chunk_t));
+  map->n_slots = n_slots;
+  map->count = 0;
+}
+
+static uint8_t* map_get(chunk_map_t* map, int64_t x, int64_t y)
+{
+  size_t mask = map->n_slots - 1;
+  size_t h = hash_chunk(x, y) & mask;
+  while (map->slots[h].cells != NULL) {
+    if (map->slots[h].x == x && map->slots[h].y == y) {
+      return map->slots[h].cells;
+    }
+    h = (h + 1) & mask;
+  }
+  return NULL;
+}
+
+/** Insert a chunk that is not in the map yet */
+static void map_put(chunk_map_t* map, int64_t x, int64_t y, uint8_t* cells)
+{
+  if (2 * (map->count + 1) > map->n_slots) {
+    chunk_t* old = map->slots;
+    size_t n_old = map->n_slots;
+    map_init(map, 2 * n_old);
+    for (size_t k = 0; k < n_old; ++k) {
+      if (old[k].cells != NULL) {
+        map_put(map, old[k].x, old[k].y, old[k].cells);
+      }
+    }
+    free(old);
+  }
+
+  size_t mask = map->n_slots - 1;
+  size_t h = hash_chunk(x, y) & mask;
+  while (map->slots[h].cells != NULL) {
+    h = (h + 1) & mask;
+  }
+  map->slots[h].x = x;
+  map->slots[h].y = y;
+  map->slots[h].cells = cells;
+  ++map->count;
+}
+
+static void map_clear(chunk_map_t* map)
+{
+  memset(map->slots, 0, map->n_slots * sizeof(chunk_t));
+  map->count = 0;
+}
+
+static uint8_t* take_cells(plane_t* p)
+{
+  if (p->n_spare > 0) {
+    return p->spare[--p->n_spare];
+  }
+  return (uint8_t*) malloc(CHUNK * CHUNK * sizeof(uint8_t));
+}
+
+/** Give the cells of all the chunks of the map back to the spare list */
+static void release_chunks(plane_t* p, chunk_map_t* map)
+{
+  if (p->n_spare + map->count > p->cap_spare) {
+    p->cap_spare = 2 * (p->n_spare + map->count);
+    p->spare = (uint8_t**) realloc(p->spare, p->cap_spare * sizeof(uint8_t*));
+  }
+  for (size_t k = 0; k < map->n_slots; ++k) {
+    if (map->slots[k].cells != NULL) {
+      p->spare[p->n_spare++] = map->slots[k].cells;
+    }
+  }
+  map_clear(map);
+}
+
+/** Check whether the cells [r0, r1) x [c0, c1) all are the background */
+static int is_background(uint8_t* cells, size_t pitch, size_t r0, size_t r1,
+                         size_t c0, size_t c1, uint8_t background)
+{
+  for (size_t r = r0; r < r1; ++r) {
+    for (size_t c = c0; c < c1; ++c) {
+      if (cells[r * pitch + c] != background) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/**
+ * Check whether the cells of a chunk within horizon of its neighbor in the
+ * direction (dy, dx) differ from the background.
+ */
+static int reaches(plane_t* p, uint8_t* cells, int dy, int dx)
+{
+  size_t h = p->horizon;
+  size_t r0 = (dy == 1) ? CHUNK - h: 0;
+  size_t r1 = (dy == -1) ? h: CHUNK;
+  size_t c0 = (dx == 1) ? CHUNK - h: 0;
+  size_t c1 = (dx == -1) ? h: CHUNK;
+  return !is_background(cells, CHUNK, r0, r1, c0, c1, p->background);
+}
+
+/**
+ * Compute the next state of chunk (x, y) in p->local_out, whose inside
+ * starts at row and column horizon.
+ */
+static void compute_chunk(plane_t* p, int64_t x, int64_t y)
+{
+  size_t h = p->horizon;
+  size_t local = CHUNK + 2 * h;
+  uint8_t* around[3][3];
+
+  for (int dy = -1; dy <= 1; ++dy) {
+    for (int dx = -1; dx <= 1; ++dx) {
+      around[dy + 1][dx + 1] = map_get(p->grid, x + dx, y + dy);
+    }
+  }
+
+  for (size_t r = 0; r < local; ++r) {
+    /* Row r of the local frame is row `row` of the chunks at dy */
+    int dy = (r < h) ? 0: (r < CHUNK + h) ? 1: 2;
+    size_t row = (r + CHUNK - h) % CHUNK;
+    uint8_t* out = &p->local_in[r * local];
+    size_t offsets[3] = {CHUNK - h, 0, 0};
+    size_t widths[3] = {h, CHUNK, h};
+
+    for (int dx = 0; dx < 3; ++dx) {
+      uint8_t* cells = around[dy][dx];
+      if (cells == NULL) {
+        memset(out, p->background, widths[dx]);
+      }
+      else {
+        memcpy(out, &cells[row * CHUNK + offsets[dx]], widths[dx]);
+      }
+      out += widths[dx];
+    }
+  }
+
+  update_tile_sliding(CHUNK, p->local_out, p->rule, p->local_in, h, p->pows,
+                      0, CHUNK, 0, CHUNK);
+}
+
+static void plane_step_once(plane_t* p)
+{
+  size_t h = p->horizon;
+  size_t local = CHUNK + 2 * h;
+  int neigs = (2 * h + 1) * (2 * h + 1);
+  uint32_t uniform = 0;
+
+  for (int i = 0; i < neigs; ++i) {
+    uniform += p->background * p->pows[i];
+  }
+  uint8_t background = p->rule[uniform];
+
+  /* Candidates are the chunks and their neighbors they reach, chunks that
+     end up uniform are dropped */
+  map_clear(&p->visited);
+  for (size_t k = 0; k < p->grid->n_slots; ++k) {
+    chunk_t chunk = p->grid->slots[k];
+    if (chunk.cells == NULL) {
+      continue;
+    }
+
+    for (int dy = -1; dy <= 1; ++dy) {
+      for (int dx = -1; dx <= 1; ++dx) {
+        int64_t x = chunk.x + dx;
+        int64_t y = chunk.y + dy;
+        if ((dy != 0 || dx != 0) && !reaches(p, chunk.cells, dy, dx)) {
+          continue;
+        }
+        if (map_get(&p->visited, x, y) != NULL) {
+          continue;
+        }
+        map_put(&p->visited, x, y, &visited_mark);
+
+        compute_chunk(p, x, y);
+        if (!is_background(p->local_out, local, h, CHUNK + h, h, CHUNK + h,
+                           background)) {
+          uint8_t* cells = take_cells(p);
+          for (size_t r = 0; r < CHUNK; ++r) {
+            memcpy(&cells[r * CHUNK], &p->local_out[(r + h) * local + h],
+                   CHUNK);
+          }
+          map_put(p->next, x, y, cells);
+        }
+      }
+    }
+  }
+
+  release_chunks(p, p->grid);
+  chunk_map_t* temp = p->grid;
+  p->grid = p->next;
+  p->next = temp;
+  p->background = background;
+}
+
+static void plane_step(engine_t* engine, long n)
+{
+  plane_t* p = (plane_t*) engine->data;
+  for (long i = 0; i < n; ++i) {
+    plane_step_once(p);
+  }
+}
+
+static void plane_load(engine_t* engine, uint8_t* frame)
+{
+  plane_t* p = (plane_t*) engine->data;
+  size_t size = p->size;
+  size_t counts[256] = {0};
+
+  /* The background is the most common state on the border of the frame */
+  for (size_t k = 0; k < size; ++k) {
+    ++counts[frame[k]];
+    ++counts[frame[(size - 1) * size + k]];
+    ++counts[frame[k * size]];
+    ++counts[frame[k * size + size - 1]];
+  }
+  p->background = 0;
+  for (int s = 1; s < p->states; ++s) {
+    if (counts[s] > counts[p->background]) {
+      p->background = s;
+    }
+  }
+
+  release_chunks(p, p->grid);
+  int64_t y0 = floor_div(p->origin_row, CHUNK);
+  int64_t y1 = floor_div(p->origin_row + size - 1, CHUNK);
+  int64_t x0 = floor_div(p->origin_col, CHUNK);
+  int64_t x1 = floor_div(p->origin_col + size - 1, CHUNK);
+  uint8_t* cells = NULL;
+
+  for (int64_t y = y0; y <= y1; ++y) {
+    for (int64_t x = x0; x <= x1; ++x) {
+      if (cells == NULL) {
+        cells = take_cells(p);
+      }
+      memset(cells, p->background, CHUNK * CHUNK);
+      for (size_t r = 0; r < CHUNK; ++r) {
+        int64_t i = y * CHUNK + r - p->origin_row;
+        if (i < 0 || i >= (int64_t) size) {
+          continue;
+        }
+        for (size_t c = 0; c < CHUNK; ++c) {
+          int64_t j = x * CHUNK + c - p->origin_col;
+          if (j >= 0 && j < (int64_t) size) {
+            cells[r * CHUNK + c] = frame[i * size + j];
+          }
+        }
+      }
+      if (!is_background(cells, CHUNK, 0, CHUNK, 0, CHUNK, p->background)) {
+        map_put(p->grid, x, y, cells);
+        cells = NULL;
+      }
+    }
+  }
+  if (cells != NULL) {
+    p->spare[p->n_spare++] = cells;
+  }
+}
+
+static void plane_store(engine_t* engine, uint8_t* frame)
+{
+  plane_t* p = (plane_t*) engine->data;
+  size_t size = p->size;
+  int64_t min_row = INT64_MAX, max_row = INT64_MIN;
+  int64_t min_col = INT64_MAX, max_col = INT64_MIN;
+
+  /* Bounding box of the cells that differ from the background */
+  for (size_t k = 0; k < p->grid->n_slots; ++k) {
+    chunk_t chunk = p->grid->slots[k];
+    if (chunk.cells == NULL) {
+      continue;
+    }
+    for (size_t r = 0; r < CHUNK; ++r) {
+      for (size_t c = 0; c < CHUNK; ++c) {
+        if (chunk.cells[r * CHUNK + c] != p->background) {
+          int64_t i = chunk.y * CHUNK + r;
+          int64_t j = chunk.x * CHUNK + c;
+          min_row = (i < min_row) ? i: min_row;
+          max_row = (i > max_row) ? i: max_row;
+          min_col = (j < min_col) ? j: min_col;
+          max_col = (j > max_col) ? j: max_col;
+        }
+      }
+    }
+  }
+
+  /* The window is kept in place when the plane is uniform */
+  if (min_row <= max_row) {
+    p->origin_row = floor_div(min_row + max_row, 2) - (int64_t) size / 2;
+    p->origin_col = floor_div(min_col + max_col, 2) - (int64_t) size / 2;
+  }
+
+  memset(frame, p->background, size * size);
+  for (size_t k = 0; k < p->grid->n_slots; ++k) {
+    chunk_t chunk = p->grid->slots[k];
+    if (chunk.cells == NULL) {
+      continue;
+    }
+    for (size_t r = 0; r < CHUNK; ++r) {
+      int64_t i = chunk.y * CHUNK + r - p->origin_row;
+      if (i < 0 || i >= (int64_t) size) {
+        continue;
+      }
+      for (size_t c = 0; c < CHUNK; ++c) {
+        int64_t j = chunk.x * CHUNK + c - p->origin_col;
+        if (j >= 0 && j < (int64_t) size) {
+          frame[i * size + j] = chunk.cells[r * CHUNK + c];
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Hash of the plane, which the window of store does not identify since it
+ * follows the pattern. Chunks are hashed with their position and summed, so
+ * that the order of the map does not matter.
+ */
+static uint64_t plane_state_hash(engine_t* engine)
+{
+  plane_t* p = (plane_t*) engine->data;
+  uint64_t h = p->background;
+
+  for (size_t k = 0; k < p->grid->n_slots; ++k) {
+    chunk_t chunk = p->grid->slots[k];
+    if (chunk.cells != NULL) {
+      h += (frame_hash(CHUNK * CHUNK, chunk.cells)
+            ^ hash_chunk(chunk.x, chunk.y)) * 0x9E3779B97F4A7C15ULL;
+    }
+  }
+  return h;
+}
+
+static void plane_free(engine_t* engine)
+{
+  plane_t* p = (plane_t*) engine->data;
+  release_chunks(p, p->grid);
+  for (size_t k = 0; k < p->n_spare; ++k) {
+    free(p->spare[k]);
+  }
+  free(p->spare);
+  free(p->maps[0].slots);
+  free(p->maps[1].slots);
+  free(p->visited.slots);
+  free(p->local_in);
+  free(p->local_out);
+  free(p->pows);
+  free(p);
+}
+
+engine_t* plane_engine_new(uint8_t* rule, struct Options2D* opts)
+{
+  plane_t* p = (plane_t*) calloc(1, sizeof(plane_t));
+  int h = opts->horizon;
+  int neigs = (2 * h + 1) * (2 * h + 1);
+  size_t local = CHUNK + 2 * h;
+
+  p->size = opts->size;
+  p->horizon = h;
+  p->states = opts->states;
+  p->rule = rule;
+  p->pows = (uint32_t*) malloc(neigs * sizeof(uint32_t));
+  for (int i = 0; i < neigs; ++i) {
+    p->pows[i] = ipow(opts->states, i);
+  }
+
+  map_init(&p->maps[0], 64);
+  map_init(&p->maps[1], 64);
+  map_init(&p->visited, 64);
+  p->grid = &p->maps[0];
+  p->next = &p->maps[1];
+  p->cap_spare = 64;
+  p->spare = (uint8_t**) malloc(p->cap_spare * sizeof(uint8_t*));
+  p->local_in = (uint8_t*) calloc(local * local, sizeof(uint8_t));
+  p->local_out = (uint8_t*) calloc(local * local, sizeof(uint8_t));
+
+  engine_t* engine = (engine_t*) malloc(sizeof(engine_t));
+  engine->name = "plane";
+  engine->data = p;
+  engine->load = plane_load;
+  engine->step = plane_step;
+  engine->store = plane_store;
+  engine->activity = NULL;
+  engine->free = plane_free;
+  engine->stats = NULL;
+  engine->state_hash = plane_state_hash;
+  return engine;
+}
@@ -0,0 +1,20 @@
+#include <stdint.h>
+#include "automaton/engine.h"
+
+#ifndef PLANE_H /* Include guard */
+#define PLANE_H
+
+/**
+ * @brief Create an engine simulating the automaton on an unbounded plane.
+ *
+ * The plane is stored as a hash map of fixed size chunks, only allocated
+ * where some cell differs from the background state (which evolves with the
+ * rule, like every other cell). The frame given to load is placed at the
+ * current window, and the background is the most common state on its
+ * border. store writes the size x size window centered on the bounding box
+ * of the cells that differ from the background, so the measurements follow
+ * the pattern instead of wrapping around a torus.
+ */
+engine_t* plane_engine_new(uint8_t* rule, struct Options2D* opts);
+
+#endif // PLANE_H
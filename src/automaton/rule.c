@@ -6,13 +6,20 @@
 #include "utils/utils.h"
 #include "utils/compress.h"
 #include "rule.h"
+#include "sparse.h"
 
 #define DIRICHLET 1
 #define D_CONST .4
 
 
-void populate_buf(uint64_t grule_size, uint8_t* rule_array, char* rule_buf)
+void populate_buf(uint64_t grule_size, uint8_t* rule_array, char* rule_buf,
+                  enum RuleFamily family)
 {
+  if (family == FAMILY_SPARSE) {
+    sparse_populate_buf(rule_array, rule_buf, grule_size + 1);
+    return;
+  }
+
   /* Populate buffer with newly created rule */
   for (uint64_t v = 0; v < grule_size; v++) {
     sprintf(&rule_buf[v], "%"PRIu8, rule_array[v]);
@@ -20,106 +27,99 @@ void populate_buf(uint64_t grule_size, uint8_t* rule_array, char* rule_buf)
   rule_buf[grule_size] = '\0';
 }
 
+/** states^exp, saturated to UINT64_MAX */
+static uint64_t pow_sat(uint64_t states, int exp)
+{
+  uint64_t result = 1;
+  for (int e = 0; e < exp; ++e) {
+    result = (result > UINT64_MAX / states) ? UINT64_MAX: result * states;
+  }
+  return result;
+}
+
+uint64_t rule_size(struct Options2D* opts)
+{
+  int side = 2 * opts->horizon + 1;
+  int cells = opts->neighborhood.cells;
+  uint64_t size;
+
+  switch (opts->family) {
+  case FAMILY_TOTALISTIC:
+    size = (uint64_t) side * side * (opts->states - 1) + 1;
+    break;
+  case FAMILY_SPARSE:
+    /* Neighborhood codes on 64 bits, the largest value marking free slots */
+    if (pow_sat(opts->states, cells) == UINT64_MAX) {
+      return 0;
+    }
+    size = sparse_rule_bytes(opts->transitions);
+    break;
+  case FAMILY_OUTER:
+    /* The box sums of the engine reach (side^2)^states */
+    if (pow_sat(side * side, opts->states) > UINT32_MAX) {
+      return 0;
+    }
+    size = opts->states * pow_sat(side * side, opts->states - 1);
+    break;
+  default:
+    size = pow_sat(opts->states, cells);
+  }
+  return (size > UINT32_MAX) ? 0: size;
+}
+
 /**
  * Symmetrize the rule by setting all the states and their symmetries to having
- * the same output.
+ * the same output. Only the rotations and flips mapping the neighborhood onto
+ * itself are applied.
  */
 void symmetrize_rule(uint64_t grule_size,
                      uint8_t rule_array[grule_size],
-                     int states, int horizon)
+                     int states, const neighborhood_t* neighborhood)
 {
-  int side = 2 * horizon + 1;
-  int neigh_size = side * side - 1;
+  int cells = neighborhood->cells;
+
+  /* Rules of the other families are symmetric by construction */
+  if (grule_size != pow_sat(states, cells)) {
+    return;
+  }
 
-  uint32_t position_180;
-  uint32_t position_90;
-  uint32_t position_270;
-  uint32_t position_vflip;
-  uint32_t position_hflip;
-  uint32_t position_dflip;
-  uint32_t position_aflip;
+  int perms[SYMMETRIES * cells];
+  int n_symmetries = neighborhood_symmetries(neighborhood, perms);
+  uint32_t pows[cells];
+  uint8_t digits[cells];
+
+  for (int p = 0; p < cells; ++p) {
+    pows[p] = ipow(states, p);
+  }
 
   /* grule_size can be very big, this array is better on the heap */
   /* Keep track of already seen positions with book-keeping */
   uint8_t* book_keep = calloc(grule_size, sizeof(uint8_t));
 
-  int pos;
-
   for (uint64_t i = 0; i < grule_size; ++i) {
     /* Skip already seen positions when looping through the rule */
     if (book_keep[i] == 1) {
       continue;
     }
 
-    position_180 = 0;
-    position_90 = 0;
-    position_270 = 0;
-    position_vflip = 0;
-    position_hflip = 0;
-    position_dflip = 0;
-    position_aflip = 0;
-
-    /* Create the representation of the symmetrized position by swapping the
-       states in its number representation. */
-    for (int p = 0; p < neigh_size + 1; ++p) {
-      /* 180° rotation */
-      position_180 += (uint32_t)ipow(states, p) *
-        ((i / (uint32_t)ipow(states, neigh_size  - p)) % states);
-
-      /* 90° rotation */
-      pos = (neigh_size - side + 1 - (side * (p%side)) + p/side);
-      position_90 += (uint32_t)ipow(states, p) *
-        ((i / (uint32_t)ipow(states, pos)) % states);
-
-      /* 270° rotation */
-      position_270 += (uint32_t)ipow(states, p) *
-        ((i / (uint32_t)ipow(states, neigh_size  - pos)) % states);
-
-      /* Vertical flip */
-      pos = (side * (p / side)) + (side - 1 - (p % 3));
-      position_vflip += (uint32_t)ipow(states, p) *
-        ((i / (uint32_t)ipow(states, pos)) % states);
-
-      /* Horizontal flip */
-      if (p/side < side/2) {
-        pos = (p - side + neigh_size + 1)%(neigh_size + 1);
-      } else if (p/side > side/2) {
-        pos = (p + side)%(neigh_size + 1);
-      } else {
-        pos = p;
-      }
-      position_hflip += (uint32_t)ipow(states, p) *
-        ((i / (uint32_t)ipow(states, pos)) % states);
-
-      /* Diagonal flip */
-      pos = neigh_size - ((p % side) * side  + (p / side));
-      position_dflip += (uint32_t)ipow(states, p) *
-        ((i / (uint32_t)ipow(states, pos)) % states);
+    for (int p = 0; p < cells; ++p) {
+      digits[p] = (i / pows[p]) % states;
+    }
 
-      /* Antidiagonal flip */
-      pos = ((p % side) * side  + (p / side));
-      position_aflip += (uint32_t)ipow(states, p) *
-        ((i / (uint32_t)ipow(states, pos)) % states);
+    /* Create the representation of the symmetrized position by moving the
+       state of each cell to the position of its image. */
+    for (int t = 1; t < n_symmetries; ++t) {
+      int* perm = &perms[t * cells];
+      uint32_t position = 0;
+      for (int p = 0; p < cells; ++p) {
+        position += pows[perm[p]] * digits[p];
+      }
 
+      /* Add all seen positions to the book to not process them again */
+      book_keep[position] = 1;
+      rule_array[position] = rule_array[i];
     }
-
-    /* Add all seen positions to the book to not process them again */
     book_keep[i] = 1;
-    book_keep[position_180] = 1;
-    book_keep[position_90] = 1;
-    book_keep[position_270] = 1;
-    book_keep[position_vflip] = 1;
-    book_keep[position_hflip] = 1;
-    book_keep[position_dflip] = 1;
-    book_keep[position_aflip] = 1;
-
-    rule_array[position_180] = rule_array[i];
-    rule_array[position_90] = rule_array[i];
-    rule_array[position_270] = rule_array[i];
-    rule_array[position_vflip] = rule_array[i];
-    rule_array[position_hflip] = rule_array[i];
-    rule_array[position_dflip] = rule_array[i];
-    rule_array[position_aflip] = rule_array[i];
   }
   free(book_keep);
 }
@@ -165,10 +165,17 @@ int comp (const void * elem1, const void * elem2)
 void generate_general_rule(uint64_t grule_size,
                            uint8_t rule_array[grule_size],
                            char rule_buf[grule_size + 1],
-                           int states, int horizon)
+                           int states, const neighborhood_t* neighborhood,
+                           enum RuleFamily family)
 {
   int inc;
 
+  if (family == FAMILY_SPARSE) {
+    sparse_generate(rule_array);
+    populate_buf(grule_size, rule_array, rule_buf, family);
+    return;
+  }
+
   /* Choose lambda parameter at random as well as the proportion of
      transitions to other states */
   double alphas[states];
@@ -216,31 +223,47 @@ void generate_general_rule(uint64_t grule_size,
     rule_array[v] = (uint8_t)inc;
   }
 
-  symmetrize_rule(grule_size, rule_array, states, horizon);
+  symmetrize_rule(grule_size, rule_array, states, neighborhood);
 
-  populate_buf(grule_size, rule_array, rule_buf);
+  populate_buf(grule_size, rule_array, rule_buf, family);
 }
 
 
 void cross_breed(uint64_t grule_size, uint8_t* parent_rule_A,
                  uint8_t* parent_rule_B, uint8_t* child,
                  char rule_buf[grule_size], double rate,
-                 int horizon, int states)
+                 const neighborhood_t* neighborhood, int states,
+                 enum RuleFamily family)
 {
+  if (family == FAMILY_SPARSE) {
+    sparse_cross_breed(parent_rule_A, parent_rule_B, child, rate);
+    perturb_rule(grule_size, child, rule_buf, states, neighborhood, 0.05,
+                 family);
+    return;
+  }
+
   for (uint64_t i = 0; i < grule_size; ++i) {
     double rand_num = (double)rand() / (double)((unsigned)RAND_MAX + 1);
     child[i] = (rate > rand_num) ? parent_rule_A[i]: parent_rule_B[i];
   }
 
-  perturb_rule(grule_size, child, rule_buf, states, horizon, 0.05);
+  perturb_rule(grule_size, child, rule_buf, states, neighborhood, 0.05,
+               family);
 }
 
 
 void perturb_rule(uint64_t grule_size,
                   uint8_t rule_array[grule_size],
                   char rule_buf[grule_size + 1],
-                  int states, int horizon, double rate)
+                  int states, const neighborhood_t* neighborhood,
+                  double rate, enum RuleFamily family)
 {
+  if (family == FAMILY_SPARSE) {
+    sparse_perturb(rule_array, rate);
+    populate_buf(grule_size, rule_array, rule_buf, family);
+    return;
+  }
+
   for (uint64_t v = 0; v < grule_size; ++v) {
     /* Perturb transisition outcome with probability rate */
     double rand_num = (double)rand() / (double)((unsigned)RAND_MAX + 1);
@@ -250,8 +273,8 @@ void perturb_rule(uint64_t grule_size,
     }
   }
 
-  symmetrize_rule(grule_size, rule_array, states, horizon);
-  populate_buf(grule_size, rule_array, rule_buf);
+  symmetrize_rule(grule_size, rule_array, states, neighborhood);
+  populate_buf(grule_size, rule_array, rule_buf, family);
 }
 
 void make_map(struct Options2D* opts, char* rule_buf, int step)
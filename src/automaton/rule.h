@@ -4,7 +4,14 @@
 #ifndef RULE_H
 #define RULE_H
 
-void populate_buf(uint64_t, uint8_t*, char*);
+void populate_buf(uint64_t, uint8_t*, char*, enum RuleFamily);
+
+/**
+ * Number of transitions of the rules of opts->family with the states,
+ * horizon and neighborhood of opts, 0 when the rule indices would not fit in
+ * 32 bits.
+ */
+uint64_t rule_size(struct Options2D* opts);
 
 void build_rule_from_args(uint64_t grule_size,
                           uint8_t rule_array[grule_size],
@@ -12,17 +19,19 @@ void build_rule_from_args(uint64_t grule_size,
                           char*, int);
 
 void symmetrize_rule(uint64_t grule_size,
-                     uint8_t rule_array[grule_size], int, int);
+                     uint8_t rule_array[grule_size], int,
+                     const neighborhood_t*);
 
 void perturb_rule(uint64_t grule_size,
                   uint8_t rule_array[grule_size],
                   char rule_buf[grule_size + 1],
-                  int, int, double);
+                  int, const neighborhood_t*, double, enum RuleFamily);
 
 void cross_breed(uint64_t grule_size, uint8_t* parent_rule_A,
                  uint8_t* parent_rule_B, uint8_t* child,
                  char rule_buf[grule_size], double rate,
-                 int horizon, int states);
+                 const neighborhood_t* neighborhood, int states,
+                 enum RuleFamily family);
 
 void make_map(struct Options2D*, char*, int);
 
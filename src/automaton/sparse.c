@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "automaton/sparse.h"
+#include "automaton/kernels.h"
+
+#define EMPTY UINT64_MAX /* Key of the free slots, never a valid code */
+#define HEADER ((sizeof(sparse_rule_t) + 7) / 8 * 8)
+#define SLOT_BYTES (sizeof(uint64_t) + sizeof(uint8_t)) /* Key and output */
+#define MIN_CAPACITY 16
+#define IMAGES 8 /* Rotations and flips of a neighborhood */
+#define MAX_SIDE 7 /* Largest side with 64 bit codes (2 states) */
+
+typedef struct sparse_engine_s
+{
+  size_t size;
+  int horizon;
+  sparse_rule_t* rule;
+  uint64_t* keys;
+  uint8_t* outputs;
+  uint64_t weights[MAX_SIDE]; /**< Weight of the cells of a column code */
+  uint8_t* frame1;
+  uint8_t* frame2;
+  pool_t* pool; /**< Workers updating row bands, NULL when serial */
+  int n_scratch;
+  uint64_t** scratch; /**< Column codes of a row, per worker */
+} sparse_engine_t;
+
+static uint64_t* rule_keys(sparse_rule_t* r)
+{
+  return (uint64_t*) ((uint8_t*) r + HEADER);
+}
+
+static uint8_t* rule_outputs(sparse_rule_t* r)
+{
+  return (uint8_t*) &rule_keys(r)[r->capacity];
+}
+
+/** First slot probed for a code, Fibonacci hashing */
+static inline uint32_t first_slot(uint64_t code, uint32_t capacity)
+{
+  return (uint32_t) ((code * 0x9E3779B97F4A7C15ULL)
+                     >> (64 - __builtin_ctz(capacity)));
+}
+
+/** Slot holding the code, or the free slot where it would go */
+static inline uint32_t find_slot(uint64_t* keys, uint32_t capacity,
+                                 uint64_t code)
+{
+  uint32_t slot = first_slot(code, capacity);
+  while (keys[slot] != code && keys[slot] != EMPTY) {
+    slot = (slot + 1) & (capacity - 1);
+  }
+  return slot;
+}
+
+static uint32_t capacity_for(uint32_t transitions)
+{
+  uint32_t capacity = MIN_CAPACITY;
+  /* Keep the load under 1/2 for short probe sequences */
+  while (capacity < 2 * (uint64_t) transitions) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+uint64_t sparse_rule_bytes(uint32_t transitions)
+{
+  return HEADER + (uint64_t) capacity_for(transitions) * SLOT_BYTES;
+}
+
+static void clear_table(sparse_rule_t* r)
+{
+  uint64_t* keys = rule_keys(r);
+  for (uint32_t s = 0; s < r->capacity; ++s) {
+    keys[s] = EMPTY;
+  }
+  r->count = 0;
+}
+
+void sparse_rule_init(uint64_t bytes, uint8_t* rule, int states,
+                      int horizon)
+{
+  sparse_rule_t* r = (sparse_rule_t*) rule;
+  memset(r, 0, HEADER);
+  r->capacity = MIN_CAPACITY;
+  while (HEADER + 2 * (uint64_t) r->capacity * SLOT_BYTES <= bytes) {
+    r->capacity *= 2;
+  }
+  r->states = states;
+  r->horizon = horizon;
+  r->fallback = SPARSE_FALLBACK_CENTER;
+  clear_table(r);
+}
+
+uint8_t sparse_rule_get(uint8_t* rule, uint64_t code, uint8_t center)
+{
+  sparse_rule_t* r = (sparse_rule_t*) rule;
+  uint64_t* keys = rule_keys(r);
+  uint32_t slot = find_slot(keys, r->capacity, code);
+
+  if (keys[slot] == code) {
+    return rule_outputs(r)[slot];
+  }
+  return (r->fallback == SPARSE_FALLBACK_CENTER) ? center: r->fallback;
+}
+
+/** Codes of the neighborhood by the 8 rotations and flips */
+static void images(sparse_rule_t* r, uint64_t code, uint64_t out[IMAGES])
+{
+  int side = 2 * r->horizon + 1;
+  int n = side * side;
+  uint8_t digits[MAX_SIDE * MAX_SIDE];
+  uint64_t pows[MAX_SIDE * MAX_SIDE];
+
+  pows[0] = 1;
+  for (int p = 0; p < n; ++p) {
+    digits[p] = code % r->states;
+    code /= r->states;
+    if (p > 0) {
+      pows[p] = pows[p - 1] * r->states;
+    }
+  }
+
+  memset(out, 0, IMAGES * sizeof(uint64_t));
+  for (int k = 0; k < side; ++k) {
+    for (int l = 0; l < side; ++l) {
+      uint64_t d = digits[k * side + l];
+      int m = side - 1;
+      out[0] += d * pows[k * side + l];
+      out[1] += d * pows[l * side + m - k];
+      out[2] += d * pows[(m - k) * side + m - l];
+      out[3] += d * pows[(m - l) * side + k];
+      out[4] += d * pows[k * side + m - l];
+      out[5] += d * pows[(m - k) * side + l];
+      out[6] += d * pows[l * side + k];
+      out[7] += d * pows[(m - l) * side + m - k];
+    }
+  }
+}
+
+int sparse_rule_set(uint8_t* rule, uint64_t code, uint8_t output)
+{
+  sparse_rule_t* r = (sparse_rule_t*) rule;
+  uint64_t* keys = rule_keys(r);
+  uint8_t* outputs = rule_outputs(r);
+  uint64_t codes[IMAGES];
+  uint32_t added = 0;
+
+  images(r, code, codes);
+  for (int t = 0; t < IMAGES; ++t) {
+    added += keys[find_slot(keys, r->capacity, codes[t])] == EMPTY;
+  }
+  if (r->count + added > r->capacity / 4 * 3) {
+    return 0;
+  }
+
+  /* Images that coincide are found by the first insertion */
+  for (int t = 0; t < IMAGES; ++t) {
+    uint32_t slot = find_slot(keys, r->capacity, codes[t]);
+    r->count += keys[slot] == EMPTY;
+    keys[slot] = codes[t];
+    outputs[slot] = output;
+  }
+  return 1;
+}
+
+static double uniform(void)
+{
+  return (double)rand() / (double)((unsigned)RAND_MAX + 1);
+}
+
+/** Neighborhood with about `side` cells out of the background state 0 */
+static uint64_t random_code(sparse_rule_t* r)
+{
+  int side = 2 * r->horizon + 1;
+  uint64_t code = 0;
+
+  for (int p = side * side - 1; p >= 0; --p) {
+    code *= r->states;
+    if (uniform() * side < 1.) {
+      code += 1 + rand() % (r->states - 1);
+    }
+  }
+  return code;
+}
+
+/** Add up to n random transitions, as long as the table has room */
+static void add_random(sparse_rule_t* r, uint32_t n)
+{
+  for (uint32_t k = 0; k < n; ++k) {
+    if (!sparse_rule_set((uint8_t*) r, random_code(r), rand() % r->states)) {
+      return;
+    }
+  }
+}
+
+void sparse_generate(uint8_t* rule)
+{
+  sparse_rule_t* r = (sparse_rule_t*) rule;
+
+  clear_table(r);
+  r->fallback = SPARSE_FALLBACK_CENTER;
+  /* Each transition is set with its images */
+  add_random(r, r->capacity / 2 / IMAGES);
+}
+
+void sparse_perturb(uint8_t* rule, double rate)
+{
+  sparse_rule_t* r = (sparse_rule_t*) rule;
+  uint64_t* keys = rule_keys(r);
+  uint8_t* outputs = rule_outputs(r);
+
+  for (uint32_t s = 0; s < r->capacity; ++s) {
+    if (keys[s] != EMPTY && uniform() < rate) {
+      uint8_t output = (outputs[s] + 1 + rand() % (r->states - 1))
+        % r->states;
+      sparse_rule_set(rule, keys[s], output);
+    }
+  }
+
+  add_random(r, (uint32_t) (rate * r->count / IMAGES + uniform()));
+}
+
+void sparse_cross_breed(uint8_t* parent_A, uint8_t* parent_B, uint8_t* child,
+                        double rate)
+{
+  sparse_rule_t* a = (sparse_rule_t*) parent_A;
+  sparse_rule_t* b = (sparse_rule_t*) parent_B;
+  sparse_rule_t* c = (sparse_rule_t*) child;
+  uint64_t* keys_a = rule_keys(a);
+  uint64_t* keys_b = rule_keys(b);
+
+  memcpy(c, a, HEADER);
+  clear_table(c);
+  c->fallback = (uniform() < rate) ? a->fallback: b->fallback;
+
+  /* Transitions of A, the ones also in B coming from either parent */
+  for (uint32_t s = 0; s < a->capacity; ++s) {
+    if (keys_a[s] == EMPTY) {
+      continue;
+    }
+    uint32_t slot = find_slot(keys_b, b->capacity, keys_a[s]);
+    if (keys_b[slot] == EMPTY) {
+      if (uniform() < rate) {
+        sparse_rule_set(child, keys_a[s], rule_outputs(a)[s]);
+      }
+    }
+    else {
+      sparse_rule_set(child, keys_a[s], (uniform() < rate)
+                      ? rule_outputs(a)[s]: rule_outputs(b)[slot]);
+    }
+  }
+
+  /* Transitions of B only */
+  for (uint32_t s = 0; s < b->capacity; ++s) {
+    if (keys_b[s] == EMPTY) {
+      continue;
+    }
+    uint32_t slot = find_slot(keys_a, a->capacity, keys_b[s]);
+    if (keys_a[slot] == EMPTY && uniform() >= rate) {
+      sparse_rule_set(child, keys_b[s], rule_outputs(b)[s]);
+    }
+  }
+}
+
+void sparse_populate_buf(uint8_t* rule, char* buf, size_t buf_size)
+{
+  sparse_rule_t* r = (sparse_rule_t*) rule;
+  uint64_t* keys = rule_keys(r);
+  uint64_t codes[IMAGES];
+  size_t length;
+
+  length = snprintf(buf, buf_size, "%i", r->fallback);
+  for (uint32_t s = 0; s < r->capacity && length < buf_size; ++s) {
+    if (keys[s] == EMPTY) {
+      continue;
+    }
+
+    /* One transition per orbit, the one of the smallest code */
+    images(r, keys[s], codes);
+    int smallest = 1;
+    for (int t = 1; t < IMAGES; ++t) {
+      smallest &= codes[t] >= keys[s];
+    }
+    if (smallest) {
+      length += snprintf(&buf[length], buf_size - length, ";%lu:%i",
+                         (unsigned long) keys[s], rule_outputs(r)[s]);
+    }
+  }
+}
+
+static void sparse_band(void* data, void* in, void* out,
+                        size_t row_begin, size_t row_end, int worker)
+{
+  sparse_engine_t* e = (sparse_engine_t*) data;
+  size_t size = e->size;
+  int h = e->horizon;
+  int side = 2 * h + 1;
+  size_t pitch = size + 2 * h;
+  uint64_t states = e->rule->states;
+  uint32_t capacity = e->rule->capacity;
+  uint8_t fallback = e->rule->fallback;
+  uint64_t* codes = e->scratch[worker];
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* rows = &((uint8_t*) in)[i * pitch];
+    uint8_t* center = &rows[h * pitch + h];
+    uint8_t* row_out = &((uint8_t*) out)[(i + h) * pitch + h];
+
+    for (size_t c = 0; c < pitch; ++c) {
+      codes[c] = rows[c];
+    }
+    for (int k = 1; k < side; ++k) {
+      for (size_t c = 0; c < pitch; ++c) {
+        codes[c] += rows[k * pitch + c] * e->weights[k];
+      }
+    }
+
+    /* Runs of identical neighborhoods (backgrounds) reuse the last slot */
+    uint64_t last = EMPTY;
+    uint32_t slot = 0;
+    for (size_t j = 0; j < size; ++j) {
+      uint64_t code = codes[j + 2 * h];
+      for (int l = 2 * h - 1; l >= 0; --l) {
+        code = code * states + codes[j + l];
+      }
+
+      if (code != last) {
+        slot = find_slot(e->keys, capacity, code);
+        last = code;
+      }
+      if (e->keys[slot] == code) {
+        row_out[j] = e->outputs[slot];
+      }
+      else {
+        row_out[j] = (fallback == SPARSE_FALLBACK_CENTER)
+          ? center[j]: fallback;
+      }
+    }
+  }
+
+  refresh_halo_rows(size, (uint8_t*) out, h, row_begin, row_end);
+}
+
+static void sparse_step(engine_t* engine, long n)
+{
+  sparse_engine_t* e = (sparse_engine_t*) engine->data;
+  engine_run_bands(e->pool, sparse_band, e, e->size,
+                   (void**) &e->frame1, (void**) &e->frame2, n);
+}
+
+static void sparse_load(engine_t* engine, uint8_t* frame)
+{
+  sparse_engine_t* e = (sparse_engine_t*) engine->data;
+  pad_frame(e->size, e->horizon, frame, e->frame1);
+}
+
+static void sparse_store(engine_t* engine, uint8_t* frame)
+{
+  sparse_engine_t* e = (sparse_engine_t*) engine->data;
+  unpad_frame(e->size, e->horizon, e->frame1, frame);
+}
+
+static void sparse_free(engine_t* engine)
+{
+  sparse_engine_t* e = (sparse_engine_t*) engine->data;
+  if (e->pool) {
+    pool_free(e->pool);
+  }
+  for (int w = 0; w < e->n_scratch; ++w) {
+    free(e->scratch[w]);
+  }
+  free(e->scratch);
+  free(e->frame1);
+  free(e->frame2);
+  free(e);
+}
+
+engine_t* sparse_engine_new(uint8_t* rule, struct Options2D* opts,
+                            pool_t* pool)
+{
+  sparse_engine_t* e = (sparse_engine_t*) calloc(1, sizeof(sparse_engine_t));
+  int side = 2 * opts->horizon + 1;
+  size_t pitch = opts->size + 2 * opts->horizon;
+
+  e->size = opts->size;
+  e->horizon = opts->horizon;
+  e->rule = (sparse_rule_t*) rule;
+  e->keys = rule_keys(e->rule);
+  e->outputs = rule_outputs(e->rule);
+
+  /* Cell k of a column has weight states^(k * side) */
+  e->weights[0] = 1;
+  for (int k = 1; k < side; ++k) {
+    e->weights[k] = e->weights[k - 1];
+    for (int l = 0; l < side; ++l) {
+      e->weights[k] *= opts->states;
+    }
+  }
+
+  e->pool = pool;
+  e->frame1 = (uint8_t*) engine_alloc_rows(pool, pitch, pitch);
+  e->frame2 = (uint8_t*) engine_alloc_rows(pool, pitch, pitch);
+  e->n_scratch = pool ? pool_size(pool): 1;
+  e->scratch = (uint64_t**) malloc(e->n_scratch * sizeof(uint64_t*));
+  for (int w = 0; w < e->n_scratch; ++w) {
+    e->scratch[w] = (uint64_t*) malloc(pitch * sizeof(uint64_t));
+  }
+
+  engine_t* engine = (engine_t*) malloc(sizeof(engine_t));
+  engine->name = "sparse";
+  engine->data = e;
+  engine->load = sparse_load;
+  engine->step = sparse_step;
+  engine->store = sparse_store;
+  engine->activity = NULL;
+  engine->free = sparse_free;
+  engine->stats = NULL;
+  engine->state_hash = NULL;
+  return engine;
+}
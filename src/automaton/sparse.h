@@ -0,0 +1,87 @@
+#include <stdint.h>
+#include "automaton/engine.h"
+
+#ifndef SPARSE_H /* Include guard */
+#define SPARSE_H
+
+/** Fallback output of the neighborhoods keeping the state of their center */
+#define SPARSE_FALLBACK_CENTER 255
+
+/**
+ * @brief Rule storing only the transitions that are set.
+ *
+ * A sparse rule lives in a rule array of sparse_rule_bytes() bytes so that it
+ * is copied and bred like the full tables. The array starts with this header,
+ * followed by an open addressing hash table of `capacity` neighborhood codes
+ * (the index of the neighborhood in the full table, on 64 bits) and then
+ * their outputs. The neighborhoods without a transition map to `fallback`.
+ *
+ * Transitions are always set together with the 7 images of their
+ * neighborhood by the rotations and flips, like symmetrize_rule does for the
+ * full tables.
+ */
+typedef struct sparse_rule_s
+{
+  uint32_t capacity; /**< Number of slots of the table, a power of 2 */
+  uint32_t count; /**< Number of transitions set */
+  uint8_t states;
+  uint8_t horizon;
+  uint8_t fallback; /**< Output of the neighborhoods without a transition,
+                         or SPARSE_FALLBACK_CENTER */
+} sparse_rule_t;
+
+/** Size of the rule array of a sparse rule of up to n transitions */
+uint64_t sparse_rule_bytes(uint32_t transitions);
+
+/** Make the rule array an empty sparse rule */
+void sparse_rule_init(uint64_t bytes, uint8_t* rule, int states,
+                      int horizon);
+
+/** Output of the neighborhood of the given code and center state */
+uint8_t sparse_rule_get(uint8_t* rule, uint64_t code, uint8_t center);
+
+/**
+ * Set the output of the neighborhood and its images, returns 0 when the
+ * table is too full to hold them.
+ */
+int sparse_rule_set(uint8_t* rule, uint64_t code, uint8_t output);
+
+/**
+ * Random rule filling about half of the table with transitions of
+ * neighborhoods sampled around the background state 0, the other cells
+ * keeping their state.
+ */
+void sparse_generate(uint8_t* rule);
+
+/**
+ * Change the output of each transition with probability rate, and add rate
+ * times as many new transitions.
+ */
+void sparse_perturb(uint8_t* rule, double rate);
+
+/**
+ * Child with the transitions of both parents, taken from A with probability
+ * rate when both set them. The child has the capacity of A.
+ */
+void sparse_cross_breed(uint8_t* parent_A, uint8_t* parent_B, uint8_t* child,
+                        double rate);
+
+/**
+ * String representation of the rule: the fallback followed by one
+ * `code:output` per transition up to the symmetries, at most buf_size
+ * characters including the terminating null byte.
+ */
+void sparse_populate_buf(uint8_t* rule, char* buf, size_t buf_size);
+
+/**
+ * @brief Create the engine stepping sparse rules.
+ *
+ * The 64 bit code of each cell is built from column codes like
+ * update_step_sliding, then looked up in the hash table of the rule. Rows are
+ * split across the workers of `pool` if not NULL, the engine takes ownership
+ * of the pool.
+ */
+engine_t* sparse_engine_new(uint8_t* rule, struct Options2D* opts,
+                            pool_t* pool);
+
+#endif // SPARSE_H
@@ -0,0 +1,104 @@
+#include "automaton/specialized.h"
+#include "automaton/kernels.h"
+
+#define BLOCK 64 /* Cells whose indices are computed before the lookups */
+
+/** Rule shapes for which a kernel is generated, as X(states, horizon) */
+#define SPECIALIZED_KERNELS(X) \
+  X(2, 1) X(3, 1) X(4, 1) X(5, 1) X(6, 1) X(2, 2)
+
+/**
+ * Column code and Horner scheme of update_step_sliding. Once inlined with
+ * constant states and horizon, the loops over the neighborhood are unrolled
+ * and the powers folded, leaving the loops over the cells to vectorize. The
+ * rule lookups are done in a separate pass.
+ */
+static inline __attribute__((always_inline))
+void update_step_fixed(size_t size, uint8_t* autom, uint8_t* rule,
+                       uint8_t* last_autom, const int states,
+                       const int horizon, size_t row_begin, size_t row_end)
+{
+  const int side = 2 * horizon + 1;
+  size_t pitch = size + 2 * horizon;
+  uint32_t codes[pitch];
+  uint32_t index[BLOCK];
+
+  /* Weight of row k of a column is states^(k * side) */
+  uint32_t weights[side];
+  weights[0] = 1;
+  for (int k = 1; k < side; ++k) {
+    uint32_t w = weights[k - 1];
+    for (int l = 0; l < side; ++l) {
+      w *= states;
+    }
+    weights[k] = w;
+  }
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* rows = &last_autom[i * pitch];
+    uint8_t* out = &autom[(i + horizon) * pitch + horizon];
+
+    for (size_t c = 0; c < pitch; ++c) {
+      uint32_t code = 0;
+      for (int k = 0; k < side; ++k) {
+        code += rows[k * pitch + c] * weights[k];
+      }
+      codes[c] = code;
+    }
+
+    for (size_t j0 = 0; j0 < size; j0 += BLOCK) {
+      size_t n = (size - j0 < BLOCK) ? size - j0: BLOCK;
+      uint32_t* window = &codes[j0];
+
+      for (size_t j = 0; j < n; ++j) {
+        uint32_t position = window[j + 2 * horizon];
+        for (int l = 2 * horizon - 1; l >= 0; --l) {
+          position = position * states + window[j + l];
+        }
+        index[j] = position;
+      }
+      for (size_t j = 0; j < n; ++j) {
+        out[j0 + j] = rule[index[j]];
+      }
+    }
+  }
+
+  refresh_halo_rows(size, autom, horizon, row_begin, row_end);
+}
+
+#define DEFINE_KERNEL(S, H)                                             \
+  static void update_step_##S##_##H(size_t size, uint8_t* autom,        \
+                                    uint8_t* rule, uint8_t* last_autom, \
+                                    int horizon, uint32_t* pows,        \
+                                    size_t row_begin, size_t row_end)   \
+  {                                                                     \
+    (void)(horizon); /* Unused parameters */                            \
+    (void)(pows);                                                       \
+    update_step_fixed(size, autom, rule, last_autom, S, H,              \
+                      row_begin, row_end);                              \
+  }
+
+SPECIALIZED_KERNELS(DEFINE_KERNEL)
+
+typedef struct specialized_s
+{
+  int states;
+  int horizon;
+  ProcessF function;
+} specialized_t;
+
+#define TABLE_ENTRY(S, H) {S, H, update_step_##S##_##H},
+
+static const specialized_t kernels[] = {
+  SPECIALIZED_KERNELS(TABLE_ENTRY)
+};
+
+ProcessF specialized_kernel(int states, int horizon)
+{
+  for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+    if (kernels[k].states == states && kernels[k].horizon == horizon) {
+      return kernels[k].function;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,18 @@
+#include <stdint.h>
+#include "automaton/2d_automaton.h"
+
+#ifndef SPECIALIZED_H /* Include guard */
+#define SPECIALIZED_H
+
+/**
+ * @brief Update step kernel specialized for a number of states and horizon.
+ *
+ * The kernels are generated for the rule shapes whose table fits in memory
+ * (2 to 6 states with horizon 1, 2 states with horizon 2), with the powers of
+ * the states and the neighborhood loops as compile time constants so that
+ * the index computation is unrolled and vectorized. They ignore the `pows`
+ * argument. Returns NULL when no kernel matches.
+ */
+ProcessF specialized_kernel(int states, int horizon);
+
+#endif // SPECIALIZED_H
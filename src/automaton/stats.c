@@ -0,0 +1,111 @@
+#include <string.h>
+#include "automaton/stats.h"
+#include "utils/cycle.h"
+
+#define GOLDEN 0x9E3779B97F4A7C15ULL
+
+/** Finalizer of splitmix64, spreads the hash of a row over the 64 bits */
+static inline uint64_t scramble(uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+void stats_clear(step_stats_t* s)
+{
+  memset(s, 0, sizeof(step_stats_t));
+  s->changed = -1;
+  s->row_min = (size_t) -1;
+  s->col_min = (size_t) -1;
+}
+
+void stats_rows(step_stats_t* s, size_t size, int horizon, int states,
+                uint8_t* frame, uint8_t* last, size_t row_begin,
+                size_t row_end)
+{
+  size_t pitch = size + 2 * horizon;
+  uint64_t changed = 0;
+  /* Interleaved histograms so that runs of a state do not wait on the
+     previous increment of the same bin */
+  uint32_t counts[4][states];
+
+  memset(counts, 0, sizeof(counts));
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* row = &frame[(i + horizon) * pitch + horizon];
+    size_t j = 0, occupied = 0;
+
+    for (; j + 4 <= size; j += 4) {
+      counts[0][row[j]]++;
+      counts[1][row[j + 1]]++;
+      counts[2][row[j + 2]]++;
+      counts[3][row[j + 3]]++;
+    }
+    for (; j < size; ++j) {
+      counts[0][row[j]]++;
+    }
+
+    for (j = 0; j < size; ++j) {
+      occupied += row[j] != 0;
+    }
+    if (last) {
+      uint8_t* last_row = &last[(i + horizon) * pitch + horizon];
+      for (j = 0; j < size; ++j) {
+        changed += row[j] != last_row[j];
+      }
+    }
+
+    /* Only the rows out of the background are searched for the columns */
+    if (occupied > 0) {
+      size_t first = 0, end = size;
+      while (row[first] == 0) {
+        ++first;
+      }
+      while (row[end - 1] == 0) {
+        --end;
+      }
+      s->row_min = (i < s->row_min) ? i: s->row_min;
+      s->row_max = (i > s->row_max) ? i: s->row_max;
+      s->col_min = (first < s->col_min) ? first: s->col_min;
+      s->col_max = (end - 1 > s->col_max) ? end - 1: s->col_max;
+    }
+
+    s->hash += scramble(frame_hash(size, row) + (i + 1) * GOLDEN);
+  }
+
+  for (int k = 0; k < states; ++k) {
+    s->histogram[k] += counts[0][k] + counts[1][k] + counts[2][k]
+      + counts[3][k];
+  }
+  if (last) {
+    s->changed = (s->changed < 0 ? 0: s->changed) + changed;
+  }
+}
+
+void stats_merge(step_stats_t* into, step_stats_t* part)
+{
+  for (int k = 0; k < STATS_STATES; ++k) {
+    into->histogram[k] += part->histogram[k];
+  }
+  if (part->changed >= 0) {
+    into->changed = (into->changed < 0 ? 0: into->changed) + part->changed;
+  }
+  /* Empty boxes are (-1, 0, -1, 0) so they are merged like the others */
+  into->row_min = (part->row_min < into->row_min) ? part->row_min
+    : into->row_min;
+  into->row_max = (part->row_max > into->row_max) ? part->row_max
+    : into->row_max;
+  into->col_min = (part->col_min < into->col_min) ? part->col_min
+    : into->col_min;
+  into->col_max = (part->col_max > into->col_max) ? part->col_max
+    : into->col_max;
+  into->hash += part->hash;
+}
+
+void frame_stats(step_stats_t* s, size_t size, int states, uint8_t* frame,
+                 uint8_t* last)
+{
+  stats_clear(s);
+  stats_rows(s, size, 0, states, frame, last, 0, size);
+}
@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef STATS_H /* Include guard */
+#define STATS_H
+
+#define STATS_STATES 256 /* Histogram bins, one per possible cell value */
+
+/**
+ * @brief Statistics of one generation of the automaton.
+ *
+ * The lookup table engines compute them in the sweep of their last
+ * generation, a few rows at a time right after updating them, so the
+ * measurements need no extra pass over the frame. The other engines leave
+ * them to frame_stats on the stored frame.
+ */
+typedef struct step_stats_s
+{
+  uint64_t histogram[STATS_STATES]; /**< Number of cells in each state */
+  int64_t changed; /**< Cells that changed over the last generation, -1
+                      when the previous generation is not known */
+  size_t row_min; /**< Bounding box of the cells out of the background
+                     state 0, row_min > row_max when there are none */
+  size_t row_max;
+  size_t col_min;
+  size_t col_max;
+  uint64_t hash; /**< Hash of the frame, independent of the row order in
+                    which it is accumulated */
+  int fused; /**< Set by the engines that computed them in their step */
+} step_stats_t;
+
+void stats_clear(step_stats_t*);
+
+/**
+ * Accumulate the rows [row_begin, row_end) of a padded frame (see
+ * automaton/kernels.h) whose cells are below `states`, counting the changes
+ * against the padded frame `last` if not NULL. A horizon of 0 reads a flat
+ * frame. At most 2^32 cells per call.
+ */
+void stats_rows(step_stats_t*, size_t size, int horizon, int states,
+                uint8_t* frame, uint8_t* last, size_t row_begin,
+                size_t row_end);
+
+/** Add the statistics of disjoint rows of the same frame */
+void stats_merge(step_stats_t* into, step_stats_t* part);
+
+/**
+ * Statistics of a flat size x size frame in one pass, the changes being
+ * counted against the flat frame `last` if not NULL.
+ */
+void frame_stats(step_stats_t*, size_t size, int states, uint8_t* frame,
+                 uint8_t* last);
+
+#endif // STATS_H
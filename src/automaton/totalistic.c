@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <string.h>
+#include "automaton/totalistic.h"
+
+typedef struct totalistic_s
+{
+  size_t size;
+  int horizon;
+  uint8_t* rule;
+  uint32_t weights[256]; /**< Weight of each state in the box sums */
+  uint32_t offsets[256]; /**< Rule index of the box sum 0 per center state */
+  uint32_t scale; /**< Rule index increment per unit of box sum */
+  uint8_t* grid;
+  uint8_t* next;
+  pool_t* pool; /**< Workers updating row bands, NULL when serial */
+  int n_scratch;
+  uint32_t** scratch; /**< Row sums, column sums and padded row weights, per
+                           worker */
+} totalistic_t;
+
+/** Running sum of the weights over the 2h + 1 cells around each cell */
+static void row_sums(totalistic_t* t, uint8_t* row, uint32_t* padded,
+                     uint32_t* sums)
+{
+  size_t size = t->size;
+  size_t h = t->horizon;
+  size_t side = 2 * h + 1;
+
+  /* The row wraps around, h cells on each side */
+  for (size_t k = 0; k < h; ++k) {
+    padded[k] = t->weights[row[size - h + k]];
+    padded[size + h + k] = t->weights[row[k]];
+  }
+  for (size_t j = 0; j < size; ++j) {
+    padded[h + j] = t->weights[row[j]];
+  }
+
+  uint32_t sum = 0;
+  for (size_t k = 0; k < side; ++k) {
+    sum += padded[k];
+  }
+  sums[0] = sum;
+  for (size_t j = 1; j < size; ++j) {
+    sum += padded[j + 2 * h] - padded[j - 1];
+    sums[j] = sum;
+  }
+}
+
+static void totalistic_band(void* data, void* in, void* out,
+                            size_t row_begin, size_t row_end, int worker)
+{
+  totalistic_t* t = (totalistic_t*) data;
+  uint8_t* grid = (uint8_t*) in;
+  size_t size = t->size;
+  size_t h = t->horizon;
+  size_t slots = 2 * h + 2;
+  uint32_t scale = t->scale;
+
+  /* The row sums of the rows [i - h, i + h + 1] are kept in a ring, row r
+     (shifted by h to stay positive) being in slot r % slots */
+  uint32_t* ring = t->scratch[worker];
+  uint32_t* columns = &ring[slots * size];
+  uint32_t* padded = &columns[size];
+
+  if (row_begin == row_end) {
+    return;
+  }
+
+  memset(columns, 0, size * sizeof(uint32_t));
+  for (size_t r = row_begin; r < row_begin + 2 * h + 1; ++r) {
+    uint32_t* sums = &ring[(r % slots) * size];
+    row_sums(t, &grid[((r + size - h) % size) * size], padded, sums);
+    for (size_t j = 0; j < size; ++j) {
+      columns[j] += sums[j];
+    }
+  }
+
+  for (size_t i = row_begin; i < row_end; ++i) {
+    uint8_t* row = &grid[i * size];
+    uint8_t* row_out = &((uint8_t*) out)[i * size];
+
+    for (size_t j = 0; j < size; ++j) {
+      row_out[j] = t->rule[columns[j] * scale + t->offsets[row[j]]];
+    }
+
+    if (i + 1 == row_end) {
+      break;
+    }
+
+    /* Slide the column sums down by one row */
+    uint32_t* first = &ring[(i % slots) * size];
+    uint32_t* last = &ring[((i + 2 * h + 1) % slots) * size];
+    row_sums(t, &grid[((i + h + 1) % size) * size], padded, last);
+    for (size_t j = 0; j < size; ++j) {
+      columns[j] += last[j] - first[j];
+    }
+  }
+}
+
+static void totalistic_step(engine_t* engine, long n)
+{
+  totalistic_t* t = (totalistic_t*) engine->data;
+  engine_run_bands(t->pool, totalistic_band, t, t->size,
+                   (void**) &t->grid, (void**) &t->next, n);
+}
+
+static void totalistic_load(engine_t* engine, uint8_t* frame)
+{
+  totalistic_t* t = (totalistic_t*) engine->data;
+  memcpy(t->grid, frame, t->size * t->size * sizeof(uint8_t));
+}
+
+static void totalistic_store(engine_t* engine, uint8_t* frame)
+{
+  totalistic_t* t = (totalistic_t*) engine->data;
+  memcpy(frame, t->grid, t->size * t->size * sizeof(uint8_t));
+}
+
+static void totalistic_free(engine_t* engine)
+{
+  totalistic_t* t = (totalistic_t*) engine->data;
+  if (t->pool) {
+    pool_free(t->pool);
+  }
+  for (int w = 0; w < t->n_scratch; ++w) {
+    free(t->scratch[w]);
+  }
+  free(t->scratch);
+  free(t->grid);
+  free(t->next);
+  free(t);
+}
+
+engine_t* totalistic_engine_new(uint8_t* rule, struct Options2D* opts,
+                                pool_t* pool)
+{
+  totalistic_t* t = (totalistic_t*) calloc(1, sizeof(totalistic_t));
+  size_t size = opts->size;
+  int side = 2 * opts->horizon + 1;
+
+  t->size = size;
+  t->horizon = opts->horizon;
+  t->rule = rule;
+
+  if (opts->family == FAMILY_OUTER) {
+    /* The center is counted by the box sum and removed by the offset */
+    uint32_t weight = 1;
+    t->scale = opts->states;
+    for (int s = 1; s < opts->states; ++s) {
+      t->weights[s] = weight;
+      weight *= side * side;
+    }
+    for (int s = 0; s < opts->states; ++s) {
+      t->offsets[s] = s - t->scale * t->weights[s];
+    }
+  }
+  else {
+    t->scale = 1;
+    for (int s = 0; s < opts->states; ++s) {
+      t->weights[s] = s;
+    }
+  }
+
+  t->pool = pool;
+  t->grid = (uint8_t*) engine_alloc_rows(pool, size, size);
+  t->next = (uint8_t*) engine_alloc_rows(pool, size, size);
+  t->n_scratch = pool ? pool_size(pool): 1;
+  t->scratch = (uint32_t**) malloc(t->n_scratch * sizeof(uint32_t*));
+  for (int w = 0; w < t->n_scratch; ++w) {
+    t->scratch[w] = (uint32_t*)
+      malloc(((side + 3) * size + 2 * opts->horizon) * sizeof(uint32_t));
+  }
+
+  engine_t* engine = (engine_t*) malloc(sizeof(engine_t));
+  engine->name = "totalistic";
+  engine->data = t;
+  engine->load = totalistic_load;
+  engine->step = totalistic_step;
+  engine->store = totalistic_store;
+  engine->activity = NULL;
+  engine->free = totalistic_free;
+  engine->stats = NULL;
+  engine->state_hash = NULL;
+  return engine;
+}
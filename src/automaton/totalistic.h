@@ -0,0 +1,24 @@
+#include <stdint.h>
+#include "automaton/engine.h"
+
+#ifndef TOTALISTIC_H /* Include guard */
+#define TOTALISTIC_H
+
+/**
+ * @brief Create an engine for the rules of the totalistic families.
+ *
+ * With FAMILY_TOTALISTIC the next state of a cell is rule[t] where t is the
+ * sum of the states of its (2h + 1)^2 neighborhood, center included. With
+ * FAMILY_OUTER it is rule[c + states * n] where c is the state of the cell
+ * and n = sum over s >= 1 of count_s * side^(2 (s - 1)), count_s being the
+ * number of neighbors (center excluded) in state s.
+ *
+ * Both sums are box filters of a per state weight, computed with running
+ * sums along the rows then along the columns, so the cost per cell does not
+ * depend on the horizon. Rows are split across the workers of `pool` if not
+ * NULL, the engine takes ownership of the pool.
+ */
+engine_t* totalistic_engine_new(uint8_t* rule, struct Options2D* opts,
+                                pool_t* pool);
+
+#endif // TOTALISTIC_H
@@ -124,7 +124,9 @@ void write_to_file(size_t size, size_t rule_size, uint8_t rule[rule_size],
                 states, options->radius);
   }
   print_bits_spaced(size, final, final_output);
-  end_comp_size = compress_memory_size(final_output, size);
+  compressor_t* compressor = compressor_new(Z_BEST_COMPRESSION,
+                                           Z_DEFAULT_STRATEGY);
+  end_comp_size = compressor_size(compressor, final_output, size);
 
   for (v = 0; v < steps; ++v) {
 
@@ -139,12 +141,12 @@ void write_to_file(size_t size, size_t rule_size, uint8_t rule[rule_size],
                 rule, states, options->radius);
 
     if (v % options->grain == 0) {
-      comp_size = compress_memory_size(spaced_output, size);
+      comp_size = compressor_size(compressor, spaced_output, size);
 
       fprintf(out_file, "%lu    %i    %i\n", v, comp_size,
               dbl_comp_size);
       sprintf(dbl_ouput, "%s%s", spaced_output, final_output);
-      dbl_comp_size = compress_memory_size(dbl_ouput, 2 * size);
+      dbl_comp_size = compressor_size(compressor, dbl_ouput, 2 * size);
 
       if (options->write == WRITE_STEP) {
         write_step(size, rule_size, A, rule, v, states);
@@ -156,6 +158,7 @@ void write_to_file(size_t size, size_t rule_size, uint8_t rule[rule_size],
     }
   }
   printf("%i\t%i\t%i", end_comp_size, comp_size, dbl_comp_size);
+  compressor_free(compressor);
   fclose(out_file);
   fclose(out_steps_file);
 }
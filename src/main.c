@@ -8,9 +8,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "automaton/2d_automaton.h"
+#include "automaton/engine.h"
 #include "automaton/rule.h"
+#include "automaton/sparse.h"
 #include "automaton/wolfram_automaton.h"
 #include "utils/utils.h"
+#include "search/calibrate.h"
 #include "search/genetic.h"
 
 #define MAJOR 0
@@ -80,7 +83,40 @@ Options:\n\
     -m --temp_output        Do a step-only output for visualization.\n\
     -e --no_early_stopping  Disable stopping when periodic.\n\
     -q --masking            Enable masking of the input.\n\
-    -c --compress           Disable compression of outputs.\n";
+    -c --compress           Disable compression of outputs.\n\
+    -k --engine=<e>         Stepping engine: auto, general, sliding,\n\
+                            specialized, gather, bitslice, packed3,\n\
+                            hashlife, active, plane, circuit,\n\
+                            compiled, compact or masked\n\
+                            [default: auto].\n\
+    -p --threads=<n>        Number of threads stepping the automaton\n\
+                            [default: 1].\n\
+    -u --time_block=<k>     Generations advanced per cache tile by the\n\
+                            general and sliding engines [default: 1].\n\
+    -l --lockstep           Advance the rules of a search generation\n\
+                            together in a batch.\n\
+    -a --ensemble=<k>       Simulate k seeds of each rule together and\n\
+                            average their metrics [default: 1].\n\
+    -d --horizon=<h>        Radius of the neighborhood [default: 1].\n\
+    -N --neighborhood=<n>   Cells read by the rule: moore, vonneumann,\n\
+                            hex or a list of offsets dy:dx,dy:dx,...\n\
+                            [default: moore].\n\
+    -y --family=<f>         Rule family: table, totalistic, outer (outer\n\
+                            totalistic) or sparse [default: table].\n\
+    -x --transitions=<n>    Transitions of the random sparse rules\n\
+                            [default: 4096].\n\
+    -E --estimator=<e>      Compressed size estimator: zlib, packed, lz77\n\
+                            or context [default: zlib].\n\
+    -J --joint=<c>          Compressor of the joint complexity: deflate\n\
+                            or long, whose window spans several frames\n\
+                            [default: deflate].\n\
+    -P --compress_threads=<n>\n\
+                            Threads computing the compressed sizes while\n\
+                            the automaton is stepped [default: 0].\n\
+    -C --calibrate=<csv>    Correlate the estimators with the\n\
+                            compressed_len column of a training set.\n\
+    -M --maps=<dir>         Rule files of the training set\n\
+                            [default: maps/train].\n";
 
   char one_input[] = "Provide only one input, either -i rule (for inline) or -f"
     " rule_file (for a file).\n";
@@ -88,6 +124,29 @@ Options:\n\
     " transitions found but %"PRIu64" were expected.\n";
   char too_large_init[] = "Initialization zone size is too large: %l was given"
     " but size is %lu.\n";
+  char invalid_engine[] = "Invalid value \"%s\" for engine option."
+    " Must be one of \"auto\", \"general\", \"sliding\", \"specialized\","
+    " \"gather\", \"bitslice\", \"packed3\", \"hashlife\", \"active\","
+    " \"plane\", \"circuit\", \"compiled\", \"compact\", \"masked\"\n";
+  char invalid_family[] = "Invalid value \"%s\" for family option."
+    " Must be one of \"table\", \"totalistic\", \"outer\", \"sparse\"\n";
+  char unsupported_family[] = "Rules of this family run on their own engine"
+    " and need a grid larger than their neighborhood.\n";
+  char sparse_input[] = "Sparse rules can only be generated.\n";
+  char too_large_rule[] = "Rules with %i states and horizon %i are too large"
+    " for this family.\n";
+  char invalid_neighborhood[] = "Invalid value \"%s\" for neighborhood option."
+    " Must be one of \"moore\", \"vonneumann\", \"hex\" or a list of offsets"
+    " such as \"-1:0,0:-1,0:0,0:1,1:0\"\n";
+  char unsupported_neighborhood[] = "The %s neighborhood is only supported by"
+    " lookup table rules with the auto, general or masked engines.\n";
+  char unsupported_engine[] = "Engine \"%s\" does not support %i states with"
+    " horizon %i on a grid of size %lu.\n";
+  char invalid_estimator[] = "Invalid value \"%s\" for estimator option."
+    " Must be one of \"zlib\", \"packed\", \"lz77\", \"context\"\n";
+  char invalid_joint[] = "Invalid value \"%s\" for joint option."
+    " Must be one of \"deflate\", \"long\"\n";
+  char calibrate_family[] = "Calibration reads lookup table rules.\n";
   char base_dir_name[] = "data_2d_%i";
 
   extern char *optarg;
@@ -97,6 +156,10 @@ Options:\n\
   int compress_flag = 1;
   char* input_rule;
   char* input_fname = NULL;
+  char* engine_name = "auto";
+  char* neighborhood_arg = "moore";
+  char* calibrate_fname = NULL;
+  char* maps_dir = "maps/train";
 
   struct Options2D opts;
   opts.size = 256;
@@ -114,6 +177,16 @@ Options:\n\
   opts.output_data = OUTPUT;
   opts.init_type = -1;
   opts.init_pattern_file = NULL;
+  opts.engine = ENGINE_AUTO;
+  opts.threads = 1;
+  opts.time_block = 1;
+  opts.lockstep = 0;
+  opts.ensemble = 1;
+  opts.family = FAMILY_TABLE;
+  opts.transitions = 4096;
+  opts.estimator = ESTIMATOR_ZLIB;
+  opts.joint_compressor = JOINT_DEFLATE;
+  opts.compress_threads = 0;
 
   while (1) {
     static struct option long_options[] = {
@@ -135,6 +208,20 @@ Options:\n\
        {"output", required_argument, 0, 'o'},
        {"pattern", required_argument, 0, 'j'},
        {"init_type", required_argument, 0, 'b'},
+       {"engine", required_argument, 0, 'k'},
+       {"threads", required_argument, 0, 'p'},
+       {"time_block", required_argument, 0, 'u'},
+       {"lockstep", no_argument, 0, 'l'},
+       {"ensemble", required_argument, 0, 'a'},
+       {"horizon", required_argument, 0, 'd'},
+       {"family", required_argument, 0, 'y'},
+       {"transitions", required_argument, 0, 'x'},
+       {"neighborhood", required_argument, 0, 'N'},
+       {"estimator", required_argument, 0, 'E'},
+       {"joint", required_argument, 0, 'J'},
+       {"compress_threads", required_argument, 0, 'P'},
+       {"calibrate", required_argument, 0, 'C'},
+       {"maps", required_argument, 0, 'M'},
        {0, 0, 0, 0}
     };
 
@@ -142,7 +229,7 @@ Options:\n\
     int option_index = 0;
 
     c = getopt_long (argc - 1, &argv[1],
-                     "hvn:i:s:t:g:cz:f:mw:ero:qj:",
+                     "hvn:i:s:t:g:cz:f:mw:ero:qj:k:p:u:la:d:y:x:N:E:J:P:C:M:",
                      long_options, &option_index);
 
     /* Detect the end of the options. */
@@ -214,6 +301,124 @@ Options:\n\
     case 'b':
       opts.init_type = atol(optarg);
       break;
+    case 'k':
+      engine_name = optarg;
+      if (strcmp("auto", optarg) == 0) {
+        opts.engine = ENGINE_AUTO;
+      }
+      else if (strcmp("general", optarg) == 0) {
+        opts.engine = ENGINE_GENERAL;
+      }
+      else if (strcmp("sliding", optarg) == 0) {
+        opts.engine = ENGINE_SLIDING;
+      }
+      else if (strcmp("specialized", optarg) == 0) {
+        opts.engine = ENGINE_SPECIALIZED;
+      }
+      else if (strcmp("gather", optarg) == 0) {
+        opts.engine = ENGINE_GATHER;
+      }
+      else if (strcmp("bitslice", optarg) == 0) {
+        opts.engine = ENGINE_BITSLICE;
+      }
+      else if (strcmp("packed3", optarg) == 0) {
+        opts.engine = ENGINE_PACKED3;
+      }
+      else if (strcmp("hashlife", optarg) == 0) {
+        opts.engine = ENGINE_HASHLIFE;
+      }
+      else if (strcmp("active", optarg) == 0) {
+        opts.engine = ENGINE_ACTIVE;
+      }
+      else if (strcmp("plane", optarg) == 0) {
+        opts.engine = ENGINE_PLANE;
+      }
+      else if (strcmp("circuit", optarg) == 0) {
+        opts.engine = ENGINE_CIRCUIT;
+      }
+      else if (strcmp("compiled", optarg) == 0) {
+        opts.engine = ENGINE_COMPILED;
+      }
+      else if (strcmp("compact", optarg) == 0) {
+        opts.engine = ENGINE_COMPACT;
+      }
+      else if (strcmp("masked", optarg) == 0) {
+        opts.engine = ENGINE_MASKED;
+      }
+      else {
+        fprintf(stderr, invalid_engine, optarg);
+        err = 1;
+      }
+      break;
+    case 'p':
+      opts.threads = atoi(optarg);
+      break;
+    case 'u':
+      opts.time_block = atoi(optarg);
+      break;
+    case 'l':
+      opts.lockstep = 1;
+      break;
+    case 'a':
+      opts.ensemble = atoi(optarg);
+      break;
+    case 'd':
+      opts.horizon = atoi(optarg);
+      break;
+    case 'y':
+      if (strcmp("table", optarg) == 0) {
+        opts.family = FAMILY_TABLE;
+      }
+      else if (strcmp("totalistic", optarg) == 0) {
+        opts.family = FAMILY_TOTALISTIC;
+      }
+      else if (strcmp("outer", optarg) == 0) {
+        opts.family = FAMILY_OUTER;
+      }
+      else if (strcmp("sparse", optarg) == 0) {
+        opts.family = FAMILY_SPARSE;
+      }
+      else {
+        fprintf(stderr, invalid_family, optarg);
+        err = 1;
+      }
+      break;
+    case 'x':
+      opts.transitions = atoi(optarg);
+      break;
+    case 'N':
+      neighborhood_arg = optarg;
+      break;
+    case 'E':
+      if (estimator_parse(optarg) < 0) {
+        fprintf(stderr, invalid_estimator, optarg);
+        err = 1;
+      }
+      else {
+        opts.estimator = estimator_parse(optarg);
+      }
+      break;
+    case 'J':
+      if (strcmp("deflate", optarg) == 0) {
+        opts.joint_compressor = JOINT_DEFLATE;
+      }
+      else if (strcmp("long", optarg) == 0) {
+        opts.joint_compressor = JOINT_LONG;
+      }
+      else {
+        fprintf(stderr, invalid_joint, optarg);
+        err = 1;
+      }
+      break;
+    case 'P':
+      opts.compress_threads = atoi(optarg);
+      break;
+    case 'C':
+      calibrate_fname = optarg;
+      break;
+    case 'M':
+      maps_dir = optarg;
+      break;
     case 'h':
       fprintf(stdout, usage, argv[0]);
       exit(EXIT_SUCCESS);
@@ -233,6 +438,36 @@ Options:\n\
     }
   }
 
+  /* Named shapes take the radius of -d, lists of offsets set it */
+  if (!neighborhood_parse(&opts.neighborhood, neighborhood_arg,
+                          opts.horizon)) {
+    fprintf(stderr, invalid_neighborhood, neighborhood_arg);
+    fprintf(stderr, usage, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  opts.horizon = opts.neighborhood.horizon;
+
+  if (opts.neighborhood.shape != SHAPE_MOORE
+      && (opts.family != FAMILY_TABLE
+          || (opts.engine != ENGINE_AUTO && opts.engine != ENGINE_GENERAL
+              && opts.engine != ENGINE_MASKED))) {
+    fprintf(stderr, unsupported_neighborhood,
+            neighborhood_name(&opts.neighborhood));
+    exit(EXIT_FAILURE);
+  }
+
+  if (!engine_supported(opts.engine, opts.states, opts.horizon, opts.size)) {
+    fprintf(stderr, unsupported_engine, engine_name, opts.states,
+            opts.horizon, opts.size);
+    exit(EXIT_FAILURE);
+  }
+
+  if (opts.family != FAMILY_TABLE
+      && (opts.engine != ENGINE_AUTO || opts.size <= 2 * opts.horizon)) {
+    fprintf(stderr, "%s", unsupported_family);
+    exit(EXIT_FAILURE);
+  }
+
   create_tree(&opts, base_dir_name);
 
   /* Check init zone is smaller than the size of the automaton */
@@ -244,15 +479,38 @@ Options:\n\
   time_t t;
   srand((unsigned)time(&t));
 
-  const int side = 2 * opts.horizon + 1; /* Sidelength of neighborhood */
-  const int neigh_size = side * side - 1; /* Total number of neighbors */
   /* Size of rule */
-  const uint64_t grule_size = (int) pow(opts.states, neigh_size + 1);
+  const uint64_t grule_size = rule_size(&opts);
+  if (grule_size == 0) {
+    fprintf(stderr, too_large_rule, opts.states, opts.horizon);
+    exit(EXIT_FAILURE);
+  }
 
   /* These arrays can be very big and are therefore allocated on the heap */
   char* rule_buf = malloc((grule_size + 1) * sizeof(char));
   uint8_t* rule_array = malloc(grule_size * sizeof(uint8_t));
 
+  if (calibrate_fname) {
+    if (opts.family != FAMILY_TABLE) {
+      fprintf(stderr, "%s", calibrate_family);
+      exit(EXIT_FAILURE);
+    }
+    calibrate_estimators(calibrate_fname, maps_dir, timesteps, grule_size,
+                         &opts);
+    free(rule_array);
+    free(rule_buf);
+    neighborhood_free(&opts.neighborhood);
+    return 0;
+  }
+
+  if (opts.family == FAMILY_SPARSE) {
+    if (input_flag) {
+      fprintf(stderr, "%s", sparse_input);
+      exit(EXIT_FAILURE);
+    }
+    sparse_rule_init(grule_size, rule_array, opts.states, opts.horizon);
+  }
+
 
   /* If input was given, it was either directly inline or via a file */
   if (input_fname) {
@@ -296,7 +554,7 @@ Options:\n\
     results_nn_t res;
     /* This should not be necessary if the provided rule is already symmetric */
     /* TODO: Add possibility to work with either type */
-    symmetrize_rule(grule_size, rule_array, opts.states, opts.horizon);
+    symmetrize_rule(grule_size, rule_array, opts.states, &opts.neighborhood);
 
     make_map(&opts, rule_buf, 0);
 
@@ -304,6 +562,7 @@ Options:\n\
     process_rule(grule_size, rule_array, rule_buf, timesteps, &opts, &res);
     free(rule_array);
     free(rule_buf);
+    neighborhood_free(&opts.neighborhood);
     return 0;
   }
 
@@ -318,7 +577,7 @@ Options:\n\
   else {
     for (int i = 0; i < n_simulations; ++i) {
       generate_general_rule(grule_size, rule_array, rule_buf,
-                            opts.states, opts.horizon);
+                            opts.states, &opts.neighborhood, opts.family);
 
       make_map(&opts, rule_buf, i);
 
@@ -331,6 +590,7 @@ Options:\n\
   printf("\n");
   free(rule_array);
   free(rule_buf);
+  neighborhood_free(&opts.neighborhood);
   return EXIT_SUCCESS;
 }
 
@@ -66,17 +66,23 @@ void shuffle_index(size_t num_pattern, size_t random_idx[num_pattern])
   }
 }
 
+/** Cells of the window read by the network, all but the center */
+static int window_inputs(neighborhood_t* window)
+{
+  return window->cells - (neighborhood_find(window, 0, 0) >= 0);
+}
+
 /**
  * This function fills the input and target vector with the list of training
- * examples from automaton.
+ * examples from automaton, the inputs being the cells of the window.
  */
 void fill_input_target(size_t size, double* input, uint8_t* target,
-                       uint8_t* automaton, int offset, int states)
+                       uint8_t* automaton, neighborhood_t* window,
+                       int states)
 {
   size_t index;
   int counter;
-  int side = 2 * offset + 1;
-  int num_input = states * (side * side - 1);
+  int num_input = states * window_inputs(window);
   uint8_t val;
 
   for (size_t i = 0; i < size; ++i) {
@@ -87,15 +93,15 @@ void fill_input_target(size_t size, double* input, uint8_t* target,
       /* Add bias in the main vector */
       input[index * (num_input + 1)] = 1.0;
 
-      for (int a = -offset; a < offset + 1; ++a) {
-        for (int b = -offset; b < offset + 1; ++b) {
-          if (a != 0 || b != 0) {  /* Don't take index i,j */
-            val = automaton[((i + a + size) % size) * size
-                            + ((j + b + size) % size)];
-            for (uint8_t s = 0; s < states; ++s) {
-              input[index * (num_input + 1) + counter] = (val == s) ? 1.: 0.;
-              counter++;
-            }
+      for (int p = 0; p < window->cells; ++p) {
+        int a = window->dy[p];
+        int b = window->dx[p];
+        if (a != 0 || b != 0) {  /* Don't take index i,j */
+          val = automaton[((i + a + size) % size) * size
+                          + ((j + b + size) % size)];
+          for (uint8_t s = 0; s < states; ++s) {
+            input[index * (num_input + 1) + counter] = (val == s) ? 1.: 0.;
+            counter++;
           }
         }
       }
@@ -450,8 +456,9 @@ void train_nn_on_automaton(size_t size, int states,
   }
 
   size_t num_pattern = size * size;
-  int side = 2 * opts->offset + 1;
-  int num_input = states * (side * side - 1);
+  neighborhood_t window;
+  neighborhood_init(&window, opts->shape, opts->offset);
+  int num_input = states * window_inputs(&window);
   int num_hidden = opts->num_hid;
   int num_output = states;
 
@@ -473,7 +480,7 @@ void train_nn_on_automaton(size_t size, int states,
   uint8_t* target = (uint8_t *) malloc(num_pattern * sizeof(uint8_t));
   /* Fill those arrays with the automaton's content */
   fill_input_target(size, base_input, target,
-                    train_automaton, opts->offset, states);
+                    train_automaton, &window, states);
 
   /* Arrays for the test data */
   double* test_input =
@@ -585,8 +592,9 @@ void train_nn_on_automaton(size_t size, int states,
 
   /* Compute Fisher information if the flag requires it */
   if (opts->fisher == FISHER) {
-    res->fisher_info = compute_fisher(states, (side*side - 1), num_pattern,
-                                      num_output, num_hidden, num_input,
+    res->fisher_info = compute_fisher(states, window_inputs(&window),
+                                      num_pattern, num_output, num_hidden,
+                                      num_input,
                                       base_input, weight_ih, weight_ho);
   }
 
@@ -596,7 +604,7 @@ void train_nn_on_automaton(size_t size, int states,
     for (int i = 0; i < n_tests; ++i) {
       /* Fill the placeholders with test data */
       fill_input_target(size, test_input, test_target,
-                        test_automata[i], opts->offset, states);
+                        test_automata[i], &window, states);
 
       /* Compute error on the test set */
       test_errors[i] = compute_error(num_pattern, num_output, num_hidden,
@@ -640,5 +648,6 @@ void train_nn_on_automaton(size_t size, int states,
   free(test_input);
   free(test_target);
   free(delta_w_ih_prev);
+  neighborhood_free(&window);
   free(delta_w_ho_prev);
 }
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "automaton/neighborhood.h"
 
 enum OptimType { MOMENTUM, ADAM, NESTEROV, SGD };
 enum LRDecay { NO_DECAY, DECAY };
@@ -15,6 +16,8 @@ typedef struct network_opts_s
   enum LRDecay decay;
   enum FisherInfo fisher;
   int verbosity;
+  enum NeighborhoodShape shape; /**< Shape of the input window, of radius
+                                   offset */
 } network_opts_t;
 
 typedef struct network_result_s
@@ -0,0 +1,244 @@
+#define _GNU_SOURCE /* asprintf */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "automaton/engine.h"
+#include "automaton/rule.h"
+#include "search/calibrate.h"
+#include "utils/estimator.h"
+
+typedef struct val_idx_s
+{
+  double value;
+  int index;
+} val_idx_t;
+
+static int cmp_value(const void* a, const void* b)
+{
+  double va = ((val_idx_t*) a)->value;
+  double vb = ((val_idx_t*) b)->value;
+  return (va > vb) - (va < vb);
+}
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1E-9;
+}
+
+/** Field of a CSV line at the given column, empty fields included */
+static char* csv_field(char* line, int column)
+{
+  for (int k = 0; k < column; ++k) {
+    line = strchr(line, ',');
+    if (line == NULL) {
+      return NULL;
+    }
+    ++line;
+  }
+  line[strcspn(line, ",\r\n")] = '\0';
+  return line;
+}
+
+/** Column of the header whose name is `name`, -1 if there is none */
+static int csv_column(const char* header, const char* name)
+{
+  size_t length = strlen(name);
+  int column = 0;
+
+  while (1) {
+    if (strncmp(header, name, length) == 0
+        && strchr(",\r\n", header[length]) != NULL) {
+      return column;
+    }
+    header = strchr(header, ',');
+    if (header == NULL) {
+      return -1;
+    }
+    ++header;
+    ++column;
+  }
+}
+
+static double pearson(int n, double* x, double* y)
+{
+  double mx = 0., my = 0., sxy = 0., sxx = 0., syy = 0.;
+
+  for (int k = 0; k < n; ++k) {
+    mx += x[k] / n;
+    my += y[k] / n;
+  }
+  for (int k = 0; k < n; ++k) {
+    sxy += (x[k] - mx) * (y[k] - my);
+    sxx += (x[k] - mx) * (x[k] - mx);
+    syy += (y[k] - my) * (y[k] - my);
+  }
+  return (sxx > 0 && syy > 0) ? sxy / sqrt(sxx * syy): 0.;
+}
+
+/** Ranks of the values, tied values sharing their mean rank */
+static void ranks(int n, double* values, double* out)
+{
+  val_idx_t* sorted = (val_idx_t*) malloc(n * sizeof(val_idx_t));
+
+  for (int k = 0; k < n; ++k) {
+    sorted[k].value = values[k];
+    sorted[k].index = k;
+  }
+  qsort(sorted, n, sizeof(val_idx_t), cmp_value);
+
+  for (int k = 0; k < n;) {
+    int end = k + 1;
+    while (end < n && sorted[end].value == sorted[k].value) {
+      ++end;
+    }
+    for (int l = k; l < end; ++l) {
+      out[sorted[l].index] = (k + end - 1) / 2.;
+    }
+    k = end;
+  }
+  free(sorted);
+}
+
+static double spearman(int n, double* x, double* y)
+{
+  double* rx = (double*) malloc(n * sizeof(double));
+  double* ry = (double*) malloc(n * sizeof(double));
+
+  ranks(n, x, rx);
+  ranks(n, y, ry);
+  double rho = pearson(n, rx, ry);
+  free(rx);
+  free(ry);
+  return rho;
+}
+
+/** Read the rule of a map file, returns 0 if missing or of the wrong size */
+static int read_map(const char* fname, uint64_t grule_size, uint8_t* rule)
+{
+  FILE* map_file = fopen(fname, "r");
+  uint64_t count = 0;
+  int c;
+
+  if (map_file == NULL) {
+    return 0;
+  }
+  while ((c = getc(map_file)) != EOF && count < grule_size) {
+    rule[count++] = (uint8_t)(c - '0');
+  }
+  fclose(map_file);
+  return count == grule_size;
+}
+
+void calibrate_estimators(const char* csv_fname, const char* maps_dir,
+                          long steps, uint64_t grule_size,
+                          struct Options2D* opts)
+{
+  FILE* csv_file = fopen(csv_fname, "r");
+  if (csv_file == NULL) {
+    fprintf(stderr, "Error opening file %s\n", csv_fname);
+    exit(EXIT_FAILURE);
+  }
+
+  char* line = NULL;
+  size_t line_size = 0;
+  int id_column = -1, len_column = -1;
+  if (getline(&line, &line_size, csv_file) > 0) {
+    id_column = csv_column(line, "ID");
+    len_column = csv_column(line, "compressed_len");
+  }
+  if (id_column < 0 || len_column < 0) {
+    fprintf(stderr, "No ID and compressed_len columns in %s\n", csv_fname);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t size = opts->size;
+  uint8_t* rule = (uint8_t*) malloc(grule_size * sizeof(uint8_t));
+  uint8_t* frame = (uint8_t*) malloc(size * size * sizeof(uint8_t));
+  compressor_t* compressor = compressor_new(Z_BEST_COMPRESSION,
+                                            Z_DEFAULT_STRATEGY);
+  estimator_t* estimators[ESTIMATORS];
+  for (int t = 0; t < ESTIMATORS; ++t) {
+    estimators[t] = estimator_new(t, size, opts->states, compressor);
+  }
+
+  int capacity = 256, n = 0, rows = 0;
+  double* reference = (double*) malloc(capacity * sizeof(double));
+  double* sizes[ESTIMATORS];
+  double elapsed[ESTIMATORS] = {0};
+  for (int t = 0; t < ESTIMATORS; ++t) {
+    sizes[t] = (double*) malloc(capacity * sizeof(double));
+  }
+
+  while (getline(&line, &line_size, csv_file) > 0) {
+    /* Fields are cut out of the line, the length is read from a copy */
+    char* copy = strdup(line);
+    char* len_field = csv_field(copy, len_column);
+    double len = len_field ? atof(len_field): 0.;
+    char* id = csv_field(line, id_column);
+    free(copy);
+    if (id == NULL || len_field == NULL) {
+      continue;
+    }
+    ++rows;
+
+    char* map_fname;
+    asprintf(&map_fname, "%s/%s.map", maps_dir, id);
+    int found = read_map(map_fname, grule_size, rule);
+    free(map_fname);
+    if (!found) {
+      continue;
+    }
+
+    if (n == capacity) {
+      capacity *= 2;
+      reference = (double*) realloc(reference, capacity * sizeof(double));
+      for (int t = 0; t < ESTIMATORS; ++t) {
+        sizes[t] = (double*) realloc(sizes[t], capacity * sizeof(double));
+      }
+    }
+    reference[n] = len;
+
+    symmetrize_rule(grule_size, rule, opts->states, &opts->neighborhood);
+    init_automat(size, frame, opts->states, opts->init_type);
+    engine_t* engine = engine_new(grule_size, rule, opts);
+    engine->load(engine, frame);
+    engine->step(engine, steps);
+    engine->store(engine, frame);
+    engine_free(engine);
+
+    printf("%s  %.0f", id, len);
+    for (int t = 0; t < ESTIMATORS; ++t) {
+      double start = now();
+      sizes[t][n] = estimator_size(estimators[t], frame);
+      elapsed[t] += now() - start;
+      printf("  %.0f", sizes[t][n]);
+    }
+    printf("\n");
+    ++n;
+  }
+
+  printf("Found %i of the %i rules of %s in %s\n", n, rows, csv_fname,
+         maps_dir);
+  if (n > 1) {
+    printf("%-10s%12s%12s%12s\n", "estimator", "pearson", "spearman",
+           "ms/frame");
+    for (int t = 0; t < ESTIMATORS; ++t) {
+      printf("%-10s%12.4f%12.4f%12.4f\n", estimator_name(t),
+             pearson(n, sizes[t], reference),
+             spearman(n, sizes[t], reference), 1E3 * elapsed[t] / n);
+    }
+  }
+
+  for (int t = 0; t < ESTIMATORS; ++t) {
+    estimator_free(estimators[t]);
+    free(sizes[t]);
+  }
+  compressor_free(compressor);
+  free(reference);
+  free(line);
+  free(frame);
+  free(rule);
+  fclose(csv_file);
+}
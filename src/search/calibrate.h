@@ -0,0 +1,19 @@
+#include <stdint.h>
+#include "automaton/2d_automaton.h"
+
+#ifndef CALIBRATE_H /* Include guard */
+#define CALIBRATE_H
+
+/**
+ * Compare the compressed size estimators (see utils/estimator.h) with the
+ * compressed_len column of a training set such as data/train_data.csv, whose
+ * rules are read from <maps_dir>/<ID>.map. Each rule is simulated for
+ * `steps` generations from a random frame and every estimator measures the
+ * last frame. Prints the Pearson and Spearman correlations of each estimator
+ * with the column and its time per frame.
+ */
+void calibrate_estimators(const char* csv_fname, const char* maps_dir,
+                          long steps, uint64_t grule_size,
+                          struct Options2D* opts);
+
+#endif // CALIBRATE_H
@@ -46,7 +46,7 @@ void iterative_search(int n_simulations, int input_flag,
 
   int population_size = 5;
   int n_children = 10;
-  results_nn_t res = {0, 0, 0, 0, 0, 0};
+  int n_rules = population_size * (n_children + 1);
 
   uint8_t** population = (uint8_t**) malloc(sizeof(uint8_t *)
                                             * population_size);
@@ -60,11 +60,17 @@ void iterative_search(int n_simulations, int input_flag,
     (val_idx_t*) malloc(sizeof(val_idx_t) *
                          population_size * (n_children + 1));
 
+  /* Rules of a generation in the order of `results` */
+  uint8_t** batch_rules = (uint8_t**) malloc(sizeof(uint8_t*) * n_rules);
+  char** rule_names = (char**) malloc(sizeof(char*) * n_rules);
+  results_nn_t* batch_res =
+    (results_nn_t*) malloc(sizeof(results_nn_t) * n_rules);
+
   for (int i = 0; i < n_simulations; ++i) {
     /* Initialize rule */
     if (i == 0 && input_flag == 0) {
       generate_general_rule(grule_size, rule_array, rule_buf,
-                            opts->states, opts->horizon);
+                            opts->states, &opts->neighborhood, opts->family);
     }
     /* Initialize search */
     if (i == 0) {
@@ -94,7 +100,7 @@ void iterative_search(int n_simulations, int input_flag,
 
 
         perturb_rule(grule_size, population[k], rule_buf, opts->states,
-                     opts->horizon, 10 * RATE);
+                     &opts->neighborhood, 10 * RATE, opts->family);
 
         /* Allocate space for childrenrules */
         for (int d = 0; d < n_children; ++d) {
@@ -104,53 +110,58 @@ void iterative_search(int n_simulations, int input_flag,
       }
     }
 
+    /* Breed the whole generation first so that it can be simulated in
+       lockstep, rule k * (n_children + 1) + n_children being parent k and
+       the ones before it its children */
     for (int k = 0; k < population_size; ++k) {
-      /* Compute results for the parents */
+      int parent = k * (n_children + 1) + n_children;
 
-      populate_buf(grule_size, population[k], rule_buf);
+      populate_buf(grule_size, population[k], rule_buf, opts->family);
       make_map(opts, rule_buf, i);
+      rule_names[parent] = strdup(rule_buf);
+      batch_rules[parent] = population[k];
 
-      res.nn_tr_5 = 1.;
-      res.nn_tr_50 = 0.;
-      res.nn_tr_300 = 1.;
-      res.nn_te_5 = 1.;
-      res.nn_te_50 = 1.;
-      res.nn_te_300 = 1.;
-
-      process_rule(grule_size, population[k],
-                   rule_buf, timesteps,
-                   opts, &res);
-
-      results[k * (n_children + 1) + n_children].index =
-        k * (n_children + 1) + n_children;
-      results[k * (n_children + 1) + n_children].value = compute_score(&res);
-
-      /* Compute results for children */
       for (int d = 0; d < n_children; ++d) {
         int rule_A = rand() % population_size;
         int rule_B = rand() % population_size;
 
         cross_breed(grule_size, population[rule_A], population[rule_B],
-                    children[k * n_children + d], rule_buf, .5, opts->horizon,
-                    opts->states);
+                    children[k * n_children + d], rule_buf, .5,
+                    &opts->neighborhood, opts->states, opts->family);
 
         make_map(opts, rule_buf, i);
+        rule_names[k * (n_children + 1) + d] = strdup(rule_buf);
+        batch_rules[k * (n_children + 1) + d] = children[k * n_children + d];
+      }
+    }
 
-        res.nn_tr_5 = 1.;
-        res.nn_tr_50 = 0.;
-        res.nn_tr_300 = 1.;
-        res.nn_te_5 = 1.;
-        res.nn_te_50 = 1.;
-        res.nn_te_300 = 1.;
-
-        process_rule(grule_size, children[k * n_children + d],
-                     rule_buf, timesteps, opts, &res);
+    for (int r = 0; r < n_rules; ++r) {
+      batch_res[r].nn_tr_5 = 1.;
+      batch_res[r].nn_tr_50 = 0.;
+      batch_res[r].nn_tr_300 = 1.;
+      batch_res[r].nn_te_5 = 1.;
+      batch_res[r].nn_te_50 = 1.;
+      batch_res[r].nn_te_300 = 1.;
+    }
 
-        results[k * (n_children + 1) + d].index = k * (n_children + 1) + d;
-        results[k * (n_children + 1) + d].value = compute_score(&res);
+    /* Ensembles already fill a batch per rule */
+    if (opts->lockstep && opts->ensemble <= 1) {
+      process_rule_batch(n_rules, batch_rules, rule_names, timesteps, opts,
+                         batch_res);
+    }
+    else {
+      for (int r = 0; r < n_rules; ++r) {
+        process_rule(grule_size, batch_rules[r], rule_names[r], timesteps,
+                     opts, &batch_res[r]);
       }
     }
 
+    for (int r = 0; r < n_rules; ++r) {
+      results[r].index = r;
+      results[r].value = compute_score(&batch_res[r]);
+      free(rule_names[r]);
+    }
+
     /* Keep the best `population_size` results */
     qsort(results,
           (n_children + 1) * population_size,
@@ -165,7 +176,8 @@ void iterative_search(int n_simulations, int input_flag,
       if ((index % (n_children + 1)) == n_children) {
         populate_buf(grule_size,
                      population[index / (n_children + 1)],
-                     rule_buf);
+                     rule_buf,
+                     opts->family);
 
         fprintf(stdout, "p:%lu %f  ",
                 hash(rule_buf),
@@ -180,7 +192,8 @@ void iterative_search(int n_simulations, int input_flag,
           n_children * (index / (n_children + 1));
         populate_buf(grule_size,
                      children[child_index],
-                     rule_buf);
+                     rule_buf,
+                     opts->family);
 
         fprintf(stdout, "c:%lu %f  ",
                 hash(rule_buf),
@@ -196,7 +209,7 @@ void iterative_search(int n_simulations, int input_flag,
     for (int k = 0; k < population_size; ++ k) {
       memcpy(population[k], tmp_pop[k], sizeof(uint8_t) * grule_size);
 
-      populate_buf(grule_size, population[k], rule_buf);
+      populate_buf(grule_size, population[k], rule_buf, opts->family);
       fprintf(genealogy_file, "%lu:%f\t",
               hash(rule_buf),
               results[k].value);
@@ -215,6 +228,9 @@ void iterative_search(int n_simulations, int input_flag,
   }
   fclose(genealogy_file);
   free(results);
+  free(batch_rules);
+  free(rule_names);
+  free(batch_res);
   free(tmp_pop);
   free(genealogy_fname);
   free(population);
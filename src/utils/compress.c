@@ -45,15 +45,91 @@ void compress_in_memory(void* in_data, size_t in_data_size,
 }
 
 
+struct compressor_s
+{
+  z_stream strm;
+  uint8_t sink[COMPRESSOR_SINK];
+};
+
+compressor_t* compressor_new(int level, int strategy)
+{
+  compressor_t* c = (compressor_t*) calloc(1, sizeof(compressor_t));
+  int res = deflateInit2(&c->strm, level, Z_DEFLATED, MAX_WBITS, 8, strategy);
+  assert(res == Z_OK);
+  (void)(res); /* Unused without assertions */
+  return c;
+}
+
+int compressor_size(compressor_t* c, void* data, size_t size)
+{
+  z_stream* strm = &c->strm;
+  int res;
+
+  deflateReset(strm);
+  strm->next_in = (uint8_t*) data;
+  strm->avail_in = size;
+  strm->data_type = Z_TEXT;
+
+  /* Same flushes as compress_in_memory, which the sizes must match */
+  do {
+    strm->next_out = c->sink;
+    strm->avail_out = COMPRESSOR_SINK;
+    res = deflate(strm, (strm->avail_in != 0) ? Z_NO_FLUSH: Z_FINISH);
+  } while (res == Z_OK);
+
+  assert(res == Z_STREAM_END);
+  return (int) strm->total_out;
+}
+
+void compressor_reset(compressor_t* c)
+{
+  deflateReset(&c->strm);
+  c->strm.data_type = Z_TEXT;
+}
+
+/** Run deflate on the pending input with the given flush mode */
+static int compressor_deflate(compressor_t* c, int flush)
+{
+  z_stream* strm = &c->strm;
+  int res;
+
+  /* Output stops short of filling the sink once everything is flushed */
+  do {
+    strm->next_out = c->sink;
+    strm->avail_out = COMPRESSOR_SINK;
+    res = deflate(strm, flush);
+  } while (res == Z_OK && (strm->avail_in != 0 || strm->avail_out == 0));
+  return res;
+}
+
+void compressor_feed(compressor_t* c, void* data, size_t size)
+{
+  c->strm.next_in = (uint8_t*) data;
+  c->strm.avail_in = size;
+  int res = compressor_deflate(c, Z_NO_FLUSH);
+  assert(res == Z_OK || res == Z_BUF_ERROR);
+  (void)(res); /* Unused without assertions */
+}
+
+long compressor_flushed_size(compressor_t* c)
+{
+  int res = compressor_deflate(c, Z_SYNC_FLUSH);
+  assert(res == Z_OK || res == Z_BUF_ERROR);
+  (void)(res); /* Unused without assertions */
+  return (long) c->strm.total_out;
+}
+
+void compressor_free(compressor_t* c)
+{
+  deflateEnd(&c->strm);
+  free(c);
+}
+
 int compress_memory_size(void *in_data, size_t in_data_size)
 {
-  const size_t BUFSIZE = 256 * 256 * 256;
-  uint8_t* temp_buffer = malloc(sizeof(char) * BUFSIZE);
-  z_stream strm = {};
-  compress_in_memory(in_data, in_data_size, BUFSIZE, temp_buffer, &strm);
-  int compressed_size = BUFSIZE - strm.avail_out;
-  deflateEnd(&strm);
-  free(temp_buffer);
+  compressor_t* c = compressor_new(Z_BEST_COMPRESSION, Z_DEFAULT_STRATEGY);
+  int compressed_size = compressor_size(c, in_data, in_data_size);
+  compressor_free(c);
 
   return compressed_size;
 }
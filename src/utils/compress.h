@@ -1,9 +1,58 @@
 #include <stdlib.h>
 #include <stdint.h>
+#include "zlib.h"
 
 #ifndef COMPRESS_H   /* Include guard */
 #define COMPRESS_H
 
+/** Bytes of the ring buffer receiving the discarded output of a compressor */
+#define COMPRESSOR_SINK (1 << 14)
+
+/**
+ * @brief Reusable deflate context measuring compressed sizes.
+ *
+ * The stream is initialized once and reset between two inputs, and its
+ * output goes to a small ring buffer that is overwritten as it fills, only
+ * the number of bytes written being kept. A context is used by one thread at
+ * a time, so concurrent evaluators each own one.
+ */
+typedef struct compressor_s compressor_t;
+
+/**
+ * Create a context compressing with a zlib level (Z_BEST_COMPRESSION for the
+ * metrics) and strategy (Z_DEFAULT_STRATEGY, Z_FILTERED, ...).
+ */
+compressor_t* compressor_new(int level, int strategy);
+
+/** Size of the data once compressed */
+int compressor_size(compressor_t*, void* data, size_t size);
+
+/**
+ * Start a new stream, which is then fed with compressor_feed and whose
+ * compressed size is read with compressor_flushed_size.
+ */
+void compressor_reset(compressor_t*);
+
+/**
+ * Append data to the stream. It is compressed along with the data fed
+ * before, within the 32 KB window of deflate, and not retained.
+ */
+void compressor_feed(compressor_t*, void* data, size_t size);
+
+/**
+ * Compressed size of the data fed since the last reset. The pending output
+ * is flushed to a byte boundary with Z_SYNC_FLUSH, which keeps the window so
+ * that the next data still refers to the previous one, at the cost of a few
+ * bytes per call.
+ */
+long compressor_flushed_size(compressor_t*);
+
+void compressor_free(compressor_t*);
+
+/**
+ * One-off compressed size at Z_BEST_COMPRESSION. Measurements repeated in a
+ * loop should reuse a compressor_t instead.
+ */
 int compress_memory_size(void*, size_t);
 
 void compress_rule(char* rule_buf, uint8_t* out_buf, size_t buf_size);
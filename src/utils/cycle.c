@@ -0,0 +1,78 @@
+#include <string.h>
+#include "cycle.h"
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+
+void cycle_init(cycle_t* c)
+{
+  memset(c, 0, sizeof(cycle_t));
+  c->power = 1;
+}
+
+int cycle_push(cycle_t* c, long step, uint64_t hash)
+{
+  if (c->period > 0) {
+    return 0;
+  }
+
+  /* Most recent states first, for the smallest period */
+  long last = c->n < CYCLE_RING ? c->n: CYCLE_RING;
+  for (long k = 1; k <= last; ++k) {
+    int slot = (c->n - k) % CYCLE_RING;
+    if (c->ring[slot] == hash) {
+      c->period = step - c->ring_steps[slot];
+      c->transient = c->ring_steps[slot];
+      return 1;
+    }
+  }
+
+  if (c->n > 0 && c->saved == hash) {
+    c->period = step - c->saved_step;
+    c->transient = c->saved_step;
+    return 1;
+  }
+
+  c->ring[c->n % CYCLE_RING] = hash;
+  c->ring_steps[c->n % CYCLE_RING] = step;
+  if (++c->n == c->power) {
+    c->saved = hash;
+    c->saved_step = step;
+    c->power *= 2;
+  }
+  return 0;
+}
+
+static inline uint64_t mix(uint64_t h, uint64_t w)
+{
+  h += w * PRIME2;
+  h = (h << 31) | (h >> 33);
+  return h * PRIME1;
+}
+
+uint64_t frame_hash(size_t n, uint8_t* frame)
+{
+  /* Four independent lanes so that the multiplications overlap */
+  uint64_t h[4] = {PRIME1 + PRIME2, PRIME2, 0, -PRIME1};
+  uint64_t w;
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    for (int l = 0; l < 4; ++l) {
+      memcpy(&w, &frame[i + 8 * l], sizeof(uint64_t));
+      h[l] = mix(h[l], w);
+    }
+  }
+
+  uint64_t r = n;
+  for (int l = 0; l < 4; ++l) {
+    r = mix(r, h[l]);
+  }
+  for (; i < n; ++i) {
+    r = mix(r, frame[i]);
+  }
+  r ^= r >> 33;
+  r *= PRIME2;
+  r ^= r >> 29;
+  return r;
+}
@@ -0,0 +1,45 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef CYCLE_H /* Include guard */
+#define CYCLE_H
+
+#define CYCLE_RING 64 /* Number of recent states compared with a new one */
+
+/**
+ * @brief Detection of the cycle entered by a trajectory.
+ *
+ * The states of the trajectory are pushed as 64 bit hashes with their step.
+ * A state is compared with the CYCLE_RING last ones, which gives the period
+ * and transient length of short cycles as soon as the trajectory enters
+ * them, and with a state saved at push counts growing in powers of 2
+ * (Brent's algorithm), which catches the longer cycles with a transient only
+ * known up to the step of the saved state.
+ *
+ * The period found is the distance between two equal states: it is exact
+ * when every step is pushed and a multiple of the period otherwise.
+ */
+typedef struct cycle_s
+{
+  uint64_t ring[CYCLE_RING];
+  long ring_steps[CYCLE_RING];
+  long n; /**< Number of states pushed */
+  uint64_t saved; /**< State saved by Brent's algorithm */
+  long saved_step;
+  long power; /**< Push count at which the next state is saved */
+  long period; /**< Period of the cycle, 0 until one is found */
+  long transient; /**< Step at which the cycle was entered */
+} cycle_t;
+
+void cycle_init(cycle_t*);
+
+/**
+ * Push the state at the given step, return 1 when it closes a cycle for the
+ * first time, setting the period and transient.
+ */
+int cycle_push(cycle_t*, long step, uint64_t hash);
+
+/** 64 bit hash of n bytes */
+uint64_t frame_hash(size_t n, uint8_t* frame);
+
+#endif // CYCLE_H
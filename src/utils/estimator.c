@@ -0,0 +1,222 @@
+#include <math.h>
+#include <string.h>
+#include "utils/estimator.h"
+
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_MATCH 259
+#define LZ_WINDOW 65535
+#define LZ_LITERAL_BITS 9 /* Flag and byte */
+#define LZ_MATCH_BITS 25 /* Flag, 16 bits of offset and 8 of length */
+
+static const char* estimator_names[ESTIMATORS] = {
+  "zlib", "packed", "lz77", "context"
+};
+
+struct estimator_s
+{
+  enum EstimatorType type;
+  size_t size;
+  int states;
+  compressor_t* compressor;
+  int bits; /**< Bits of a packed cell */
+  size_t row_bytes; /**< Bytes of a packed row */
+  uint8_t* buffer; /**< Text or packed cells of the frame */
+  uint32_t* table; /**< Last position + 1 of each hash (lz77) or counts of
+                      each context and state (context) */
+  int order; /**< Causal neighbors in a context */
+  size_t contexts;
+};
+
+estimator_t* estimator_new(enum EstimatorType type, size_t size, int states,
+                           compressor_t* compressor)
+{
+  estimator_t* e = (estimator_t*) calloc(1, sizeof(estimator_t));
+
+  e->type = type;
+  e->size = size;
+  e->states = states;
+  e->compressor = compressor;
+  e->bits = 1;
+  while ((1 << e->bits) < states) {
+    e->bits *= 2;
+  }
+  e->row_bytes = (size * e->bits + 7) / 8;
+
+  switch (type) {
+  case ESTIMATOR_ZLIB:
+    e->buffer = (uint8_t*) malloc((size + 1) * size);
+    break;
+  case ESTIMATOR_PACKED:
+    e->buffer = (uint8_t*) malloc(size * e->row_bytes);
+    break;
+  case ESTIMATOR_LZ77:
+    e->buffer = (uint8_t*) malloc(size * e->row_bytes);
+    e->table = (uint32_t*) malloc((1 << LZ_HASH_BITS) * sizeof(uint32_t));
+    break;
+  case ESTIMATOR_CONTEXT:
+    e->order = CONTEXT_ORDER;
+    e->contexts = 1;
+    for (int k = 0; k < e->order; ++k) {
+      e->contexts *= states;
+    }
+    while (e->order > 0 && e->contexts * states > CONTEXT_MAX_COUNTS) {
+      --e->order;
+      e->contexts /= states;
+    }
+    e->table = (uint32_t*) malloc(e->contexts * states * sizeof(uint32_t));
+    break;
+  }
+  return e;
+}
+
+/** Frame as printed by print_bits, without the final '\0' */
+static void print_text(estimator_t* e, uint8_t* frame)
+{
+  size_t size = e->size;
+
+  for (size_t i = 0; i < size; ++i) {
+    for (size_t j = 0; j < size; ++j) {
+      e->buffer[i * (size + 1) + j] = '0' + frame[i * size + j];
+    }
+    e->buffer[i * (size + 1) + size] = '\n';
+  }
+}
+
+/** Cells on `bits` bits, the first cell in the low bits, rows byte aligned */
+static void pack_cells(estimator_t* e, uint8_t* frame)
+{
+  size_t size = e->size;
+  int per_byte = 8 / e->bits;
+
+  memset(e->buffer, 0, size * e->row_bytes);
+  for (size_t i = 0; i < size; ++i) {
+    uint8_t* cells = &frame[i * size];
+    uint8_t* out = &e->buffer[i * e->row_bytes];
+    for (size_t j = 0; j < size; ++j) {
+      out[j / per_byte] |= cells[j] << ((j % per_byte) * e->bits);
+    }
+  }
+}
+
+static inline uint32_t lz_hash(uint8_t* p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/** Bits of the greedy LZ77 parse of the n bytes of the buffer */
+static uint64_t lz77_bits(estimator_t* e, size_t n)
+{
+  uint8_t* data = e->buffer;
+  uint64_t bits = 0;
+  size_t i = 0;
+
+  memset(e->table, 0, (1 << LZ_HASH_BITS) * sizeof(uint32_t));
+  while (i + LZ_MIN_MATCH <= n) {
+    uint32_t h = lz_hash(&data[i]);
+    size_t candidate = e->table[h];
+    e->table[h] = i + 1;
+
+    if (candidate > 0 && i + 1 - candidate <= LZ_WINDOW
+        && memcmp(&data[candidate - 1], &data[i], LZ_MIN_MATCH) == 0) {
+      /* Byte by byte, a match may overlap the bytes it copies */
+      size_t from = candidate - 1;
+      size_t length = LZ_MIN_MATCH;
+      while (i + length < n && length < LZ_MAX_MATCH
+             && data[from + length] == data[i + length]) {
+        ++length;
+      }
+      bits += LZ_MATCH_BITS;
+      i += length;
+    }
+    else {
+      bits += LZ_LITERAL_BITS;
+      ++i;
+    }
+  }
+  return bits + (n - i) * LZ_LITERAL_BITS;
+}
+
+/** Code length in bits of the cells with the adaptive context model */
+static double context_bits(estimator_t* e, uint8_t* frame)
+{
+  static const int dy[CONTEXT_ORDER] = {0, -1, -1, -1};
+  static const int dx[CONTEXT_ORDER] = {-1, 0, -1, 1};
+  long size = e->size;
+  int states = e->states;
+  uint32_t* counts = e->table;
+
+  memset(counts, 0, e->contexts * states * sizeof(uint32_t));
+  for (long i = 0; i < size; ++i) {
+    for (long j = 0; j < size; ++j) {
+      size_t context = 0;
+      /* Neighbors out of the frame are in state 0 */
+      for (int k = e->order - 1; k >= 0; --k) {
+        long y = i + dy[k];
+        long x = j + dx[k];
+        uint8_t s = (y >= 0 && x >= 0 && x < size) ? frame[y * size + x]: 0;
+        context = context * states + s;
+      }
+      ++counts[context * states + frame[i * size + j]];
+    }
+  }
+
+  /* The KT code length of a context only depends on its final counts */
+  double half = lgamma(0.5);
+  double nats = 0.;
+  for (size_t c = 0; c < e->contexts; ++c) {
+    uint32_t* n = &counts[c * states];
+    uint64_t total = 0;
+    for (int s = 0; s < states; ++s) {
+      if (n[s] > 0) {
+        nats -= lgamma(n[s] + 0.5) - half;
+      }
+      total += n[s];
+    }
+    if (total > 0) {
+      nats += lgamma(total + states / 2.) - lgamma(states / 2.);
+    }
+  }
+  return nats / M_LN2;
+}
+
+int estimator_size(estimator_t* e, uint8_t* frame)
+{
+  switch (e->type) {
+  case ESTIMATOR_ZLIB:
+    print_text(e, frame);
+    return compressor_size(e->compressor, e->buffer, (e->size + 1) * e->size);
+  case ESTIMATOR_PACKED:
+    pack_cells(e, frame);
+    return compressor_size(e->compressor, e->buffer, e->size * e->row_bytes);
+  case ESTIMATOR_LZ77:
+    pack_cells(e, frame);
+    return (int) ((lz77_bits(e, e->size * e->row_bytes) + 7) / 8);
+  default:
+    return (int) ceil(context_bits(e, frame) / 8.);
+  }
+}
+
+void estimator_free(estimator_t* e)
+{
+  free(e->buffer);
+  free(e->table);
+  free(e);
+}
+
+int estimator_parse(const char* name)
+{
+  for (int t = 0; t < ESTIMATORS; ++t) {
+    if (strcmp(estimator_names[t], name) == 0) {
+      return t;
+    }
+  }
+  return -1;
+}
+
+const char* estimator_name(enum EstimatorType type)
+{
+  return estimator_names[type];
+}
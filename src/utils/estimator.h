@@ -0,0 +1,52 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "utils/compress.h"
+
+#ifndef ESTIMATOR_H /* Include guard */
+#define ESTIMATOR_H
+
+enum EstimatorType { ESTIMATOR_ZLIB, ESTIMATOR_PACKED, ESTIMATOR_LZ77,
+                     ESTIMATOR_CONTEXT };
+#define ESTIMATORS 4
+
+#define CONTEXT_ORDER 4 /* Causal neighbors of the context model */
+#define CONTEXT_MAX_COUNTS (1 << 16) /* Largest table of counts, the order
+                                        is lowered for many states */
+
+/**
+ * @brief Estimate of the compressed size of the frames of an automaton.
+ *
+ * The backends trade accuracy for speed:
+ *
+ * - zlib compresses the frame printed as text, one character per cell and a
+ *   newline per row, which is the compressed size of the paper;
+ * - packed compresses the cells packed on 1, 2, 4 or 8 bits with zlib;
+ * - lz77 parses the packed cells with a greedy LZ77 matcher and counts the
+ *   bits of the tokens, without any entropy coder;
+ * - context sums the code lengths of an adaptive order-k arithmetic coder
+ *   predicting each cell from its k causal neighbors (west, north,
+ *   north-west and north-east), the Krichevsky-Trofimov estimate of each
+ *   context giving them from its final counts.
+ *
+ * All sizes are in bytes. An estimator is used by one thread at a time.
+ */
+typedef struct estimator_s estimator_t;
+
+/**
+ * Estimator of size x size frames of cells below `states`. The zlib
+ * backends compress with the given context, which stays owned by the caller.
+ */
+estimator_t* estimator_new(enum EstimatorType, size_t size, int states,
+                           compressor_t*);
+
+/** Estimated compressed size of a flat size x size frame */
+int estimator_size(estimator_t*, uint8_t* frame);
+
+void estimator_free(estimator_t*);
+
+/** Backend of the given name, -1 if there is none */
+int estimator_parse(const char* name);
+
+const char* estimator_name(enum EstimatorType);
+
+#endif // ESTIMATOR_H
@@ -0,0 +1,219 @@
+#include <string.h>
+#include "utils/frame_lz.h"
+
+#define SLOTS (FRAME_LZ_WINDOW + 1) /* The window and the frame being fed */
+#define TAG_BITS 3 /* Bits of the kind of a token, one of 5 */
+#define FRAME_BITS 2 /* Bits of the index of a co-located frame */
+#define SHIFTS ((2 * FRAME_LZ_SHIFT + 1) * (2 * FRAME_LZ_SHIFT + 1))
+
+struct frame_lz_s
+{
+  size_t bytes;
+  size_t width;
+  int state_bits; /**< Bits of a literal cell */
+  int offset_bits; /**< Bits of an offset in the window */
+  int shift_bits; /**< Bits of a shift of the previous frame */
+  uint8_t* frames[SLOTS]; /**< Frame f in slot f % SLOTS */
+  uint64_t fed; /**< Frames fed since the last reset */
+  uint64_t* table; /**< Position + 1 of the last occurrence of each hash,
+                      frame f starting at position f * bytes */
+  uint64_t bits; /**< Total size of the frames fed */
+  uint64_t distance; /**< Distance of the last match */
+};
+
+frame_lz_t* frame_lz_new(size_t width, size_t height, int states)
+{
+  frame_lz_t* lz = (frame_lz_t*) malloc(sizeof(frame_lz_t));
+  size_t bytes = width * height;
+
+  lz->bytes = bytes;
+  lz->width = width;
+  lz->state_bits = 1;
+  while ((1 << lz->state_bits) < states) {
+    ++lz->state_bits;
+  }
+  lz->offset_bits = 64 - __builtin_clzll((uint64_t) SLOTS * bytes);
+  lz->shift_bits = 32 - __builtin_clz(SHIFTS - 1);
+  for (int s = 0; s < SLOTS; ++s) {
+    lz->frames[s] = (uint8_t*) malloc(bytes);
+  }
+  lz->table = (uint64_t*) malloc(((size_t) 1 << FRAME_LZ_HASH_BITS)
+                                 * sizeof(uint64_t));
+  frame_lz_reset(lz);
+  return lz;
+}
+
+void frame_lz_reset(frame_lz_t* lz)
+{
+  lz->fed = 0;
+  lz->bits = 0;
+  lz->distance = 0;
+  memset(lz->table, 0, ((size_t) 1 << FRAME_LZ_HASH_BITS) * sizeof(uint64_t));
+}
+
+static inline uint32_t hash_bytes(uint8_t* p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return (v * 2654435761u) >> (32 - FRAME_LZ_HASH_BITS);
+}
+
+/** Bits of the Elias gamma code of a length */
+static inline int gamma_bits(size_t length)
+{
+  return 2 * (63 - __builtin_clzll(length)) + 1;
+}
+
+/** Bytes at a position of the window, frame f starting at f * bytes */
+static inline uint8_t* window_bytes(frame_lz_t* lz, uint64_t position)
+{
+  return &lz->frames[(position / lz->bytes) % SLOTS][position % lz->bytes];
+}
+
+/** Length of the common prefix of a and b, at most limit */
+static size_t common_length(uint8_t* a, uint8_t* b, size_t limit)
+{
+  size_t l = 0;
+
+  while (l + 8 <= limit) {
+    uint64_t x, y;
+    memcpy(&x, &a[l], 8);
+    memcpy(&y, &b[l], 8);
+    if (x != y) {
+      return l + (__builtin_ctzll(x ^ y) >> 3);
+    }
+    l += 8;
+  }
+  while (l < limit && a[l] == b[l]) {
+    ++l;
+  }
+  return l;
+}
+
+/**
+ * Length of the match at distance d of position i of the frame being fed,
+ * 0 if it is out of the window. A match stops at the end of the frame it
+ * copies.
+ */
+static size_t match_length(frame_lz_t* lz, uint8_t* cur, uint64_t start,
+                           uint64_t oldest, size_t i, uint64_t d)
+{
+  if (d == 0 || d > start + i - oldest) {
+    return 0;
+  }
+  size_t position = (start + i - d) % lz->bytes;
+  size_t limit = (position > i) ? lz->bytes - position: lz->bytes - i;
+  return common_length(window_bytes(lz, start + i - d), &cur[i], limit);
+}
+
+uint64_t frame_lz_feed(frame_lz_t* lz, uint8_t* frame)
+{
+  size_t bytes = lz->bytes;
+  uint64_t f = lz->fed;
+  uint64_t start = f * bytes;
+  int history = (f < FRAME_LZ_WINDOW) ? (int) f: FRAME_LZ_WINDOW;
+  uint64_t oldest = (f - history) * bytes;
+  int literal_bits = TAG_BITS + lz->state_bits;
+  uint8_t* cur = lz->frames[f % SLOTS];
+  uint64_t bits = 0;
+  size_t i = 0;
+
+  memcpy(cur, frame, bytes);
+  while (i < bytes) {
+    size_t best_length = 1;
+    long best_saving = 0;
+    long cost = literal_bits;
+    uint64_t distance = 0;
+
+    /* Co-located bytes of the previous frames, the most recent first */
+    for (int k = 1; k <= history; ++k) {
+      uint8_t* prev = lz->frames[(f - k) % SLOTS];
+      if (prev[i] != cur[i]) {
+        continue;
+      }
+      size_t length = common_length(&prev[i], &cur[i], bytes - i);
+      long token = TAG_BITS + FRAME_BITS + gamma_bits(length);
+      long saving = (long) length * literal_bits - token;
+      if (saving > best_saving) {
+        best_length = length;
+        best_saving = saving;
+        cost = token;
+      }
+    }
+
+    /* Matches at the distance of the last one, which follow a pattern
+       moving across the frames, then at the last occurrence of the next
+       bytes */
+    uint64_t candidates[2] = {
+      lz->distance,
+      (i + FRAME_LZ_MIN_MATCH <= bytes)
+      ? start + i + 1 - lz->table[hash_bytes(&cur[i])]: 0
+    };
+    for (int c = 0; c < 2; ++c) {
+      size_t length = match_length(lz, cur, start, oldest, i, candidates[c]);
+      if (length == 0) {
+        continue;
+      }
+      long token = TAG_BITS + ((c == 0) ? 0: lz->offset_bits)
+        + gamma_bits(length);
+      long saving = (long) length * literal_bits - token;
+      if (saving > best_saving) {
+        best_length = length;
+        best_saving = saving;
+        cost = token;
+        distance = candidates[c];
+      }
+    }
+
+    /* Otherwise the region of the previous frame around the cell, shifted
+       by up to FRAME_LZ_SHIFT rows and columns, where a pattern that moved
+       since then is found */
+    for (int dy = -FRAME_LZ_SHIFT;
+         dy <= FRAME_LZ_SHIFT && history > 0
+           && best_length < FRAME_LZ_MIN_MATCH; ++dy) {
+      for (int dx = -FRAME_LZ_SHIFT; dx <= FRAME_LZ_SHIFT; ++dx) {
+        uint64_t d = bytes - dy * (long) lz->width - dx;
+        size_t length = match_length(lz, cur, start, oldest, i, d);
+        if (length == 0) {
+          continue;
+        }
+        long token = TAG_BITS + lz->shift_bits + gamma_bits(length);
+        long saving = (long) length * literal_bits - token;
+        if (saving > best_saving) {
+          best_length = length;
+          best_saving = saving;
+          cost = token;
+          distance = d;
+        }
+      }
+    }
+
+    if (distance > 0) {
+      lz->distance = distance;
+    }
+    bits += cost;
+    for (size_t end = i + best_length; i < end; ++i) {
+      if (i + FRAME_LZ_MIN_MATCH <= bytes) {
+        lz->table[hash_bytes(&cur[i])] = start + i + 1;
+      }
+    }
+  }
+
+  ++lz->fed;
+  lz->bits += bits;
+  return bits;
+}
+
+long frame_lz_size(frame_lz_t* lz)
+{
+  return (long) ((lz->bits + 7) / 8);
+}
+
+void frame_lz_free(frame_lz_t* lz)
+{
+  for (int s = 0; s < SLOTS; ++s) {
+    free(lz->frames[s]);
+  }
+  free(lz->table);
+  free(lz);
+}
@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifndef FRAME_LZ_H /* Include guard */
+#define FRAME_LZ_H
+
+#define FRAME_LZ_WINDOW 4 /* Previous frames a frame can refer to */
+#define FRAME_LZ_HASH_BITS 16
+#define FRAME_LZ_MIN_MATCH 4 /* Bytes hashed to find the matches */
+#define FRAME_LZ_SHIFT 2 /* Largest shift of the previous frame tried when
+                            there is no other match */
+
+/**
+ * @brief Compressed size of a sequence of frames of the same size, with a
+ * window of several frames.
+ *
+ * Deflate only looks 32 KB back, less than a 256x256 frame, so it cannot
+ * compress a frame against the previous one. This matcher keeps the last
+ * FRAME_LZ_WINDOW frames and parses each new frame greedily into five
+ * kinds of tokens:
+ *
+ * - a copy of the co-located bytes of one of the previous frames, found by
+ *   comparing the frames directly, which encodes still lifes, oscillators of
+ *   a period up to the window and the background;
+ * - a match at the distance of the last match, which follows a pattern
+ *   moving across the frames;
+ * - a match at the last occurrence of the next bytes in the window or
+ *   earlier in the frame, found through a hash;
+ * - a match in the previous frame shifted by a few cells;
+ * - a literal cell.
+ *
+ * The size is the number of bits of the tokens: a tag telling their kind,
+ * lengths coded with Elias gamma codes, offsets on the bits of the window,
+ * shifts on the bits of their number and literals on the bits of a state.
+ * There is no entropy coder, which makes it several times faster than
+ * deflate at its best level.
+ */
+typedef struct frame_lz_s frame_lz_t;
+
+/** Matcher for frames of height rows of width cells below `states` */
+frame_lz_t* frame_lz_new(size_t width, size_t height, int states);
+
+/** Forget the previous frames and the total size */
+void frame_lz_reset(frame_lz_t*);
+
+/**
+ * Compress a frame given the previous ones and add its size to the total.
+ * Returns the size in bits of the frame conditioned on the window.
+ */
+uint64_t frame_lz_feed(frame_lz_t*, uint8_t* frame);
+
+/** Total compressed size in bytes of the frames fed since the last reset */
+long frame_lz_size(frame_lz_t*);
+
+void frame_lz_free(frame_lz_t*);
+
+#endif // FRAME_LZ_H
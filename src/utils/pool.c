@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include "pool.h"
+
+typedef struct barrier_s
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int count;
+  int waiting;
+  unsigned long generation;
+} barrier_t;
+
+struct pool_s
+{
+  int n_threads;
+  pthread_t* threads;
+  barrier_t start; /**< Released when a job is posted */
+  barrier_t barrier; /**< Synchronization inside a job */
+  PoolF job; /**< Current job, NULL to stop the workers */
+  void* arg;
+};
+
+typedef struct worker_s
+{
+  pool_t* pool;
+  int index;
+} worker_t;
+
+static void barrier_init(barrier_t* b, int count)
+{
+  pthread_mutex_init(&b->mutex, NULL);
+  pthread_cond_init(&b->cond, NULL);
+  b->count = count;
+  b->waiting = 0;
+  b->generation = 0;
+}
+
+static void barrier_wait(barrier_t* b)
+{
+  pthread_mutex_lock(&b->mutex);
+  unsigned long generation = b->generation;
+  if (++b->waiting == b->count) {
+    b->waiting = 0;
+    b->generation++;
+    pthread_cond_broadcast(&b->cond);
+  }
+  else {
+    while (generation == b->generation) {
+      pthread_cond_wait(&b->cond, &b->mutex);
+    }
+  }
+  pthread_mutex_unlock(&b->mutex);
+}
+
+static void barrier_destroy(barrier_t* b)
+{
+  pthread_mutex_destroy(&b->mutex);
+  pthread_cond_destroy(&b->cond);
+}
+
+static void* worker_loop(void* in)
+{
+  worker_t* worker = (worker_t*) in;
+  pool_t* pool = worker->pool;
+
+  for (;;) {
+    barrier_wait(&pool->start);
+    if (pool->job == NULL) {
+      break;
+    }
+    pool->job(pool, pool->arg, worker->index);
+    barrier_wait(&pool->barrier);
+  }
+
+  free(worker);
+  return NULL;
+}
+
+pool_t* pool_new(int n_threads)
+{
+  pool_t* pool = (pool_t*) malloc(sizeof(pool_t));
+  pool->n_threads = (n_threads > 0) ? n_threads: 1;
+  pool->threads = (pthread_t*) malloc(sizeof(pthread_t) * pool->n_threads);
+  pool->job = NULL;
+  barrier_init(&pool->start, pool->n_threads);
+  barrier_init(&pool->barrier, pool->n_threads);
+
+  for (int i = 1; i < pool->n_threads; ++i) {
+    worker_t* worker = (worker_t*) malloc(sizeof(worker_t));
+    worker->pool = pool;
+    worker->index = i;
+    pthread_create(&pool->threads[i], NULL, worker_loop, worker);
+  }
+  return pool;
+}
+
+int pool_size(pool_t* pool)
+{
+  return pool->n_threads;
+}
+
+void pool_run(pool_t* pool, PoolF job, void* arg)
+{
+  pool->job = job;
+  pool->arg = arg;
+  barrier_wait(&pool->start);
+  job(pool, arg, 0);
+  barrier_wait(&pool->barrier);
+}
+
+void pool_barrier(pool_t* pool)
+{
+  barrier_wait(&pool->barrier);
+}
+
+void pool_band(pool_t* pool, int worker, size_t count,
+               size_t* begin, size_t* end)
+{
+  *begin = count * worker / pool->n_threads;
+  *end = count * (worker + 1) / pool->n_threads;
+}
+
+void pool_free(pool_t* pool)
+{
+  pool->job = NULL;
+  barrier_wait(&pool->start);
+  for (int i = 1; i < pool->n_threads; ++i) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  barrier_destroy(&pool->start);
+  barrier_destroy(&pool->barrier);
+  free(pool->threads);
+  free(pool);
+}
@@ -0,0 +1,34 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#ifndef POOL_H /* Include guard */
+#define POOL_H
+
+/**
+ * @brief A persistent pool of worker threads.
+ *
+ * The calling thread takes part in every job as worker 0, so a pool of n
+ * threads only spawns n - 1 of them. Workers sleep between jobs.
+ */
+typedef struct pool_s pool_t;
+
+/** Job executed by every worker of a pool with its worker index */
+typedef void (*PoolF)(pool_t*, void* arg, int worker);
+
+pool_t* pool_new(int n_threads);
+
+int pool_size(pool_t*);
+
+/** Run `job` on all the workers and return once they are all done */
+void pool_run(pool_t*, PoolF job, void* arg);
+
+/** Wait for all the workers of the running job to reach this point */
+void pool_barrier(pool_t*);
+
+/** Split `count` items in contiguous bands, one per worker */
+void pool_band(pool_t*, int worker, size_t count,
+               size_t* begin, size_t* end);
+
+void pool_free(pool_t*);
+
+#endif // POOL_H
@@ -0,0 +1,141 @@
+#include <pthread.h>
+#include <string.h>
+#include "utils/size_queue.h"
+
+struct size_queue_s
+{
+  int depth;
+  size_t size;
+  int states;
+  enum EstimatorType type;
+  uint8_t* frames; /**< Frame of push j in slot j % depth */
+  int* sizes;
+  int* done; /**< Set when the size of the slot is computed */
+  long pushed;
+  long taken; /**< Pushes taken by a worker */
+  long popped;
+  int stop;
+  pthread_mutex_t mutex;
+  pthread_cond_t pending; /**< Signaled on a push or stop */
+  pthread_cond_t measured; /**< Signaled when a size is computed */
+  int workers;
+  pthread_t* threads;
+};
+
+static void* worker_loop(void* in)
+{
+  size_queue_t* q = (size_queue_t*) in;
+  size_t cells = q->size * q->size;
+  compressor_t* compressor = compressor_new(Z_BEST_COMPRESSION,
+                                            Z_DEFAULT_STRATEGY);
+  estimator_t* estimator = estimator_new(q->type, q->size, q->states,
+                                         compressor);
+
+  pthread_mutex_lock(&q->mutex);
+  for (;;) {
+    while (!q->stop && q->taken == q->pushed) {
+      pthread_cond_wait(&q->pending, &q->mutex);
+    }
+    if (q->stop) {
+      break;
+    }
+    int slot = q->taken++ % q->depth;
+    pthread_mutex_unlock(&q->mutex);
+
+    /* The slot is only reused once its size has been popped */
+    int size = estimator_size(estimator, &q->frames[slot * cells]);
+
+    pthread_mutex_lock(&q->mutex);
+    q->sizes[slot] = size;
+    q->done[slot] = 1;
+    pthread_cond_broadcast(&q->measured);
+  }
+  pthread_mutex_unlock(&q->mutex);
+
+  estimator_free(estimator);
+  compressor_free(compressor);
+  return NULL;
+}
+
+size_queue_t* size_queue_new(int workers, int depth, enum EstimatorType type,
+                             size_t size, int states)
+{
+  size_queue_t* q = (size_queue_t*) calloc(1, sizeof(size_queue_t));
+
+  q->depth = depth;
+  q->size = size;
+  q->states = states;
+  q->type = type;
+  q->frames = (uint8_t*) malloc(depth * size * size * sizeof(uint8_t));
+  q->sizes = (int*) calloc(depth, sizeof(int));
+  q->done = (int*) calloc(depth, sizeof(int));
+  pthread_mutex_init(&q->mutex, NULL);
+  pthread_cond_init(&q->pending, NULL);
+  pthread_cond_init(&q->measured, NULL);
+
+  q->workers = workers;
+  q->threads = (pthread_t*) malloc(workers * sizeof(pthread_t));
+  for (int w = 0; w < workers; ++w) {
+    pthread_create(&q->threads[w], NULL, worker_loop, q);
+  }
+  return q;
+}
+
+int size_queue_full(size_queue_t* q)
+{
+  /* Only the pushing thread changes pushed and popped */
+  return q->pushed - q->popped == q->depth;
+}
+
+void size_queue_push(size_queue_t* q, uint8_t* frame)
+{
+  size_t cells = q->size * q->size;
+  int slot = q->pushed % q->depth;
+
+  memcpy(&q->frames[slot * cells], frame, cells * sizeof(uint8_t));
+  pthread_mutex_lock(&q->mutex);
+  q->pushed++;
+  pthread_cond_signal(&q->pending);
+  pthread_mutex_unlock(&q->mutex);
+}
+
+int size_queue_pop(size_queue_t* q, int wait, int* size)
+{
+  int found = 0;
+
+  pthread_mutex_lock(&q->mutex);
+  if (q->popped < q->pushed) {
+    int slot = q->popped % q->depth;
+    while (wait && !q->done[slot]) {
+      pthread_cond_wait(&q->measured, &q->mutex);
+    }
+    if (q->done[slot]) {
+      *size = q->sizes[slot];
+      q->done[slot] = 0;
+      q->popped++;
+      found = 1;
+    }
+  }
+  pthread_mutex_unlock(&q->mutex);
+  return found;
+}
+
+void size_queue_free(size_queue_t* q)
+{
+  pthread_mutex_lock(&q->mutex);
+  q->stop = 1;
+  pthread_cond_broadcast(&q->pending);
+  pthread_mutex_unlock(&q->mutex);
+  for (int w = 0; w < q->workers; ++w) {
+    pthread_join(q->threads[w], NULL);
+  }
+
+  pthread_mutex_destroy(&q->mutex);
+  pthread_cond_destroy(&q->pending);
+  pthread_cond_destroy(&q->measured);
+  free(q->threads);
+  free(q->frames);
+  free(q->sizes);
+  free(q->done);
+  free(q);
+}
@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "utils/estimator.h"
+
+#ifndef SIZE_QUEUE_H /* Include guard */
+#define SIZE_QUEUE_H
+
+/**
+ * @brief Compressed sizes computed by worker threads while the automaton
+ * is stepped.
+ *
+ * The stepping thread pushes copies of the measured frames into a bounded
+ * ring and pops their sizes in the order of the pushes. Each worker takes
+ * the oldest frame not taken yet and measures it with its own estimator, so
+ * frames are measured concurrently but read back in order. Frames are
+ * copied when pushed and not modified afterwards.
+ */
+typedef struct size_queue_s size_queue_t;
+
+/**
+ * Queue of `depth` frames of size x size cells measured by `workers`
+ * threads with the given estimator backend.
+ */
+size_queue_t* size_queue_new(int workers, int depth, enum EstimatorType,
+                             size_t size, int states);
+
+/** Whether depth frames are pending, a push then having to wait for a pop */
+int size_queue_full(size_queue_t*);
+
+/** Copy a frame into the queue, which must not be full */
+void size_queue_push(size_queue_t*, uint8_t* frame);
+
+/**
+ * Size of the oldest pending frame. Returns 0 if no frame is pending, or if
+ * its size is not computed yet and `wait` is 0, and 1 otherwise.
+ */
+int size_queue_pop(size_queue_t*, int wait, int* size);
+
+/** Stop the workers, the pending frames being dropped */
+void size_queue_free(size_queue_t*);
+
+#endif // SIZE_QUEUE_H
@@ -0,0 +1,143 @@
+/**
+ * Microbenchmark of the update step kernels against update_step_general.
+ * Build with
+ * make bench
+ * and run with
+ * bin/step_bench [size] [states] [horizon] [steps] [time_block]
+ *
+ * The sliding engine is then run with temporal blocking of time_block
+ * generations to measure the savings of stepping cache-sized tiles.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "automaton/2d_automaton.h"
+#include "automaton/engine.h"
+#include "automaton/gather.h"
+#include "automaton/kernels.h"
+#include "automaton/specialized.h"
+#include "utils/utils.h"
+
+typedef struct kernel_s
+{
+  const char* name;
+  ProcessF function;
+} kernel_t;
+
+double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+  size_t size = (argc > 1) ? atol(argv[1]): 256;
+  int states = (argc > 2) ? atoi(argv[2]): 3;
+  int horizon = (argc > 3) ? atoi(argv[3]): 1;
+  long steps = (argc > 4) ? atol(argv[4]): 200;
+  int time_block = (argc > 5) ? atoi(argv[5]): 4;
+
+  int neigs = (2 * horizon + 1) * (2 * horizon + 1);
+  uint64_t grule_size = ipow(states, neigs);
+  uint32_t pows[neigs];
+  for (int i = 0; i < neigs; ++i) {
+    pows[i] = ipow(states, i);
+  }
+
+  srand(0);
+  uint8_t* rule = calloc(grule_size + RULE_PADDING, sizeof(uint8_t));
+  for (uint64_t i = 0; i < grule_size; ++i) {
+    rule[i] = rand() % states;
+  }
+
+  size_t pitch = size + 2 * horizon;
+  uint8_t* init = malloc(size * size * sizeof(uint8_t));
+  uint8_t* reference = malloc(size * size * sizeof(uint8_t));
+  uint8_t* result = malloc(size * size * sizeof(uint8_t));
+  uint8_t* frame1 = calloc(pitch * pitch, sizeof(uint8_t));
+  uint8_t* frame2 = calloc(pitch * pitch, sizeof(uint8_t));
+  uint8_t* temp;
+  for (size_t i = 0; i < size * size; ++i) {
+    init[i] = rand() % states;
+  }
+
+  printf("size %zu, %i states, horizon %i, %li steps\n",
+         size, states, horizon, steps);
+
+  /* Kernels picked from the rule shape or the CPU are skipped if NULL */
+  kernel_t kernels[] = {
+                        {"general", update_step_general},
+                        {"sliding", update_step_sliding},
+                        {"special", specialized_kernel(states, horizon)},
+                        {gather_kernel_name(), gather_kernel()},
+  };
+
+  double base = 0.;
+  for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+    ProcessF function = kernels[k].function;
+    if (function == NULL) {
+      continue;
+    }
+    pad_frame(size, horizon, init, frame1);
+
+    double start = now();
+    for (long s = 0; s < steps; ++s) {
+      function(size, frame2, rule, frame1, horizon, pows, 0, size);
+      temp = frame1;
+      frame1 = frame2;
+      frame2 = temp;
+    }
+    double elapsed = now() - start;
+    unpad_frame(size, horizon, frame1, result);
+
+    const char* check = "";
+    if (k == 0) {
+      base = elapsed;
+      memcpy(reference, result, size * size * sizeof(uint8_t));
+    }
+    else {
+      check = memcmp(reference, result, size * size) ? "MISMATCH": "ok";
+    }
+
+    printf("%-10s %8.2f Mcells/s  x%5.2f  %s\n", kernels[k].name,
+           (double)(size * size) * steps / elapsed * 1E-6,
+           base / elapsed, check);
+  }
+
+  struct Options2D opts;
+  memset(&opts, 0, sizeof(opts));
+  opts.size = size;
+  opts.states = states;
+  opts.horizon = horizon;
+  opts.engine = ENGINE_SLIDING;
+  opts.threads = 1;
+  opts.time_block = time_block;
+  neighborhood_init(&opts.neighborhood, SHAPE_MOORE, horizon);
+
+  engine_t* engine = engine_new(grule_size, rule, &opts);
+  engine->load(engine, init);
+  double start = now();
+  engine->step(engine, steps);
+  double elapsed = now() - start;
+  engine->store(engine, result);
+  engine_free(engine);
+  neighborhood_free(&opts.neighborhood);
+
+  char name[32];
+  snprintf(name, sizeof(name), "blocked/%i", time_block);
+  printf("%-10s %8.2f Mcells/s  x%5.2f  %s\n", name,
+         (double)(size * size) * steps / elapsed * 1E-6, base / elapsed,
+         memcmp(reference, result, size * size) ? "MISMATCH": "ok");
+
+  free(rule);
+  free(init);
+  free(reference);
+  free(result);
+  free(frame1);
+  free(frame2);
+  return 0;
+}